@@ -66,6 +66,28 @@ struct StellarLauncher
         dream_stellar::stellar_kernel_runtime & strand_runtime,
         StringSet<QueryMatches<StellarMatch<String<TAlphabet> const, TId> > > & localMatches
     )
+    {
+        // finder
+        StellarSwiftFinder<TAlphabet> swiftFinder(databaseSegment.asInfixSegment(), localOptions.minRepeatLength, localOptions.maxRepeatPeriod);
+
+        return search_and_verify(databaseID, databaseStrand, localOptions, localSwiftPattern, swiftFinder, strand_runtime, localMatches);
+    }
+
+    /**
+     * @brief Searches with a finder over the database segment that was created by the caller, e.g. a copy of a finder
+     *        that is reused for several searches of the same segment, so that the low complexity repeats of the segment
+     *        are found only once.
+     */
+    static StellarComputeStatistics
+    search_and_verify(
+        TId const & databaseID,
+        bool const databaseStrand,
+        StellarOptions & localOptions, // localOptions.compactThresh is out-param
+        StellarSwiftPattern<TAlphabet> & localSwiftPattern,
+        StellarSwiftFinder<TAlphabet> & swiftFinder,
+        dream_stellar::stellar_kernel_runtime & strand_runtime,
+        StringSet<QueryMatches<StellarMatch<String<TAlphabet> const, TId> > > & localMatches
+    )
     {
         using TSequence = String<TAlphabet>;
 
@@ -100,9 +122,6 @@ struct StellarLauncher
             );
         };
 
-        // finder
-        StellarSwiftFinder<TAlphabet> swiftFinder(databaseSegment.asInfixSegment(), localOptions.minRepeatLength, localOptions.maxRepeatPeriod);
-
         StellarComputeStatistics statistics = _verificationMethodVisit(
             localOptions.verificationMethod,
             [&]<typename TTag>(TTag) -> StellarComputeStatistics
@@ -30,6 +30,13 @@ public:
 
     threshold(threshold_parameters const & arguments);
 
+    /*!\brief Uses precomputed tables instead of precomputing them.
+     * \details Tables that are empty or do not match the minimiser range of the arguments are precomputed as usual.
+     */
+    threshold(threshold_parameters const & arguments,
+              std::vector<size_t> thresholds,
+              std::vector<size_t> correction);
+
     size_t get(size_t const minimiser_count) const noexcept;
 
 private:
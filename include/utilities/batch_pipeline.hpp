@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace valik
+{
+
+/**
+ * @brief A FIFO queue with a fixed capacity that is shared by a producer and a consumer thread.
+ *
+ * push blocks while the queue is full and pop blocks while the queue is empty. After close, push fails and pop returns
+ * the remaining values, so that either side can stop the other one.
+ */
+template <typename value_t>
+class bounded_queue
+{
+private:
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<value_t> values{};
+    size_t capacity;
+    bool closed{false};
+
+public:
+    bounded_queue() = delete;
+    bounded_queue(bounded_queue const &) = delete;
+    bounded_queue & operator=(bounded_queue const &) = delete;
+    bounded_queue(bounded_queue &&) = delete;
+    bounded_queue & operator=(bounded_queue &&) = delete;
+    ~bounded_queue() = default;
+
+    explicit bounded_queue(size_t const capacity_) : capacity{std::max<size_t>(capacity_, 1u)}
+    {}
+
+    //!\brief Appends a value. Returns false without appending if the queue was closed.
+    bool push(value_t value)
+    {
+        std::unique_lock lk{mutex};
+        not_full.wait(lk, [&] { return closed || values.size() < capacity; });
+        if (closed)
+            return false;
+        values.push_back(std::move(value));
+        lk.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    //!\brief Removes the oldest value. Returns std::nullopt if the queue is closed and empty.
+    std::optional<value_t> pop()
+    {
+        std::unique_lock lk{mutex};
+        not_empty.wait(lk, [&] { return closed || !values.empty(); });
+        if (values.empty())
+            return std::nullopt;
+        value_t value = std::move(values.front());
+        values.pop_front();
+        lk.unlock();
+        not_full.notify_one();
+        return value;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard lk{mutex};
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+};
+
+/**
+ * @brief Collects records into batches of at least batch_bytes bytes and passes each full batch on.
+ */
+template <typename record_t>
+class batch_builder
+{
+public:
+    using emit_t = std::function<bool(std::vector<record_t> &&)>;
+
+private:
+    emit_t emit;
+    size_t batch_bytes;
+    std::vector<record_t> records{};
+    size_t bytes{0};
+
+public:
+    batch_builder(emit_t emit_, size_t const batch_bytes_) : emit{std::move(emit_)}, batch_bytes{batch_bytes_}
+    {}
+
+    /**
+     * @brief Adds a record to the current batch and passes the batch on when it is full.
+     *
+     * @param record The record.
+     * @param record_bytes Memory that the record occupies, e.g. the length of its sequence.
+     * @return false if the consumer stopped and no more records should be read.
+     */
+    bool add(record_t && record, size_t const record_bytes)
+    {
+        records.push_back(std::move(record));
+        bytes += record_bytes;
+        return bytes < batch_bytes || flush();
+    }
+
+    //!\brief Passes the current batch on if it is not empty.
+    bool flush()
+    {
+        if (records.empty())
+            return true;
+        bytes = 0;
+        return emit(std::exchange(records, {}));
+    }
+};
+
+/**
+ * @brief Function that overlaps reading records with processing them.
+ *
+ * The records are read on a thread of their own into batches of batch_bytes bytes. Up to queued_batches full batches
+ * wait in a bounded queue while the calling thread processes an earlier batch, i.e. at most queued_batches + 2 batches
+ * are in memory. Exceptions of either stage stop both stages and are rethrown.
+ *
+ * @param read_records Callable that takes a batch_builder<record_t> & and adds all records to it.
+ *                     It should stop reading when batch_builder::add returns false.
+ * @param process_batch Callable that takes a std::vector<record_t> const & and processes the batch.
+ * @param batch_bytes Minimum size of a batch in bytes. The last batch can be smaller.
+ * @param queued_batches Number of full batches that the reader can be ahead of processing.
+ */
+template <typename record_t, typename read_fn_t, typename process_fn_t>
+void run_batch_pipeline(read_fn_t && read_records,
+                        process_fn_t && process_batch,
+                        size_t const batch_bytes,
+                        size_t const queued_batches)
+{
+    bounded_queue<std::vector<record_t>> batches{queued_batches};
+    std::exception_ptr read_error{};
+
+    std::jthread reader{[&]()
+    {
+        try
+        {
+            batch_builder<record_t> builder{[&batches](std::vector<record_t> && batch)
+                                            {
+                                                return batches.push(std::move(batch));
+                                            },
+                                            batch_bytes};
+            read_records(builder);
+            builder.flush();
+        }
+        catch (...)
+        {
+            read_error = std::current_exception();
+        }
+        batches.close();
+    }};
+
+    try
+    {
+        while (std::optional<std::vector<record_t>> batch = batches.pop())
+            process_batch(std::as_const(*batch));
+    }
+    catch (...)
+    {
+        batches.close();    // the reader stops at the next batch
+        throw;
+    }
+
+    reader.join();
+    if (read_error)
+        std::rethrow_exception(read_error);
+}
+
+} // namespace valik
@@ -1,52 +1,184 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
+/** The number of values after which the carts of each bin are sent of to be consumed.
+ *
+ * By default every bin uses the fixed initial capacity. With a target duration, consumers report how long they took
+ * to process a cart and the capacity of its bin moves toward the number of values that would take the target
+ * duration. Carts that take too long shrink the capacity, so that the work is spread over all consumers, and carts
+ * that are quickly processed grow it, so that fixed costs per cart (e.g. building an index of the values) are
+ * amortised. The capacity stays within [min_capacity, max_capacity].
+ */
+struct cart_capacity {
+    std::vector<std::atomic<size_t>> per_bin;
+    double target_duration{0.0}; // seconds per cart, 0 means a fixed capacity
+    size_t min_capacity;
+    size_t max_capacity;
+
+    cart_capacity(size_t number_of_bins, size_t initial_capacity)
+        : per_bin(number_of_bins)
+        , min_capacity{std::max<size_t>(initial_capacity, 1u)}
+        , max_capacity{std::max<size_t>(initial_capacity, 1u)}
+    {
+        for (auto& capacity : per_bin) {
+            capacity.store(min_capacity, std::memory_order_relaxed);
+        }
+    }
+
+    bool adaptive() const noexcept {
+        return target_duration > 0.0;
+    }
+
+    // Lets the capacities adapt to the reported durations - call before the first value is inserted
+    void adapt(double target_duration_, size_t min_capacity_, size_t max_capacity_) {
+        target_duration = target_duration_;
+        min_capacity = std::max<size_t>(min_capacity_, 1u);
+        max_capacity = std::max(max_capacity_, min_capacity);
+        for (auto& capacity : per_bin) {
+            capacity.store(std::clamp(capacity.load(std::memory_order_relaxed), min_capacity, max_capacity),
+                           std::memory_order_relaxed);
+        }
+    }
+
+    size_t operator()(size_t bin_id) const noexcept {
+        return per_bin[bin_id].load(std::memory_order_relaxed);
+    }
+
+    // Moves the capacity of a bin toward the size of a cart that would take the target duration - thread safe
+    void report(size_t bin_id, size_t cart_size, double seconds) {
+        if (!adaptive() || cart_size == 0) return;
+
+        double const ideal = seconds > 0.0 ? cart_size * target_duration / seconds : static_cast<double>(max_capacity);
+        // the geometric mean of the current and the ideal capacity damps the noise of single carts
+        double const next = std::sqrt(static_cast<double>(per_bin[bin_id].load(std::memory_order_relaxed)) * ideal);
+        per_bin[bin_id].store(std::clamp(static_cast<size_t>(std::llround(next)), min_capacity, max_capacity),
+                              std::memory_order_relaxed);
+    }
+};
+
+// splits a cart in halves until each part costs at most max_cost or holds a single value
+template <typename value_t>
+void split_cart(std::function<double(size_t, std::vector<value_t> const&)> const& cost,
+                size_t bin_id,
+                std::vector<value_t>&& basket,
+                double max_cost,
+                std::vector<std::tuple<double, size_t, std::vector<value_t>>>& parts) {
+    double const basket_cost = cost(bin_id, basket);
+    if (basket.size() < 2 || basket_cost <= max_cost) {
+        parts.emplace_back(basket_cost, bin_id, std::move(basket));
+        return;
+    }
+
+    auto const middle = basket.begin() + basket.size() / 2;
+    std::vector<value_t> second_half(std::make_move_iterator(middle), std::make_move_iterator(basket.end()));
+    basket.erase(middle, basket.end());
+    split_cart(cost, bin_id, std::move(basket), max_cost, parts);
+    split_cart(cost, bin_id, std::move(second_half), max_cost, parts);
+}
+
 /** A cart queue groups values together and sends them to consumers in batches.
  *
  * The cart queue is organized in so called carts. There is a list of carts that currently are being filled.
  * Each cart that is being filled, collects values for a unique bin. If a cart is full it is being pushed
  * to to full cart queue. The full cart queue then can be processed by consumers.
  *
+ * Without a cost function the newest full cart is processed first. With a cost function the most expensive
+ * full cart is processed first (longest processing time first), and finish splits partially filled carts that
+ * cost more than an even share of the remaining work of the consumers, so that no consumer is left with a
+ * single expensive cart at the end.
+ *
+ * The cart capacity can adapt to the time it takes to process a cart, see cart_capacity and report_cart_duration.
+ *
+ * A consumer can prefer the carts of a bin, e.g. of the bin that it processed last, so that it can reuse state that
+ * it derived for the bin. It only takes a cart of another bin if no cart of the preferred bin is full. The full carts
+ * of each bin are kept in a heap of their own and the bins in a heap by their first cart, i.e. taking a cart of the
+ * preferred bin costs as much as taking the first cart.
+ *
  * The cart queue is designed to be accessed by multiple consumers and producers concurrently.
  */
 template <typename value_t>
 struct cart_queue {
     using cart = std::vector<value_t>;
 
+    //!< Estimated time to process a cart of a bin, e.g. the summed query length times the length of the bin
+    using cost_fn = std::function<double(size_t, cart const&)>;
+
     // same as cart, but with additional mutex
     struct secured_cart {
         std::mutex mutex;
         cart       basket;
     };
 
+    // a full cart and the priority that it is dequeued with
+    struct queued_cart {
+        double priority;
+        size_t bin_id;
+        cart   basket;
+    };
+
      //!< List of carts that are ready to be filled
     std::vector<secured_cart> carts_being_filled;
 
-    //!< Maximum number of elements that should be put into a cart before it is send of to be consumed
-    size_t cart_max_capacity;
+    //!< Number of elements that should be put into a cart of each bin before it is send of to be consumed
+    cart_capacity capacity;
 
     std::mutex filled_carts_mutex;
     std::condition_variable filled_carts_process_ready_cv;
     std::condition_variable filled_carts_queue_ready_cv;
 
-    std::vector<std::tuple<size_t, cart>> filled_carts;
+    static constexpr size_t not_queued{std::numeric_limits<size_t>::max()};
+
+    //!< Max-heap of the full carts of each bin by priority
+    std::vector<std::vector<queued_cart>> filled_carts;
+    //!< Max-heap of the bins that have full carts, by the priority of their first cart
+    std::vector<size_t> filled_bins;
+    //!< Position of each bin in filled_bins, not_queued if the bin has no full cart
+    std::vector<size_t> filled_bin_position;
+    size_t filled_cart_count{0};
     size_t max_queued_carts;
     bool finishing{false};
 
-    cart_queue(size_t number_of_bins, size_t cart_max_capacity, size_t max_queued_carts)
+    cost_fn cart_cost;
+    size_t  consumer_count;
+    size_t  pushed_carts{0};
+
+    cart_queue(size_t number_of_bins,
+               size_t cart_max_capacity,
+               size_t max_queued_carts,
+               cost_fn cart_cost = {},
+               size_t consumer_count = 1)
         : carts_being_filled(number_of_bins)
-        , cart_max_capacity{cart_max_capacity}
+        , capacity{number_of_bins, cart_max_capacity}
+        , filled_carts(number_of_bins)
+        , filled_bin_position(number_of_bins, not_queued)
         , max_queued_carts{max_queued_carts}
+        , cart_cost{std::move(cart_cost)}
+        , consumer_count{std::max<size_t>(consumer_count, 1u)}
     {
         for (auto& cart : carts_being_filled) {
-            cart.basket.reserve(cart_max_capacity);
+            cart.basket.reserve(capacity.min_capacity);
         }
+        filled_bins.reserve(number_of_bins);
     }
     ~cart_queue() {
         if (!finishing) {
@@ -54,6 +186,106 @@ struct cart_queue {
         }
     }
 
+    // see cart_capacity::adapt
+    void adapt_cart_capacity(double target_duration, size_t min_capacity, size_t max_capacity) {
+        capacity.adapt(target_duration, min_capacity, max_capacity);
+    }
+
+    // a consumer took seconds to process a cart of cart_size values of a bin - thread safe
+    void report_cart_duration(size_t bin_id, size_t cart_size, double seconds) {
+        capacity.report(bin_id, cart_size, seconds);
+    }
+
+    static bool lower_priority(queued_cart const& lhs, queued_cart const& rhs) {
+        return lhs.priority < rhs.priority;
+    }
+
+    double cost(size_t bin_id, cart const& basket) const {
+        return cart_cost ? cart_cost(bin_id, basket) : 0.0;
+    }
+
+    // priority of the first cart of a bin that has full carts
+    double bin_priority(size_t bin_id) const {
+        return filled_carts[bin_id].front().priority;
+    }
+
+    void place_bin(size_t position, size_t bin_id) {
+        filled_bins[position] = bin_id;
+        filled_bin_position[bin_id] = position;
+    }
+
+    // moves the bin at position toward the root of filled_bins until the heap property holds
+    void sift_up(size_t position) {
+        size_t const bin_id = filled_bins[position];
+        double const priority = bin_priority(bin_id);
+        while (position > 0) {
+            size_t const parent = (position - 1) / 2;
+            if (bin_priority(filled_bins[parent]) >= priority) break;
+            place_bin(position, filled_bins[parent]);
+            position = parent;
+        }
+        place_bin(position, bin_id);
+    }
+
+    // moves the bin at position toward the leaves of filled_bins until the heap property holds
+    void sift_down(size_t position) {
+        size_t const bin_id = filled_bins[position];
+        double const priority = bin_priority(bin_id);
+        while (true) {
+            size_t child = 2 * position + 1;
+            if (child >= filled_bins.size()) break;
+            if (child + 1 < filled_bins.size() && bin_priority(filled_bins[child]) < bin_priority(filled_bins[child + 1])) {
+                ++child;
+            }
+            if (bin_priority(filled_bins[child]) <= priority) break;
+            place_bin(position, filled_bins[child]);
+            position = child;
+        }
+        place_bin(position, bin_id);
+    }
+
+    // adds a full cart to the heaps - filled_carts_mutex must be held
+    void push_filled(double cost, size_t bin_id, cart&& basket) {
+        // without a cost function the newest cart has the highest priority
+        double const priority = cart_cost ? cost : static_cast<double>(pushed_carts++);
+        auto& bin_carts = filled_carts[bin_id];
+        bin_carts.push_back(queued_cart{priority, bin_id, std::move(basket)});
+        std::push_heap(bin_carts.begin(), bin_carts.end(), lower_priority);
+        ++filled_cart_count;
+
+        if (filled_bin_position[bin_id] == not_queued) {
+            filled_bins.push_back(bin_id);
+            filled_bin_position[bin_id] = filled_bins.size() - 1;
+        }
+        sift_up(filled_bin_position[bin_id]);
+        filled_carts_process_ready_cv.notify_one();
+    }
+
+    // takes the first cart of a bin that has full carts - filled_carts_mutex must be held
+    queued_cart pop_filled(size_t bin_id) {
+        auto& bin_carts = filled_carts[bin_id];
+        std::pop_heap(bin_carts.begin(), bin_carts.end(), lower_priority);
+        queued_cart v = std::move(bin_carts.back());
+        bin_carts.pop_back();
+        --filled_cart_count;
+
+        size_t const position = filled_bin_position[bin_id];
+        if (!bin_carts.empty()) {
+            // the priority of the bin can only decrease
+            sift_down(position);
+        } else {
+            filled_bin_position[bin_id] = not_queued;
+            size_t const last = filled_bins.back();
+            filled_bins.pop_back();
+            if (last != bin_id) {
+                place_bin(position, last);
+                sift_up(position);
+                sift_down(filled_bin_position[last]);
+            }
+        }
+        return v;
+    }
+
     // Insert a query into a bin - thread safe
     void insert(size_t bin_id, value_t value) {
         assert(bin_id < carts_being_filled.size() && "bin_id has to be between 0 and number_of_bins");
@@ -62,57 +294,488 @@ struct cart_queue {
 
         // locking the cart and inserting the query
         auto _ = std::lock_guard{cart.mutex};
-        assert(cart.basket.size() < cart_max_capacity && "carts should always have at least one empty value");
         cart.basket.emplace_back(std::move(value));
 
-        // check if cart is full
-        if (cart.basket.size() == cart_max_capacity) {
+        // check if cart is full; the capacity of the bin may have shrunk since the last value was inserted
+        size_t const bin_capacity = capacity(bin_id);
+        if (cart.basket.size() >= bin_capacity) {
+            double const basket_cost = cost(bin_id, cart.basket);
+
             // lock full cart queue
             auto _ = std::unique_lock{filled_carts_mutex};
 
             // wait for enough space
-            while (filled_carts.size() == max_queued_carts) {
+            while (filled_cart_count == max_queued_carts) {
                 filled_carts_queue_ready_cv.wait(_);
             }
-            filled_carts.emplace_back(bin_id, std::move(cart.basket));
-            cart.basket.reserve(cart_max_capacity);
-            filled_carts_process_ready_cv.notify_one();
+            push_filled(basket_cost, bin_id, std::move(cart.basket));
+            cart.basket.reserve(bin_capacity);
         }
     }
 
-    // Take a cart from the filled_carts list - thread safe
+    // Take the cart with the highest priority from the filled_carts list - thread safe
     auto dequeue() -> std::optional<std::tuple<int, cart>> {
+        return dequeue(std::numeric_limits<size_t>::max());
+    }
+
+    // Take the cart of preferred_bin with the highest priority, or the cart with the highest priority if no cart of
+    // preferred_bin is full - thread safe. A preferred_bin out of range means no preference.
+    auto dequeue(size_t preferred_bin) -> std::optional<std::tuple<int, cart>> {
         auto g = std::unique_lock{filled_carts_mutex};
 
         // if no cart is available, wait
-        while (filled_carts.empty() and !finishing) {
+        while (filled_cart_count == 0 and !finishing) {
             filled_carts_process_ready_cv.wait(g);
         }
-        if (finishing and filled_carts.empty()) return std::nullopt;
+        if (finishing and filled_cart_count == 0) return std::nullopt;
 
-        // move cart from queue and return it
-        auto v = std::move(filled_carts.back());
-        filled_carts.pop_back();
+        bool const prefer = preferred_bin < filled_carts.size() && !filled_carts[preferred_bin].empty();
+        queued_cart v = pop_filled(prefer ? preferred_bin : filled_bins.front());
         filled_carts_queue_ready_cv.notify_one();
-        return {std::move(v)};
+        return std::tuple<int, cart>{static_cast<int>(v.bin_id), std::move(v.basket)};
     }
 
     // flushes all partially filled carts to the filled_carts list - thread safe
     void finish() {
+        std::vector<std::tuple<double, size_t, cart>> partial_carts;
+        double total_cost{0.0};
         for (size_t bin_id{0}; bin_id < carts_being_filled.size(); ++bin_id) {
             auto& cart = carts_being_filled[bin_id];
             auto g1 = std::unique_lock{cart.mutex};
-            auto g2 = std::unique_lock{filled_carts_mutex};
             if (!cart.basket.empty())
             {
-                filled_carts.emplace_back(bin_id, std::move(cart.basket));
-                cart.basket.reserve(cart_max_capacity);
-                filled_carts_process_ready_cv.notify_one();
+                double const basket_cost = cost(bin_id, cart.basket);
+                total_cost += basket_cost;
+                partial_carts.emplace_back(basket_cost, bin_id, std::move(cart.basket));
+                cart.basket.reserve(capacity(bin_id));
             }
         }
 
         auto g2 = std::unique_lock{filled_carts_mutex};
+        if (cart_cost) {
+            // an even share of the remaining work of all consumers
+            for (auto const& bin_carts : filled_carts) {
+                for (auto const& queued : bin_carts) {
+                    total_cost += queued.priority;
+                }
+            }
+            double const max_cost = total_cost / consumer_count;
+
+            std::vector<std::tuple<double, size_t, cart>> parts;
+            for (auto& [basket_cost, bin_id, basket] : partial_carts) {
+                split_cart(cart_cost, bin_id, std::move(basket), max_cost, parts);
+            }
+            partial_carts = std::move(parts);
+        }
+
+        for (auto& [basket_cost, bin_id, basket] : partial_carts) {
+            push_filled(basket_cost, bin_id, std::move(basket));
+        }
         finishing = true;
         filled_carts_process_ready_cv.notify_all();
     }
 };
+
+/** A bounded multi-producer multi-consumer ring buffer that does not take locks.
+ *
+ * Each slot carries a sequence number that tells producers and consumers whether the slot is free or filled
+ * for the current round (D. Vyukov's bounded MPMC queue). try_push and try_pop fail instead of waiting.
+ */
+template <typename value_t>
+struct mpmc_ring {
+    struct slot {
+        std::atomic<size_t> sequence;
+        value_t             value;
+    };
+
+    std::unique_ptr<slot[]> slots;
+    size_t                  mask;
+
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+    // capacity is rounded down to a power of two and is at least 2
+    explicit mpmc_ring(size_t capacity)
+        : slots{std::make_unique<slot[]>(std::bit_floor(std::max<size_t>(capacity, 2u)))}
+        , mask{std::bit_floor(std::max<size_t>(capacity, 2u)) - 1}
+    {
+        for (size_t i{0}; i <= mask; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const noexcept {
+        return mask + 1;
+    }
+
+    // Moves value into the ring - thread safe. Returns false and leaves value untouched if the ring is full.
+    bool try_push(value_t& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        slot* s;
+        while (true) {
+            s = &slots[pos & mask];
+            size_t const seq = s->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        s->value = std::move(value);
+        s->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Takes the oldest value out of the ring - thread safe. Returns std::nullopt if the ring is empty.
+    std::optional<value_t> try_pop() {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        slot* s;
+        while (true) {
+            s = &slots[pos & mask];
+            size_t const seq = s->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        std::optional<value_t> value{std::move(s->value)};
+        s->sequence.store(pos + mask + 1, std::memory_order_release);
+        return value;
+    }
+};
+
+/** A cart queue whose producers and consumers do not share locks.
+ *
+ * Same contract as cart_queue: insert and dequeue are thread safe, finish flushes the partially filled carts
+ * and lets dequeue return std::nullopt once all carts have been taken. finish must be called after the last
+ * insert has returned.
+ *
+ * Each producer thread fills carts of its own, i.e. an insert does not synchronize with other producers.
+ * Full carts are published through a lock-free ring per bin (at most max_bin_ring_capacity carts) and at most
+ * max_queued_carts carts are queued in total. Producers wait while the queue is full and consumers wait while it
+ * is empty by blocking on atomic counters instead of a mutex.
+ *
+ * Like cart_queue, a consumer takes a cart of its preferred bin first. Otherwise, with a cost function, it takes a
+ * cart of the bin whose queued carts are the most expensive on average and, without one, a cart of the next bin
+ * that has full carts. The carts of a bin are taken in the order they were published. finish splits expensive
+ * partial carts like cart_queue.
+ */
+template <typename value_t>
+struct lock_free_cart_queue {
+    using cart = std::vector<value_t>;
+    using cost_fn = std::function<double(size_t, cart const&)>;
+
+    static constexpr size_t max_bin_ring_capacity{64};
+
+    // carts of one producer thread, one per bin
+    struct staging_area {
+        std::vector<cart> carts;
+    };
+
+    // full carts of a bin with their cost
+    struct bin_carts {
+        mpmc_ring<std::tuple<double, cart>> ring;
+        std::atomic<size_t>                 count{0};  // published and not yet taken
+        std::atomic<double>                 cost{0.0}; // summed cost of these carts
+
+        explicit bin_carts(size_t ring_capacity) : ring{ring_capacity} {}
+    };
+
+    size_t number_of_bins;
+    cart_capacity capacity;
+    cost_fn cart_cost;
+    size_t  consumer_count;
+    size_t  max_queued_carts;
+
+    // identifies the queue in the thread local staging cache; never reused, unlike the address of the queue
+    uint64_t const id{next_id().fetch_add(1, std::memory_order_relaxed)};
+
+    std::mutex                                         staging_mutex; // taken when a thread switches queues
+    std::deque<staging_area>                           staging_areas;
+    std::unordered_map<std::thread::id, staging_area*> thread_staging;
+
+    std::deque<bin_carts>  filled_carts;
+    std::atomic<size_t>    queued{0};    // carts that are published or about to be published
+    std::atomic<size_t>    next_bin{0};  // where consumers without a cost function look for a cart first
+    std::atomic<uint64_t>  published{0}; // changes when a cart was published or the queue finished
+    std::atomic<uint64_t>  consumed{0};  // changes when a cart was taken
+    std::atomic<bool>      finishing{false};
+
+    lock_free_cart_queue(size_t number_of_bins,
+                         size_t cart_max_capacity,
+                         size_t max_queued_carts,
+                         cost_fn cart_cost = {},
+                         size_t consumer_count = 1)
+        : number_of_bins{number_of_bins}
+        , capacity{number_of_bins, cart_max_capacity}
+        , cart_cost{std::move(cart_cost)}
+        , consumer_count{std::max<size_t>(consumer_count, 1u)}
+        , max_queued_carts{std::max<size_t>(max_queued_carts, 1u)}
+    {
+        for (size_t bin_id{0}; bin_id < number_of_bins; ++bin_id) {
+            filled_carts.emplace_back(std::min(this->max_queued_carts, max_bin_ring_capacity));
+        }
+    }
+    ~lock_free_cart_queue() {
+        if (!finishing) {
+            finish();
+        }
+    }
+
+    // see cart_capacity::adapt
+    void adapt_cart_capacity(double target_duration, size_t min_capacity, size_t max_capacity) {
+        capacity.adapt(target_duration, min_capacity, max_capacity);
+    }
+
+    // a consumer took seconds to process a cart of cart_size values of a bin - thread safe
+    void report_cart_duration(size_t bin_id, size_t cart_size, double seconds) {
+        capacity.report(bin_id, cart_size, seconds);
+    }
+
+    double cost(size_t bin_id, cart const& basket) const {
+        return cart_cost ? cart_cost(bin_id, basket) : 0.0;
+    }
+
+    static std::atomic<uint64_t>& next_id() {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    // The staging area of the calling thread. Threads only cache the area of the last queue they inserted into,
+    // i.e. no thread local state of a destroyed queue is left behind.
+    staging_area& local_staging() {
+        thread_local uint64_t last_id{std::numeric_limits<uint64_t>::max()};
+        thread_local staging_area* last_area{nullptr};
+        if (last_id == id) return *last_area;
+
+        auto _ = std::lock_guard{staging_mutex};
+        auto& area = thread_staging[std::this_thread::get_id()];
+        if (area == nullptr) {
+            area = &staging_areas.emplace_back();
+            area->carts.resize(number_of_bins);
+        }
+        last_id = id;
+        last_area = area;
+        return *area;
+    }
+
+    // waits while the queue or the ring of the bin is full
+    void publish(size_t bin_id, cart&& basket, double basket_cost) {
+        while (true) {
+            uint64_t const seen = consumed.load(std::memory_order_acquire);
+            size_t count = queued.load(std::memory_order_relaxed);
+            while (count < max_queued_carts &&
+                   !queued.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {}
+            if (count < max_queued_carts) break;
+            consumed.wait(seen, std::memory_order_acquire);
+        }
+
+        auto& bin = filled_carts[bin_id];
+        std::tuple<double, cart> value{basket_cost, std::move(basket)};
+        while (true) {
+            uint64_t const seen = consumed.load(std::memory_order_acquire);
+            if (bin.ring.try_push(value)) break;
+            consumed.wait(seen, std::memory_order_acquire);
+        }
+        bin.cost.fetch_add(basket_cost, std::memory_order_relaxed);
+        bin.count.fetch_add(1, std::memory_order_release);
+        published.fetch_add(1, std::memory_order_release);
+        published.notify_one();
+    }
+
+    // Insert a query into a bin - thread safe
+    void insert(size_t bin_id, value_t value) {
+        assert(bin_id < number_of_bins && "bin_id has to be between 0 and number_of_bins");
+
+        auto& basket = local_staging().carts[bin_id];
+        size_t const bin_capacity = capacity(bin_id);
+        if (basket.capacity() == 0) {
+            basket.reserve(bin_capacity);
+        }
+        basket.emplace_back(std::move(value));
+
+        if (basket.size() >= bin_capacity) {
+            double const basket_cost = cost(bin_id, basket);
+            publish(bin_id, std::move(basket), basket_cost);
+            basket = cart{};
+        }
+    }
+
+    // takes the oldest cart of a bin, std::nullopt if the bin has none
+    auto take(size_t bin_id) -> std::optional<std::tuple<int, cart>> {
+        auto& bin = filled_carts[bin_id];
+        auto v = bin.ring.try_pop();
+        if (!v) return std::nullopt;
+
+        auto& [basket_cost, basket] = *v;
+        bin.cost.fetch_sub(basket_cost, std::memory_order_relaxed);
+        bin.count.fetch_sub(1, std::memory_order_relaxed);
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        consumed.fetch_add(1, std::memory_order_release);
+        // producers may wait for the queue or for the ring of a certain bin
+        consumed.notify_all();
+        return std::tuple<int, cart>{static_cast<int>(bin_id), std::move(basket)};
+    }
+
+    // takes a cart of preferred_bin, else of the most expensive bin or of the next bin that has full carts
+    auto take_any(size_t preferred_bin) -> std::optional<std::tuple<int, cart>> {
+        if (preferred_bin < number_of_bins) {
+            if (auto v = take(preferred_bin)) return v;
+        }
+        if (number_of_bins == 0) return std::nullopt;
+
+        if (cart_cost) {
+            size_t best_bin{number_of_bins};
+            double best_cost{std::numeric_limits<double>::lowest()};
+            for (size_t bin_id{0}; bin_id < number_of_bins; ++bin_id) {
+                size_t const count = filled_carts[bin_id].count.load(std::memory_order_acquire);
+                if (count == 0) continue;
+                double const average_cost = filled_carts[bin_id].cost.load(std::memory_order_relaxed) / count;
+                if (average_cost > best_cost) {
+                    best_bin = bin_id;
+                    best_cost = average_cost;
+                }
+            }
+            if (best_bin < number_of_bins) {
+                // another consumer may have taken the cart in the meantime
+                if (auto v = take(best_bin)) return v;
+            }
+        }
+
+        size_t const first_bin = next_bin.fetch_add(1, std::memory_order_relaxed) % number_of_bins;
+        for (size_t i{0}; i < number_of_bins; ++i) {
+            size_t const bin_id = (first_bin + i) % number_of_bins;
+            if (filled_carts[bin_id].count.load(std::memory_order_acquire) == 0) continue;
+            if (auto v = take(bin_id)) return v;
+        }
+        return std::nullopt;
+    }
+
+    // Take a cart from the filled carts - thread safe
+    auto dequeue() -> std::optional<std::tuple<int, cart>> {
+        return dequeue(std::numeric_limits<size_t>::max());
+    }
+
+    // Take a cart of preferred_bin, or of another bin if no cart of preferred_bin is full - thread safe.
+    // A preferred_bin out of range means no preference.
+    auto dequeue(size_t preferred_bin) -> std::optional<std::tuple<int, cart>> {
+        while (true) {
+            uint64_t const seen = published.load(std::memory_order_acquire);
+            // all carts are published once finishing is set, because finish comes after the last insert
+            bool const finished = finishing.load(std::memory_order_acquire);
+            if (auto v = take_any(preferred_bin)) return v;
+            if (finished) return std::nullopt;
+
+            // wakes up when a cart is published or the queue finishes after `seen` was read
+            published.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    // flushes all partially filled carts of all producer threads - call after the last insert
+    void finish() {
+        std::vector<std::tuple<double, size_t, cart>> partial_carts;
+        double total_cost{0.0};
+        {
+            auto _ = std::lock_guard{staging_mutex};
+            for (auto& area : staging_areas) {
+                for (size_t bin_id{0}; bin_id < area.carts.size(); ++bin_id) {
+                    if (!area.carts[bin_id].empty()) {
+                        double const basket_cost = cost(bin_id, area.carts[bin_id]);
+                        total_cost += basket_cost;
+                        partial_carts.emplace_back(basket_cost, bin_id, std::move(area.carts[bin_id]));
+                        area.carts[bin_id] = cart{};
+                    }
+                }
+            }
+        }
+
+        if (cart_cost) {
+            // an even share of the remaining work of all consumers
+            for (auto const& bin : filled_carts) {
+                total_cost += bin.cost.load(std::memory_order_relaxed);
+            }
+            double const max_cost = total_cost / consumer_count;
+
+            std::vector<std::tuple<double, size_t, cart>> parts;
+            for (auto& [basket_cost, bin_id, basket] : partial_carts) {
+                split_cart(cart_cost, bin_id, std::move(basket), max_cost, parts);
+            }
+            partial_carts = std::move(parts);
+        }
+
+        for (auto& [basket_cost, bin_id, basket] : partial_carts) {
+            publish(bin_id, std::move(basket), basket_cost);
+        }
+
+        finishing.store(true, std::memory_order_release);
+        published.fetch_add(1, std::memory_order_release);
+        published.notify_all();
+    }
+};
+
+/** The cart queue of search, i.e. cart_queue or, with --lock-free-queue, lock_free_cart_queue.
+ *
+ * The queue is selected at runtime, so that search is compiled once for both queues.
+ */
+template <typename value_t>
+struct search_cart_queue {
+    using cart = std::vector<value_t>;
+    using cost_fn = std::function<double(size_t, cart const&)>;
+
+    std::variant<std::monostate, cart_queue<value_t>, lock_free_cart_queue<value_t>> queue;
+
+    search_cart_queue(bool lock_free,
+                      size_t number_of_bins,
+                      size_t cart_max_capacity,
+                      size_t max_queued_carts,
+                      cost_fn cart_cost = {},
+                      size_t consumer_count = 1) {
+        if (lock_free) {
+            queue.template emplace<lock_free_cart_queue<value_t>>(number_of_bins, cart_max_capacity, max_queued_carts,
+                                                                  std::move(cart_cost), consumer_count);
+        } else {
+            queue.template emplace<cart_queue<value_t>>(number_of_bins, cart_max_capacity, max_queued_carts,
+                                                        std::move(cart_cost), consumer_count);
+        }
+    }
+
+    template <typename fn_t>
+    decltype(auto) visit(fn_t&& fn) {
+        if (auto* locked = std::get_if<cart_queue<value_t>>(&queue)) {
+            return fn(*locked);
+        }
+        return fn(std::get<lock_free_cart_queue<value_t>>(queue));
+    }
+
+    // see cart_capacity::adapt
+    void adapt_cart_capacity(double target_duration, size_t min_capacity, size_t max_capacity) {
+        visit([&](auto& q) { q.adapt_cart_capacity(target_duration, min_capacity, max_capacity); });
+    }
+
+    void report_cart_duration(size_t bin_id, size_t cart_size, double seconds) {
+        visit([&](auto& q) { q.report_cart_duration(bin_id, cart_size, seconds); });
+    }
+
+    void insert(size_t bin_id, value_t value) {
+        visit([&](auto& q) { q.insert(bin_id, std::move(value)); });
+    }
+
+    auto dequeue() -> std::optional<std::tuple<int, cart>> {
+        return visit([&](auto& q) { return q.dequeue(); });
+    }
+
+    auto dequeue(size_t preferred_bin) -> std::optional<std::tuple<int, cart>> {
+        return visit([&](auto& q) { return q.dequeue(preferred_bin); });
+    }
+
+    void finish() {
+        visit([&](auto& q) { q.finish(); });
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace valik
+{
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * The mapping is shared with all other processes that map the same file, i.e. the pages are backed by the OS page cache
+ * and are only loaded from disk once per node. The mapping is released when the object is destroyed.
+ */
+class mapped_file
+{
+private:
+    std::byte const * data_{nullptr};
+    size_t size_{0};
+
+    void unmap() noexcept
+    {
+        if (data_ != nullptr)
+            munmap(const_cast<std::byte *>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+public:
+    mapped_file() = default;
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator=(mapped_file const &) = delete;
+
+    mapped_file(mapped_file && other) noexcept : data_{other.data_}, size_{other.size_}
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    mapped_file & operator=(mapped_file && other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    ~mapped_file()
+    {
+        unmap();
+    }
+
+    explicit mapped_file(std::filesystem::path const & path)
+    {
+        int const fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error{"Could not open " + path.string() + " for mapping: " + std::strerror(errno)};
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == -1)
+        {
+            close(fd);
+            throw std::runtime_error{"Could not stat " + path.string() + ": " + std::strerror(errno)};
+        }
+
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ == 0)
+        {
+            close(fd);
+            throw std::runtime_error{"Can not map empty file " + path.string() + "."};
+        }
+
+        void * ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // the mapping keeps its own reference to the file
+        if (ptr == MAP_FAILED)
+        {
+            size_ = 0;
+            throw std::runtime_error{"Could not map " + path.string() + ": " + std::strerror(errno)};
+        }
+
+        // start reading the file into the page cache asynchronously
+        madvise(ptr, size_, MADV_WILLNEED);
+        data_ = static_cast<std::byte const *>(ptr);
+    }
+
+    std::byte const * data() const noexcept
+    {
+        return data_;
+    }
+
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+};
+
+} // namespace valik
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <cmath>   // for log, ceil, exp
 #include <cstddef> // for size_t
@@ -21,6 +22,7 @@
 #include <valik/shared.hpp>
 #include <valik/build/call_parallel_on_bins.hpp>
 #include <valik/split/metadata.hpp>
+#include <utilities/prepare/minimiser_counter.hpp>
 #include <utilities/prepare/parse_bin_paths.hpp>
 #include <utilities/prepare/reference_record.hpp>
 
@@ -60,9 +62,25 @@ namespace raptor
 
 void compute_minimiser(valik::build_arguments const & arguments);
 
+/**
+ * @brief Function that writes the filtered .minimiser and the .header file of each sequence file to arguments.out_dir.
+ *        Files whose minimisers were already computed are skipped.
+ */
+void compute_minimiser(valik::build_arguments const & arguments, std::vector<std::string> const & bin_path);
+
 namespace detail
 {
 
+// Mantis ignores k-mers that occur less often than a cutoff that depends on the size of the read file:
+// <= 300MB: 1, <= 500MB: 3, <= 1GB: 10, <= 3GB: 20, > 3GB: 50
+inline constexpr std::array<size_t, 4> cutoff_bounds{314'572'800ULL, 524'288'000ULL, 1'073'741'824ULL, 3'221'225'472ULL};
+inline constexpr std::array<uint8_t, 5> cutoffs{1u, 3u, 10u, 20u, 50u};
+
+/**
+ * @brief Function that returns the minimum k-mer count of a bin depending on the size of its sequence file.
+ */
+uint8_t filesize_dependent_cutoff(std::filesystem::path const & filename);
+
 size_t kmer_count_from_minimiser_files(std::vector<std::string> const & minimiser_bin_path, uint8_t const threads);
 
 size_t kmer_count_from_sequence_files(valik::build_arguments const & arguments);
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace valik
+{
+
+/**
+ * @brief Counts the occurrences of minimisers with a bounded amount of memory.
+ *
+ * Inserted values are appended to a flat buffer. A full buffer is sorted and adjacent duplicates are merged. If this
+ * does not free at least half of the buffer, the sorted runs are spilled to radix partitions on disk that are split
+ * by the most significant bits of the hash. A partition that does not fit into memory is split further by the next
+ * bits. The counts are reported in ascending order of the hash and saturate at `max_count`.
+ */
+class minimiser_counter
+{
+public:
+    static constexpr uint8_t max_count{254u};
+
+private:
+    struct entry
+    {
+        uint64_t hash;
+        uint8_t count;
+    };
+
+    static constexpr size_t partition_bits{8u};
+    static constexpr size_t partition_count{1ULL << partition_bits};
+    // a spilled entry is stored as 8 bytes of hash followed by 1 byte of count
+    static constexpr size_t record_bytes{sizeof(uint64_t) + sizeof(uint8_t)};
+    static constexpr size_t read_chunk_records{1ULL << 16};
+
+    std::filesystem::path spill_prefix_{};
+    size_t capacity_{};
+    std::vector<entry> buffer_{};
+    bool spilled_{false};
+
+    //!\brief Sorts the buffer and merges entries with the same hash.
+    static void compact(std::vector<entry> & entries)
+    {
+        std::ranges::sort(entries, {}, &entry::hash);
+        auto out = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (out != entries.begin() && std::prev(out)->hash == it->hash)
+                std::prev(out)->count = std::min<size_t>(max_count, std::prev(out)->count + it->count);
+            else
+                *out++ = *it;
+        }
+        entries.erase(out, entries.end());
+    }
+
+    static size_t partition_of(uint64_t const hash, size_t const level)
+    {
+        return (hash >> (64u - partition_bits * (level + 1))) & (partition_count - 1);
+    }
+
+    std::filesystem::path partition_path(std::filesystem::path const & parent, size_t const partition) const
+    {
+        std::filesystem::path path{parent};
+        path += "." + std::to_string(partition);
+        return path;
+    }
+
+    /**
+     * @brief Function that appends sorted entries to the partition files of the given level.
+     *
+     * @param entries Entries sorted by hash.
+     * @param parent Prefix of the partition files.
+     * @param level Number of partitioning rounds above this one.
+     */
+    void write_partitions(std::vector<entry> const & entries, std::filesystem::path const & parent, size_t const level) const
+    {
+        auto it = entries.begin();
+        while (it != entries.end())
+        {
+            size_t const partition = partition_of(it->hash, level);
+            std::ofstream out{partition_path(parent, partition), std::ios::binary | std::ios::app};
+            if (!out)
+                throw std::runtime_error{"Could not write minimiser spill file " + partition_path(parent, partition).string()};
+            for (; it != entries.end() && partition_of(it->hash, level) == partition; ++it)
+            {
+                out.write(reinterpret_cast<char const *>(&it->hash), sizeof(it->hash));
+                out.write(reinterpret_cast<char const *>(&it->count), sizeof(it->count));
+            }
+        }
+    }
+
+    /**
+     * @brief Function that appends the next records of a spill file to the entries.
+     *
+     * @return False if the end of the file was reached before reading any record.
+     */
+    static bool read_chunk(std::ifstream & in, std::vector<char> & bytes, std::vector<entry> & entries)
+    {
+        in.read(bytes.data(), bytes.size());
+        size_t const records = in.gcount() / record_bytes;
+        for (size_t i = 0; i < records; ++i)
+        {
+            entry e{};
+            std::memcpy(&e.hash, bytes.data() + i * record_bytes, sizeof(e.hash));
+            std::memcpy(&e.count, bytes.data() + i * record_bytes + sizeof(e.hash), sizeof(e.count));
+            entries.push_back(e);
+        }
+        return records > 0;
+    }
+
+    template <typename callback_t>
+    void process_partition(std::filesystem::path const & path, size_t const level, callback_t && callback)
+    {
+        if (!std::filesystem::exists(path))
+            return;
+
+        size_t const records = std::filesystem::file_size(path) / record_bytes;
+        std::ifstream in{path, std::ios::binary};
+        size_t const chunk_records = std::min({records, capacity_, read_chunk_records});
+        std::vector<char> bytes(chunk_records * record_bytes);
+        buffer_.clear();
+
+        if (records <= capacity_ || partition_bits * (level + 2) > 64u)
+        {
+            // the last level is processed in memory regardless of the budget
+            while (read_chunk(in, bytes, buffer_))
+            {}
+            compact(buffer_);
+            for (auto const & [hash, count] : buffer_)
+                callback(hash, count);
+        }
+        else
+        {
+            while (read_chunk(in, bytes, buffer_))
+            {
+                if (buffer_.size() + chunk_records > capacity_)
+                {
+                    compact(buffer_);
+                    write_partitions(buffer_, path, level + 1);
+                    buffer_.clear();
+                }
+            }
+            compact(buffer_);
+            write_partitions(buffer_, path, level + 1);
+            in.close();
+            for (size_t partition = 0; partition < partition_count; ++partition)
+                process_partition(partition_path(path, partition), level + 1, callback);
+        }
+
+        in.close();
+        std::filesystem::remove(path);
+    }
+
+public:
+    minimiser_counter() = delete;
+    minimiser_counter(minimiser_counter const &) = delete;
+    minimiser_counter(minimiser_counter &&) = default;
+    minimiser_counter & operator=(minimiser_counter const &) = delete;
+    minimiser_counter & operator=(minimiser_counter &&) = default;
+    ~minimiser_counter() = default;
+
+    /**
+     * @brief Constructor that allocates the insertion buffer.
+     *
+     * @param spill_prefix Prefix of the spill files. Spill files are removed when the counts have been reported.
+     * @param memory_bytes Upper bound of the memory used for counting.
+     */
+    minimiser_counter(std::filesystem::path spill_prefix, size_t const memory_bytes) :
+        spill_prefix_{std::move(spill_prefix)},
+        capacity_{std::max<size_t>(partition_count, memory_bytes / sizeof(entry))}
+    {
+        buffer_.reserve(capacity_);
+    }
+
+    void insert(uint64_t const hash)
+    {
+        buffer_.push_back(entry{hash, 1u});
+        if (buffer_.size() == capacity_)
+        {
+            compact(buffer_);
+            if (buffer_.size() > capacity_ / 2)
+            {
+                write_partitions(buffer_, spill_prefix_, 0u);
+                buffer_.clear();
+                spilled_ = true;
+            }
+        }
+    }
+
+    /**
+     * @brief Function that reports each distinct hash and its number of occurrences in ascending order of the hash.
+     *        The counter is empty afterwards.
+     *
+     * @param callback Called with (uint64_t hash, uint8_t count).
+     */
+    template <typename callback_t>
+    void for_each_count(callback_t && callback)
+    {
+        compact(buffer_);
+        if (!spilled_)
+        {
+            for (auto const & [hash, count] : buffer_)
+                callback(hash, count);
+        }
+        else
+        {
+            write_partitions(buffer_, spill_prefix_, 0u);
+            for (size_t partition = 0; partition < partition_count; ++partition)
+                process_partition(partition_path(spill_prefix_, partition), 0u, callback);
+        }
+        buffer_.clear();
+        spilled_ = false;
+    }
+};
+
+} // namespace valik
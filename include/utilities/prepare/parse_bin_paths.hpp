@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <numeric>
+
 #include <valik/shared.hpp>
 #include <valik/split/metadata.hpp>
 
@@ -34,4 +39,50 @@ inline auto parse_bin_paths(build_arguments const & arguments, std::string const
     return minimiser_files;
 }
 
+/**
+ * @brief Struct that stores the content of the .header file that is written next to each .minimiser file.
+ *
+ * \param shape        Shape of the k-mer.
+ * \param window_size  Size of the minimiser window.
+ * \param count        Number of minimisers that passed the k-mer count cutoffs.
+ * \param bin_size     Size of the sequence file or length of the segment.
+ */
+struct minimiser_header
+{
+    std::string shape{};
+    uint64_t window_size{};
+    size_t count{};
+    uint64_t bin_size{};
+};
+
+inline minimiser_header read_minimiser_header(std::filesystem::path const & header_path)
+{
+    std::ifstream file_stream{header_path};
+    minimiser_header header{};
+    if (!(file_stream >> header.shape >> header.window_size >> header.count >> header.bin_size))
+        throw std::runtime_error{"Could not read minimiser header " + header_path.string() + "."};
+    return header;
+}
+
+/**
+ * @brief Function that ranks the bins by the ratio of minimisers to bin size given in the .header files.
+ *        Bins without a header path, e.g. cleared bins, are ranked last.
+ */
+inline std::vector<size_t> entropy_ranking_from_headers(std::vector<std::string> const & header_paths)
+{
+    std::vector<double> entropy(header_paths.size(), -1.0);
+    for (size_t bin{0}; bin < header_paths.size(); ++bin)
+    {
+        if (header_paths[bin].empty())
+            continue;
+        minimiser_header const header = read_minimiser_header(header_paths[bin]);
+        entropy[bin] = (double) header.count / (double) header.bin_size;
+    }
+
+    std::vector<size_t> entropy_ranking(header_paths.size());
+    std::iota(entropy_ranking.begin(), entropy_ranking.end(), 0u);
+    std::ranges::stable_sort(entropy_ranking, std::greater{}, [&](size_t const bin) { return entropy[bin]; });
+    return entropy_ranking;
+}
+
 } // namespace valik
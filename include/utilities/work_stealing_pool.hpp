@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace valik
+{
+
+/**
+ * @brief A fixed set of worker threads that run tasks until the pool is destroyed.
+ *
+ * Each worker owns a task deque. A worker takes tasks from the back of its own deque and steals from the front of the
+ * deques of the other workers when its own deque is empty, so that a worker that finished its short tasks helps with the
+ * long tasks of the others. The pool is meant to be created once per search and shared by all producer calls.
+ */
+class work_stealing_pool
+{
+public:
+    using task_t = std::function<void()>;
+
+    //!\brief The worker id of threads that are not workers of a pool.
+    static constexpr size_t not_a_worker{std::numeric_limits<size_t>::max()};
+
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<task_t> tasks;
+    };
+
+    std::vector<worker_queue> queues;
+    std::atomic<size_t> queued{0};  // tasks in the deques
+    size_t pending{0};              // tasks that were submitted and did not finish yet
+    size_t next_queue{0};
+    bool stopping{false};
+    std::exception_ptr error{};
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    std::vector<std::jthread> workers;
+
+    static inline thread_local size_t current_worker{not_a_worker};
+
+    bool try_pop(size_t const id, task_t & task)
+    {
+        {
+            auto & own = queues[id];
+            std::lock_guard lk{own.mutex};
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        for (size_t offset{1}; offset < queues.size(); ++offset)
+        {
+            auto & victim = queues[(id + offset) % queues.size()];
+            std::lock_guard lk{victim.mutex};
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void work(size_t const id)
+    {
+        current_worker = id;
+        task_t task{};
+        while (true)
+        {
+            if (!try_pop(id, task))
+            {
+                std::unique_lock lk{mutex};
+                work_available.wait(lk, [&] { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+                if (stopping && queued.load(std::memory_order_relaxed) == 0)
+                    return;
+                continue;
+            }
+
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard lk{mutex};
+                if (!error)
+                    error = std::current_exception();
+            }
+            task = nullptr;
+
+            std::lock_guard lk{mutex};
+            if (--pending == 0)
+                work_done.notify_all();
+        }
+    }
+
+public:
+    work_stealing_pool() = delete;
+    work_stealing_pool(work_stealing_pool const &) = delete;
+    work_stealing_pool & operator=(work_stealing_pool const &) = delete;
+    work_stealing_pool(work_stealing_pool &&) = delete;
+    work_stealing_pool & operator=(work_stealing_pool &&) = delete;
+
+    /**
+     * @brief Starts the worker threads.
+     *
+     * @param thread_count Number of worker threads. At least one thread is started.
+     */
+    explicit work_stealing_pool(size_t const thread_count) : queues(std::max<size_t>(thread_count, 1u))
+    {
+        workers.reserve(queues.size());
+        for (size_t id{0}; id < queues.size(); ++id)
+            workers.emplace_back([this, id] () { work(id); });
+    }
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard lk{mutex};
+            stopping = true;
+        }
+        work_available.notify_all();
+        workers.clear();
+    }
+
+    size_t thread_count() const noexcept
+    {
+        return workers.size();
+    }
+
+    /**
+     * @brief Returns the id in [0, thread_count()) of the worker that runs the calling task.
+     *        Tasks can use it to index state that each worker owns, e.g. buffers that are reused for all its tasks.
+     */
+    static size_t worker_id() noexcept
+    {
+        return current_worker;
+    }
+
+    /**
+     * @brief Distributes the tasks round robin over the workers and blocks until all submitted tasks have finished.
+     *
+     * The first exception thrown by a task is rethrown after all tasks have finished.
+     */
+    void run(std::vector<task_t> tasks)
+    {
+        if (tasks.empty())
+            return;
+
+        {
+            std::lock_guard lk{mutex};
+            pending += tasks.size();
+            queued.fetch_add(tasks.size(), std::memory_order_relaxed);
+            for (auto & task : tasks)
+            {
+                auto & queue = queues[next_queue];
+                next_queue = (next_queue + 1) % queues.size();
+                std::lock_guard queue_lk{queue.mutex};
+                queue.tasks.push_back(std::move(task));
+            }
+        }
+        work_available.notify_all();
+
+        std::unique_lock lk{mutex};
+        work_done.wait(lk, [&] { return pending == 0; });
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+};
+
+/**
+ * @brief Splits the indices [0, count) into contiguous ranges of roughly equal total weight.
+ *
+ * @param count Number of items.
+ * @param task_count Desired number of ranges. Fewer ranges are returned if there are fewer items.
+ * @param weight Function that returns the weight of item i, e.g. the length of a sequence.
+ * @return The ranges as [begin, end) pairs in ascending order.
+ */
+template <typename weight_fn_t>
+std::vector<std::pair<size_t, size_t>> balanced_ranges(size_t const count, size_t const task_count, weight_fn_t && weight)
+{
+    std::vector<std::pair<size_t, size_t>> ranges{};
+    if (count == 0)
+        return ranges;
+
+    size_t total{0};
+    for (size_t i{0}; i < count; ++i)
+        total += weight(i);
+    size_t const tasks = std::max<size_t>(task_count, 1u);
+    size_t const target = std::max<size_t>((total + tasks - 1) / tasks, 1u);
+
+    size_t begin{0};
+    size_t current{0};
+    for (size_t i{0}; i < count; ++i)
+    {
+        current += weight(i);
+        if (current >= target)
+        {
+            ranges.emplace_back(begin, i + 1);
+            begin = i + 1;
+            current = 0;
+        }
+    }
+    if (begin < count)
+        ranges.emplace_back(begin, count);
+
+    return ranges;
+}
+
+} // namespace valik
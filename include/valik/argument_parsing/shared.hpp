@@ -8,5 +8,6 @@ namespace valik::app
 
 void init_shared_meta(sharg::parser & parser);
 void try_parsing(sharg::parser & parser);
+size_t size_in_bytes(std::string size);
 
 } // namespace valik::app
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <valik/argument_parsing/shared.hpp>
+#include <valik/update/update.hpp>
+
+namespace valik::app
+{
+
+void init_update_parser(sharg::parser & parser, update_arguments & arguments);
+void run_update(sharg::parser & parser);
+
+} // namespace valik::app
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <vector>
+
+#include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
+
+#include <valik/ibf_geometry.hpp>
+#include <valik/mapped_ibf.hpp>
+#include <valik/sharded_ibf.hpp>
+
+namespace valik
+{
+
+/**
+ * @brief Answers membership queries for a block of values at once.
+ *
+ * A membership query reads one row per hash function at a random position of the bit vector, i.e. querying the
+ * minimisers of a record one at a time waits for a cache miss per row. The batched agent hashes the values ahead of
+ * time and issues software prefetches for the rows of the value `prefetch_distance` positions ahead of the one it
+ * resolves, so that the loads of several values are in flight at the same time.
+ * The binning bit vectors are identical to the ones of the membership agent of the IBF.
+ *
+ * Like the membership agent the batched agent owns buffers and has to be created for each thread.
+ */
+class batched_membership_agent
+{
+private:
+    //!\brief A contiguous bit vector that stores the bins [first_word * 64, (first_word + geometry.bin_words) * 64).
+    struct source
+    {
+        uint64_t const * words;
+        detail::ibf_geometry geometry;
+        size_t first_word;
+    };
+
+    std::vector<source> sources_{};
+    size_t word_count_{};
+    // false if the sources leave words of the binning bit vector unset, e.g. bins of shards that are not loaded
+    bool covers_all_words_{true};
+    // first word of each row that a value hashes to; one entry per value and source
+    std::vector<std::array<size_t, 5>> rows_{};
+
+    void prefetch(size_t const value_idx) const noexcept
+    {
+        for (size_t s = 0; s < sources_.size(); ++s)
+        {
+            auto const & [words, geometry, first_word] = sources_[s];
+            auto const & rows = rows_[value_idx * sources_.size() + s];
+            for (size_t i = 0; i < geometry.hash_funs; ++i)
+                for (size_t w = 0; w < geometry.bin_words; w += 8u)
+                    __builtin_prefetch(words + rows[i] + w, 0, 0);
+        }
+    }
+
+    void resolve(size_t const value_idx, uint64_t * const result) const noexcept
+    {
+        for (size_t s = 0; s < sources_.size(); ++s)
+        {
+            auto const & [words, geometry, first_word] = sources_[s];
+            auto const & rows = rows_[value_idx * sources_.size() + s];
+            for (size_t batch = 0; batch < geometry.bin_words; ++batch)
+            {
+                uint64_t tmp{-1ULL};
+                for (size_t i = 0; i < geometry.hash_funs; ++i)
+                    tmp &= words[rows[i] + batch];
+                result[first_word + batch] = tmp;
+            }
+        }
+    }
+
+public:
+    //!\brief Number of values between the value whose rows are prefetched and the value that is resolved.
+    static constexpr size_t prefetch_distance{16};
+
+    batched_membership_agent() = default;
+    batched_membership_agent(batched_membership_agent const &) = default;
+    batched_membership_agent & operator=(batched_membership_agent const &) = default;
+    batched_membership_agent(batched_membership_agent &&) = default;
+    batched_membership_agent & operator=(batched_membership_agent &&) = default;
+    ~batched_membership_agent() = default;
+
+    explicit batched_membership_agent(seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed> const & ibf) :
+        sources_{source{ibf.raw_data().data(), detail::ibf_geometry{ibf}, 0u}},
+        word_count_{sources_.front().geometry.bin_words}
+    {}
+
+    explicit batched_membership_agent(mapped_ibf const & ibf) :
+        sources_{source{ibf.raw_words(), ibf.geometry(), 0u}},
+        word_count_{ibf.geometry().bin_words}
+    {}
+
+    explicit batched_membership_agent(sharded_ibf const & ibf) : word_count_{(ibf.bin_count() + 63) >> 6}
+    {
+        for (auto const & [first_bin, shard_ibf, geometry] : ibf.shards())
+            sources_.push_back(source{shard_ibf.raw_data().data(), geometry, first_bin >> 6});
+
+        size_t covered_words{0};
+        for (auto const & s : sources_)
+            covered_words += s.geometry.bin_words;
+        covers_all_words_ = covered_words == word_count_;
+    }
+
+    //!\brief Number of 64 bit words of a binning bit vector.
+    size_t word_count() const noexcept
+    {
+        return word_count_;
+    }
+
+    /**
+     * @brief Function that writes the binning bit vector of each value into consecutive rows of a buffer.
+     *
+     * @param values Hash values to query.
+     * @param result Buffer of values.size() rows of word_count() words each. Row i is the binning bit vector of values[i].
+     */
+    void bulk_contains(std::span<uint64_t const> const values, uint64_t * const result)
+    {
+        if (!covers_all_words_)
+            std::fill_n(result, values.size() * word_count_, 0u);
+
+        rows_.resize(values.size() * sources_.size());
+        for (size_t v = 0; v < values.size(); ++v)
+            for (size_t s = 0; s < sources_.size(); ++s)
+                rows_[v * sources_.size() + s] = sources_[s].geometry.row_words(values[v]);
+
+        for (size_t v = 0; v < std::min(prefetch_distance, values.size()); ++v)
+            prefetch(v);
+
+        for (size_t v = 0; v < values.size(); ++v)
+        {
+            if (v + prefetch_distance < values.size())
+                prefetch(v + prefetch_distance);
+            resolve(v, result + v * word_count_);
+        }
+    }
+};
+
+} // namespace valik
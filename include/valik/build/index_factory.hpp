@@ -1,7 +1,10 @@
 #pragma once
 
 #include <utilities/prepare/parse_bin_paths.hpp>
+#include <utilities/prepare/reference_record.hpp>
+#include <utilities/work_stealing_pool.hpp>
 #include <valik/build/call_parallel_on_bins.hpp>
+#include <valik/ibf_geometry.hpp>
 #include <valik/index.hpp>
 #include <valik/split/metadata.hpp>
 
@@ -25,6 +28,15 @@ public:
 private:
     build_arguments const * const arguments{nullptr};
 
+    using sequence_file_t = seqan3::sequence_file_input<dna4_traits, seqan3::fields<seqan3::field::seq>>;
+
+    auto hash_view() const
+    {
+        return seqan3::views::minimiser_hash(arguments->shape,
+                                             seqan3::window_size{arguments->window_size},
+                                             seqan3::seed{adjust_seed(arguments->shape_weight)});
+    }
+
     auto construct() const
     {
         assert(arguments != nullptr);
@@ -32,15 +44,6 @@ private:
         valik_index<> index{*arguments};
         auto & ibf = index.ibf();
         auto & entropy_ranking = index.entropy_ranking();
-        std::vector<std::pair<size_t, double>> entropy_map{};
-
-        using sequence_file_t = seqan3::sequence_file_input<dna4_traits, seqan3::fields<seqan3::field::seq>>;
-        auto hash_view = [&] ()
-        {
-            return seqan3::views::minimiser_hash(arguments->shape,
-                                                 seqan3::window_size{arguments->window_size},
-                                                 seqan3::seed{adjust_seed(arguments->shape_weight)});
-        };
 
         if (arguments->input_is_minimiser)
         {
@@ -60,26 +63,7 @@ private:
             std::vector<std::string> file_paths = parse_bin_paths(*arguments);
             call_parallel_on_bins(minimiser_worker, file_paths, arguments->threads);
 
-            std::vector<std::string> header_paths = parse_bin_paths(*arguments, "header");
-            std::string shape_string{};
-            uint64_t window_size{};
-            size_t count{};
-            uint64_t bin_size{};
-            entropy_ranking.reserve(header_paths.size());
-            for (auto && [file_name, bin_number] : seqan3::views::zip(header_paths, std::views::iota(0u)))
-            {
-                std::ifstream file_stream{file_name};
-                file_stream >> shape_string >> window_size >> count >> bin_size;
-                entropy_map.emplace_back(std::make_pair((size_t) bin_number, (double) count / (double) bin_size));
-            }
-
-            std::ranges::sort(entropy_map.begin(), entropy_map.end(), [](const std::pair<size_t, double> &a, const std::pair<size_t, double> &b)
-            { 
-                return a.second > b.second; 
-            });
-
-            for (auto && [bin_id, entropy] : entropy_map)
-                entropy_ranking.push_back(bin_id);
+            entropy_ranking = entropy_ranking_from_headers(parse_bin_paths(*arguments, "header"));
         }
         else if (arguments->bin_path.size() > 1)
         {
@@ -101,31 +85,122 @@ private:
         }
         else
         {
-            // if no .minimiser files exist then a single sequence file will be scanned sequentially to build the IBF
+            // if no .minimiser files exist then the segments of a single sequence file are hashed in parallel
+            // each segment belongs to a different bin and the bits are set atomically because neighbouring bins share words
             metadata meta(arguments->ref_meta_path);
+            detail::ibf_geometry const geometry{ibf};
+            uint64_t * const ibf_words = ibf.raw_data().data();
 
-            auto min_view = hash_view();
+            using sequence_t = seqan3::dna4_vector;
+            auto segment_worker = [&] (shared_reference_record<sequence_t> const & shared_record)
+            {
+                auto const & seg = shared_record.segment;
+                for (auto && value : *shared_record.underlying_sequence | seqan3::views::slice(seg.start, seg.start + seg.len) | hash_view())
+                    geometry.emplace(ibf_words, value, seg.id);
+            };
+
+            // segments are processed in batches to limit the number of sequences held in memory
+            // the worker threads are started once and shared by all batches
+            work_stealing_pool pool{arguments->threads};
+            std::vector<shared_reference_record<sequence_t>> reference_records{};
+            size_t const batch_size = 4u * arguments->threads;
+            reference_records.reserve(batch_size);
+            auto process_batch = [&] ()
+            {
+                std::vector<work_stealing_pool::task_t> tasks{};
+                tasks.reserve(reference_records.size());
+                for (auto const & shared_record : reference_records)
+                    tasks.emplace_back([&segment_worker, &shared_record] () { segment_worker(shared_record); });
+                pool.run(std::move(tasks));
+                reference_records.clear();
+            };
 
             size_t i{0};
             for (auto && [seq] : sequence_file_t{arguments->bin_path[0]})
             {
+                auto shared_seq = std::make_shared<sequence_t>(std::move(seq));
                 for (auto & seg : meta.segments_from_ind(i))
                 {
-                    for (auto && value : seq | seqan3::views::slice(seg.start, seg.start + seg.len) | min_view)
-                        ibf.emplace(value, seqan3::bin_index{seg.id});
+                    reference_records.emplace_back(shared_seq, metadata::segment_stats{seg});
+                    if (reference_records.size() == batch_size)
+                        process_batch();
                 }
                 i++;
             }
+
+            if (!reference_records.empty())
+                process_batch();
+        }
+
+        return index;
+    }
+
+    /**
+     * @brief Function that lays out the bins of a metagenome database in a hierarchical IBF and fills it.
+     *        The layout is computed from the bin lengths stored in the reference metadata.
+     */
+    auto construct_hierarchical() const
+    {
+        assert(arguments != nullptr);
+
+        metadata meta(arguments->ref_meta_path);
+        std::vector<uint64_t> bin_lengths(meta.seg_count);
+        for (auto const & seg : meta.segments)
+            bin_lengths[seg.id] = seg.len;
+
+        hierarchical_ibf hibf{bin_lengths, hierarchical_ibf::config{.max_bin_bits = arguments->bits,
+                                                                    .hash_count = arguments->hash,
+                                                                    .fpr = arguments->fpr,
+                                                                    .tmax = arguments->tmax}};
+
+        if (arguments->input_is_minimiser)
+        {
+            auto minimiser_worker = [&] (auto && zipped_view, auto &&)
+            {
+                for (auto && [file_name, bin_number] : zipped_view)
+                {
+                    std::ifstream fin{file_name, std::ios::binary};
+                    uint64_t value;
+                    while (fin.read(reinterpret_cast<char *>(&value), sizeof(value)))
+                        hibf.emplace(value, bin_number);
+                }
+            };
+
+            call_parallel_on_bins(minimiser_worker, parse_bin_paths(*arguments), arguments->threads);
         }
+        else
+        {
+            auto clustered_reference_worker = [&] (auto && zipped_view, auto &&)
+            {
+                for (auto && [file_name, bin_number] : zipped_view)
+                    for (auto && record : sequence_file_t{file_name})
+                        for (auto && value : record.sequence() | hash_view())
+                            hibf.emplace(value, bin_number);
+            };
 
+            call_parallel_on_bins(clustered_reference_worker, arguments->bin_path, arguments->threads);
+        }
+
+        valik_index<index_structure::hibf> index{window{arguments->window_size},
+                                                 arguments->shape,
+                                                 arguments->bin_path,
+                                                 std::move(hibf)};
+        if (arguments->input_is_minimiser)
+            index.entropy_ranking() = entropy_ranking_from_headers(parse_bin_paths(*arguments, "header"));
         return index;
     }
+
 public:
     template <typename view_t = int>
     [[nodiscard]] auto operator()() const
     {
         return construct();
     }
+
+    [[nodiscard]] auto hierarchical() const
+    {
+        return construct_hierarchical();
+    }
 };
 
 } // namespace valik
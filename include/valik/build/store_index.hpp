@@ -1,5 +1,12 @@
 #pragma once
 
+#include <cstring>
+#include <sstream>
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
 #include <valik/index.hpp>
 
 namespace valik
@@ -10,9 +17,193 @@ static inline void store_index(std::filesystem::path const & path,
                                valik_index<data_t> const & index)
 {
     std::ofstream os{path, std::ios::binary};
+    if constexpr (has_archive_magic<data_t>)
+        os.write(archive_magic<data_t>.data(), archive_magic<data_t>.size());
     cereal::BinaryOutputArchive oarchive{os};
     oarchive(index);
+    // readers of older versions ignore the trailing tables
+    if (!index.thresholds().empty())
+        oarchive(index.thresholds());
 }
 
-} // namespace valik
+/**
+ * @brief Function that writes the index in the mapped layout (see valik::mapped_index_header).
+ *
+ * @param path Output file path.
+ * @param index Index with an uncompressed IBF.
+ */
+static inline void store_mapped_index(std::filesystem::path const & path,
+                                      valik_index<index_structure::ibf> const & index)
+{
+    auto const & ibf = index.ibf();
+
+    std::ostringstream parameters{std::ios::binary};
+    {
+        cereal::BinaryOutputArchive oarchive{parameters};
+        uint32_t const version{valik_index<>::version};
+        uint64_t const window_size{index.window_size()};
+        seqan3::shape const shape{index.shape()};
+        uint64_t const bin_count{ibf.bin_count()};
+        uint64_t const bin_size{ibf.bin_size()};
+        uint64_t const hash_count{ibf.hash_function_count()};
+        oarchive(version, window_size, shape, index.bin_path(), index.entropy_ranking(), bin_count, bin_size, hash_count);
+        if (!index.thresholds().empty())
+            oarchive(index.thresholds());
+    }
+    std::string const parameter_bytes = parameters.str();
+
+    mapped_index_header header{};
+    header.parameters_offset = sizeof(mapped_index_header);
+    header.parameters_size = parameter_bytes.size();
+    uint64_t const alignment = mapped_index_header::payload_alignment;
+    header.payload_offset = (header.parameters_offset + header.parameters_size + alignment - 1) / alignment * alignment;
+    header.payload_size = detail::ibf_geometry{ibf}.word_count() * sizeof(uint64_t);
+
+    std::ofstream os{path, std::ios::binary};
+    os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    os.write(parameter_bytes.data(), parameter_bytes.size());
+    std::string const padding(header.payload_offset - header.parameters_offset - header.parameters_size, '\0');
+    os.write(padding.data(), padding.size());
+    os.write(reinterpret_cast<char const *>(ibf.raw_data().data()), header.payload_size);
+
+    if (!os.good())
+        throw std::runtime_error{"Could not write index to " + path.string() + "."};
+}
+
+/**
+ * @brief Function that writes the index in the sectioned layout (see valik::sectioned_index_header).
+ *
+ * @param path Output file path.
+ * @param index Index with an uncompressed IBF.
+ */
+static inline void store_sectioned_index(std::filesystem::path const & path,
+                                         valik_index<index_structure::ibf> const & index)
+{
+    auto const & ibf = index.ibf();
+    detail::ibf_geometry const geometry{ibf};
+
+    auto archive_bytes = [](auto const & ... values)
+    {
+        std::ostringstream os{std::ios::binary};
+        {
+            cereal::BinaryOutputArchive oarchive{os};
+            oarchive(values...);
+        }
+        return os.str();
+    };
+
+    sectioned_index_header header{};
+    bool const has_thresholds = !index.thresholds().empty();
+    header.section_count = 3u + geometry.bin_words + has_thresholds;
+    std::vector<index_section_entry> table{};
+    table.reserve(header.section_count);
+
+    std::ofstream os{path, std::ios::binary};
+    os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    // the table is written after the sections when the checksums are known
+    std::string const empty_table(header.section_count * sizeof(index_section_entry), '\0');
+    os.write(empty_table.data(), empty_table.size());
 
+    auto write_section = [&](index_section const kind, uint32_t const block, std::string const & bytes)
+    {
+        uint64_t offset = static_cast<uint64_t>(os.tellp());
+        std::string const padding((sizeof(uint64_t) - offset % sizeof(uint64_t)) % sizeof(uint64_t), '\0');
+        os.write(padding.data(), padding.size());
+        offset += padding.size();
+
+        os.write(bytes.data(), bytes.size());
+        table.push_back(index_section_entry{kind, block, offset, bytes.size(), detail::section_checksum(bytes.data(), bytes.size())});
+    };
+
+    uint32_t const version{valik_index<>::version};
+    uint64_t const window_size{index.window_size()};
+    seqan3::shape const shape{index.shape()};
+    write_section(index_section::parameters, 0u, archive_bytes(version, window_size, shape, index.bin_path()));
+    write_section(index_section::entropy_ranking, 0u, archive_bytes(index.entropy_ranking()));
+    uint64_t const bin_count{ibf.bin_count()};
+    uint64_t const bin_size{ibf.bin_size()};
+    uint64_t const hash_count{ibf.hash_function_count()};
+    write_section(index_section::ibf_parameters, 0u, archive_bytes(bin_count, bin_size, hash_count));
+    if (has_thresholds)
+        write_section(index_section::thresholds, 0u, archive_bytes(index.thresholds()));
+
+    // transpose the interleaved bit vector into blocks of 64 bins
+    uint64_t const * const words = ibf.raw_data().data();
+    std::string block_bytes(geometry.bin_size * sizeof(uint64_t), '\0');
+    for (size_t block = 0; block < geometry.bin_words; ++block)
+    {
+        for (size_t row = 0; row < geometry.bin_size; ++row)
+            std::memcpy(block_bytes.data() + row * sizeof(uint64_t), words + row * geometry.bin_words + block, sizeof(uint64_t));
+        write_section(index_section::bin_block, block, block_bytes);
+    }
+
+    os.seekp(sizeof(header));
+    os.write(reinterpret_cast<char const *>(table.data()), table.size() * sizeof(index_section_entry));
+
+    if (!os.good())
+        throw std::runtime_error{"Could not write index to " + path.string() + "."};
+}
+
+/**
+ * @brief Function that writes the index as a manifest and one file per contiguous block of bins.
+ *
+ * The manifest is written to path and stores the index parameters and the shard table. Shard i is written next to it
+ * as <stem>.<i>.shard. All shards except for the last one contain a multiple of 64 bins.
+ *
+ * @param path Output file path of the manifest.
+ * @param index Index with an uncompressed IBF.
+ * @param shard_count Number of shards. Reduced if there are fewer than 64 bins per shard.
+ */
+static inline void store_sharded_index(std::filesystem::path const & path,
+                                       valik_index<index_structure::ibf> const & index,
+                                       size_t const shard_count)
+{
+    auto const & ibf = index.ibf();
+    size_t const bin_words = (ibf.bin_count() + 63) >> 6;
+    size_t const shard_bins = ((bin_words + shard_count - 1) / shard_count) << 6;
+
+    std::vector<uint64_t> first_bins{};
+    std::vector<uint64_t> bin_counts{};
+    std::vector<std::string> shard_files{};
+    for (size_t first_bin = 0; first_bin < ibf.bin_count(); first_bin += shard_bins)
+    {
+        size_t const bin_count = std::min(shard_bins, ibf.bin_count() - first_bin);
+        std::filesystem::path shard_path{path};
+        shard_path.replace_extension(std::to_string(first_bins.size()) + ".shard");
+
+        std::ofstream os{shard_path, std::ios::binary};
+        os.write(shard_magic.data(), shard_magic.size());
+        {
+            cereal::BinaryOutputArchive oarchive{os};
+            uint32_t const version{valik_index<>::version};
+            uint64_t const first{first_bin};
+            oarchive(version, first, sharded_ibf::slice(ibf, first_bin, bin_count));
+        }
+        if (!os.good())
+            throw std::runtime_error{"Could not write index shard to " + shard_path.string() + "."};
+
+        first_bins.push_back(first_bin);
+        bin_counts.push_back(bin_count);
+        shard_files.push_back(shard_path.filename().string());
+    }
+
+    std::ofstream os{path, std::ios::binary};
+    os.write(archive_magic<index_structure::sharded_ibf>.data(), archive_magic<index_structure::sharded_ibf>.size());
+    {
+        cereal::BinaryOutputArchive oarchive{os};
+        uint32_t const version{valik_index<>::version};
+        uint64_t const window_size{index.window_size()};
+        seqan3::shape const shape{index.shape()};
+        uint64_t const bin_count{ibf.bin_count()};
+        uint64_t const bin_size{ibf.bin_size()};
+        uint64_t const hash_count{ibf.hash_function_count()};
+        oarchive(version, window_size, shape, index.bin_path(), index.entropy_ranking(), bin_count, bin_size, hash_count);
+        oarchive(first_bins, bin_counts, shard_files);
+        if (!index.thresholds().empty())
+            oarchive(index.thresholds());
+    }
+    if (!os.good())
+        throw std::runtime_error{"Could not write index to " + path.string() + "."};
+}
+
+} // namespace valik
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cereal/types/vector.hpp>
+
+#include <seqan3/core/concept/cereal.hpp>
+#include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
+
+#include <valik/ibf_geometry.hpp>
+
+namespace valik
+{
+
+/**
+ * @brief A hierarchy of Interleaved Bloom Filters for databases with many bins of uneven size.
+ *
+ * The top level IBF has at most `tmax` technical bins. Large user bins are split over several technical bins
+ * and small user bins are merged into a single technical bin that stores the union of their k-mers.
+ * Each merged bin points to a lower level IBF that distinguishes between the merged user bins.
+ * The layout keeps the load of all technical bins of an IBF similar, so that the bin size is not determined by
+ * the largest user bin. A search only descends into merged bins that pass the threshold, which means that the
+ * query cost grows with the number of hits instead of the number of user bins.
+ */
+class hierarchical_ibf
+{
+public:
+    using ibf_t = seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>;
+    static constexpr seqan3::data_layout data_layout_mode = seqan3::data_layout::uncompressed;
+    //!\brief Marks a technical bin that stores the union of a lower level IBF.
+    static constexpr uint64_t merged_bin = std::numeric_limits<uint64_t>::max();
+
+    struct config
+    {
+        size_t max_bin_bits{};      // bin size of a flat IBF, i.e. for the largest user bin
+        size_t hash_count{2};
+        double fpr{0.05};
+        size_t tmax{64};            // maximum number of technical bins per IBF
+    };
+
+    //!\brief Technical bins of one IBF that store a user bin or a merged bin.
+    struct placement
+    {
+        size_t ibf_idx;
+        size_t first_bin;
+        size_t bin_count;
+    };
+
+private:
+    //!\brief The IBFs of the hierarchy. The first IBF is the top level.
+    std::vector<ibf_t> ibf_vector_{};
+    //!\brief For each IBF and technical bin: the user bin or merged_bin.
+    std::vector<std::vector<uint64_t>> ibf_bin_to_user_bin_id_{};
+    //!\brief For each IBF and technical bin: the lower level IBF of a merged bin or the IBF itself.
+    std::vector<std::vector<uint64_t>> next_ibf_id_{};
+    size_t user_bin_count_{};
+
+    // only needed during construction
+    std::vector<std::vector<placement>> user_bin_placements_{};
+    std::vector<detail::ibf_geometry> geometries_{};
+
+    struct layout_entry
+    {
+        std::vector<size_t> user_bins{};   // more than one user bin for a merged bin
+        size_t bin_count{1};
+        double weight{};
+
+        double load() const noexcept
+        {
+            return weight / bin_count;
+        }
+    };
+
+    //!\brief Empty user bins, e.g. of sequences shorter than the window, weigh as much as a single k-mer.
+    static double layout_weight(uint64_t const weight) noexcept
+    {
+        return std::max<double>(weight, 1.0);
+    }
+
+    /**
+     * @brief Function that computes the split and merged bins of a single IBF.
+     *        Each entry holds fewer user bins than the IBF, so that the recursion on merged bins terminates.
+     *
+     * @param user_bins User bins sorted by weight in descending order.
+     * @param weights Weight of each user bin.
+     * @param tmax Maximum number of technical bins.
+     */
+    static std::vector<layout_entry> layout_level(std::vector<size_t> const & user_bins,
+                                                  std::vector<uint64_t> const & weights,
+                                                  size_t const tmax)
+    {
+        std::vector<layout_entry> entries{};
+        if (user_bins.size() <= tmax)
+        {
+            for (size_t const user_bin : user_bins)
+                entries.push_back(layout_entry{{user_bin}, 1u, layout_weight(weights[user_bin])});
+        }
+        else
+        {
+            double const total_weight = std::accumulate(user_bins.begin(), user_bins.end(), 0.0,
+                                                        [&](double sum, size_t bin) { return sum + layout_weight(weights[bin]); });
+            // increase the target load until all bins fit into tmax technical bins
+            // at the latest with a target of total_weight all bins fit into at most two technical bins
+            bool fits{false};
+            for (double factor{1.0}; !fits && factor <= 1.1 * tmax; factor *= 1.1)
+            {
+                double const target = std::max(total_weight / tmax * factor, 1.0);
+                entries.clear();
+                layout_entry group{};
+                size_t used_bins{0};
+                for (size_t const user_bin : user_bins)
+                {
+                    double const weight = layout_weight(weights[user_bin]);
+                    if (weight >= target)
+                    {
+                        entries.push_back(layout_entry{{user_bin}, std::max<size_t>(1u, std::round(weight / target)), weight});
+                        used_bins += entries.back().bin_count;
+                        continue;
+                    }
+
+                    group.user_bins.push_back(user_bin);
+                    group.weight += weight;
+                    if (group.weight >= target)
+                    {
+                        entries.push_back(std::move(group));
+                        group = layout_entry{};
+                        used_bins++;
+                    }
+                }
+                if (!group.user_bins.empty())
+                {
+                    entries.push_back(std::move(group));
+                    used_bins++;
+                }
+
+                fits = used_bins <= tmax;
+            }
+            if (!fits)
+                throw std::runtime_error{"Could not lay out " + std::to_string(user_bins.size()) + " user bins in " +
+                                         std::to_string(tmax) + " technical bins."};
+
+            // a merged bin of all user bins would be laid out again in the same way
+            if (entries.size() == 1u)
+            {
+                layout_entry all = std::move(entries.front());
+                entries.clear();
+                size_t const group_size = (all.user_bins.size() + tmax - 1) / tmax;
+                for (size_t first{0}; first < all.user_bins.size(); first += group_size)
+                {
+                    layout_entry group{};
+                    for (size_t i{first}; i < std::min(first + group_size, all.user_bins.size()); ++i)
+                    {
+                        group.user_bins.push_back(all.user_bins[i]);
+                        group.weight += layout_weight(weights[all.user_bins[i]]);
+                    }
+                    entries.push_back(std::move(group));
+                }
+            }
+        }
+
+        // split the user bins with the highest load over the remaining technical bins
+        size_t const technical_bins = std::min<size_t>(tmax, ((user_bins.size() + 63) >> 6) << 6);
+        size_t used_bins = std::accumulate(entries.begin(), entries.end(), size_t{0},
+                                           [](size_t sum, layout_entry const & entry) { return sum + entry.bin_count; });
+        for (; used_bins < technical_bins; ++used_bins)
+        {
+            auto max_it = std::ranges::max_element(entries, {}, &layout_entry::load);
+            if (max_it->user_bins.size() > 1)
+                break;  // merged bins can not be split
+            max_it->bin_count++;
+        }
+
+        return entries;
+    }
+
+    //!\brief Ratio of the bin size that keeps the FPR of a user bin that is split over `parts` technical bins.
+    static double fpr_correction(double const fpr, size_t const hash_count, size_t const parts)
+    {
+        if (parts == 1)
+            return 1.0;
+        double const part_fpr = 1.0 - std::exp(std::log1p(-fpr) / parts);
+        auto const denominator = [&](double const p) { return std::log(1.0 - std::exp(std::log(p) / hash_count)); };
+        return denominator(fpr) / denominator(part_fpr);
+    }
+
+    /**
+     * @brief Function that creates the IBF for a set of user bins and recursively the IBFs of its merged bins.
+     *
+     * @return Index of the created IBF.
+     */
+    size_t add_level(std::vector<size_t> const & user_bins,
+                     std::vector<uint64_t> const & weights,
+                     config const & cfg,
+                     double const max_weight,
+                     std::vector<placement> const & parent_placements)
+    {
+        std::vector<layout_entry> const entries = layout_level(user_bins, weights, cfg.tmax);
+
+        size_t const ibf_idx = ibf_vector_.size();
+        double max_load{1.0};
+        double correction{1.0};
+        size_t technical_bins{0};
+        for (auto const & entry : entries)
+        {
+            max_load = std::max(max_load, entry.load());
+            correction = std::max(correction, fpr_correction(cfg.fpr, cfg.hash_count, entry.bin_count));
+            technical_bins += entry.bin_count;
+        }
+        size_t const bin_size = std::max<size_t>(64u, std::ceil(cfg.max_bin_bits * max_load / max_weight * correction));
+
+        ibf_vector_.emplace_back(seqan3::bin_count{technical_bins},
+                                 seqan3::bin_size{bin_size},
+                                 seqan3::hash_function_count{cfg.hash_count});
+        geometries_.emplace_back(technical_bins, bin_size, cfg.hash_count);
+        ibf_bin_to_user_bin_id_.emplace_back(technical_bins);
+        next_ibf_id_.emplace_back(technical_bins, ibf_idx);
+
+        size_t first_bin{0};
+        for (auto const & entry : entries)
+        {
+            std::vector<placement> placements{parent_placements};
+            placements.push_back(placement{ibf_idx, first_bin, entry.bin_count});
+            if (entry.user_bins.size() == 1)
+            {
+                size_t const user_bin = entry.user_bins[0];
+                std::fill_n(ibf_bin_to_user_bin_id_[ibf_idx].begin() + first_bin, entry.bin_count, user_bin);
+                user_bin_placements_[user_bin] = std::move(placements);
+            }
+            else
+            {
+                size_t const child_idx = add_level(entry.user_bins, weights, cfg, max_weight, placements);
+                ibf_bin_to_user_bin_id_[ibf_idx][first_bin] = merged_bin;
+                next_ibf_id_[ibf_idx][first_bin] = child_idx;
+            }
+            first_bin += entry.bin_count;
+        }
+
+        return ibf_idx;
+    }
+
+public:
+    hierarchical_ibf() = default;
+    hierarchical_ibf(hierarchical_ibf const &) = default;
+    hierarchical_ibf(hierarchical_ibf &&) = default;
+    hierarchical_ibf & operator=(hierarchical_ibf const &) = default;
+    hierarchical_ibf & operator=(hierarchical_ibf &&) = default;
+    ~hierarchical_ibf() = default;
+
+    /**
+     * @brief Constructor that computes the layout from the user bin sizes and creates empty IBFs.
+     *
+     * @param user_bin_weights Size of each user bin, e.g. the sequence length.
+     * @param cfg Parameters of the hierarchy.
+     */
+    hierarchical_ibf(std::vector<uint64_t> const & user_bin_weights, config const & cfg) :
+        user_bin_count_{user_bin_weights.size()},
+        user_bin_placements_(user_bin_weights.size())
+    {
+        if (user_bin_weights.empty())
+            throw std::invalid_argument{"Can not create a hierarchical IBF without user bins."};
+        if (cfg.tmax < 2u)
+            throw std::invalid_argument{"A hierarchical IBF needs at least two technical bins per level."};
+
+        std::vector<size_t> user_bins(user_bin_weights.size());
+        std::iota(user_bins.begin(), user_bins.end(), 0u);
+        std::ranges::stable_sort(user_bins, std::greater{}, [&](size_t bin) { return user_bin_weights[bin]; });
+
+        double const max_weight = std::max<double>(1.0, user_bin_weights[user_bins.front()]);
+        add_level(user_bins, user_bin_weights, cfg, max_weight, {});
+    }
+
+    /**
+     * @brief Function that inserts a value into a user bin and all merged bins that contain it.
+     *        Concurrent calls are safe. A value is inserted into one part of a split bin.
+     *
+     * @param value Hash value to insert.
+     * @param user_bin Index of the user bin.
+     */
+    void emplace(uint64_t const value, size_t const user_bin)
+    {
+        assert(user_bin < user_bin_placements_.size());
+        for (auto const & [ibf_idx, first_bin, bin_count] : user_bin_placements_[user_bin])
+            geometries_[ibf_idx].emplace(ibf_vector_[ibf_idx].raw_data().data(), value, first_bin + value % bin_count);
+    }
+
+    //!\brief Number of user bins.
+    size_t bin_count() const noexcept
+    {
+        return user_bin_count_;
+    }
+
+    std::vector<ibf_t> const & ibf_vector() const noexcept
+    {
+        return ibf_vector_;
+    }
+
+    std::vector<std::vector<uint64_t>> const & ibf_bin_to_user_bin_id() const noexcept
+    {
+        return ibf_bin_to_user_bin_id_;
+    }
+
+    std::vector<std::vector<uint64_t>> const & next_ibf_id() const noexcept
+    {
+        return next_ibf_id_;
+    }
+
+    //!\brief Total size of all IBFs in bits.
+    size_t bit_size() const noexcept
+    {
+        return std::accumulate(ibf_vector_.begin(), ibf_vector_.end(), size_t{0},
+                               [](size_t sum, ibf_t const & ibf) { return sum + ibf.bit_size(); });
+    }
+
+    /*!\cond DEV
+     * \brief Serialisation support function.
+     * \tparam archive_t Type of `archive`; must satisfy seqan3::cereal_archive.
+     * \param[in] archive The archive being serialised from/to.
+     *
+     * \attention These functions are never called directly, see \ref serialisation for more details.
+     */
+    template <seqan3::cereal_archive archive_t>
+    void CEREAL_SERIALIZE_FUNCTION_NAME(archive_t & archive)
+    {
+        archive(user_bin_count_);
+        archive(ibf_vector_);
+        archive(ibf_bin_to_user_bin_id_);
+        archive(next_ibf_id_);
+    }
+    //!\endcond
+};
+
+} // namespace valik
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+
+#include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
+
+namespace valik
+{
+
+namespace detail
+{
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+/**
+ * @brief The dimensions of an uncompressed seqan3::interleaved_bloom_filter and its hashing scheme.
+ *
+ * The hash functions are identical to the ones used by seqan3, so that a bit vector written by seqan3 can be queried
+ * without going through seqan3::interleaved_bloom_filter.
+ */
+struct ibf_geometry
+{
+    static constexpr std::array<size_t, 5> hash_seeds{13572355802537770549ULL,  // 2**64 / (e/2)
+                                                      13043817825332782213ULL,  // 2**64 / sqrt(2)
+                                                      10650232656628343401ULL,  // 2**64 / sqrt(3)
+                                                      16499269484942379435ULL,  // 2**64 / (sqrt(5)/2)
+                                                      4893150838803335377ULL};  // 2**64 / (3*pi/5)
+
+    size_t bins{};
+    size_t technical_bins{};
+    size_t bin_size{};
+    size_t hash_shift{};
+    size_t bin_words{};
+    size_t hash_funs{};
+
+    ibf_geometry() = default;
+
+    ibf_geometry(size_t const bin_count, size_t const size, size_t const hash_function_count) :
+        bins{bin_count},
+        bin_size{size},
+        hash_funs{hash_function_count}
+    {
+        hash_shift = std::countl_zero(bin_size);
+        bin_words = (bins + 63) >> 6;
+        technical_bins = bin_words << 6;
+    }
+
+    template <seqan3::data_layout data_layout_mode>
+    explicit ibf_geometry(seqan3::interleaved_bloom_filter<data_layout_mode> const & ibf) :
+        ibf_geometry(ibf.bin_count(), ibf.bin_size(), ibf.hash_function_count())
+    {}
+
+    //!\brief Number of 64 bit words in the bit vector.
+    size_t word_count() const noexcept
+    {
+        return (technical_bins * bin_size) >> 6;
+    }
+
+    //!\brief Bit position of the first (technical) bin in the row that the hash function with the given seed selects.
+    inline size_t hash_and_fit(size_t h, size_t const seed) const noexcept
+    {
+        h *= seed;
+        assert(hash_shift < 64);
+        h ^= h >> hash_shift;          // XOR and shift higher bits into lower bits
+        h *= 11400714819323198485ULL;  // = 2^64 / golden_ration, to expand h to 64 bit range
+        h = static_cast<uint64_t>((static_cast<uint128_t>(h) * static_cast<uint128_t>(bin_size)) >> 64);
+        h *= technical_bins;
+        return h;
+    }
+
+    /**
+     * @brief Function that inserts a value into a bin of the bit vector by setting its bits atomically.
+     *        Threads that insert into different bins can share the bit vector, even if the bins share a word.
+     *
+     * @param words Bit vector of the IBF.
+     * @param value Hash value to insert.
+     * @param bin Index of the bin.
+     */
+    inline void emplace(uint64_t * const words, size_t const value, size_t const bin) const noexcept
+    {
+        assert(bin < bins);
+        for (size_t i = 0; i < hash_funs; ++i)
+        {
+            size_t const idx = hash_and_fit(value, hash_seeds[i]) + bin;
+            std::atomic_ref<uint64_t>{words[idx >> 6]}.fetch_or(1ULL << (idx & 63), std::memory_order_relaxed);
+        }
+    }
+
+    //!\brief Index of the first word of each row that the value hashes to.
+    inline std::array<size_t, 5> row_words(size_t const value) const noexcept
+    {
+        std::array<size_t, 5> rows{};
+        for (size_t i = 0; i < hash_funs; ++i)
+            rows[i] = hash_and_fit(value, hash_seeds[i]) >> 6;
+        return rows;
+    }
+};
+
+} // namespace detail
+
+} // namespace valik
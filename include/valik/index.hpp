@@ -7,9 +7,16 @@
 
 #pragma once
 
+#include <bit>
+#include <cstring>
+
 #include <sharg/exceptions.hpp>
 #include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
 
+#include <valik/hierarchical_ibf.hpp>
+#include <valik/mapped_ibf.hpp>
+#include <valik/precomputed_thresholds.hpp>
+#include <valik/sharded_ibf.hpp>
 #include <valik/shared.hpp>
 
 namespace valik
@@ -18,9 +25,36 @@ namespace valik
 namespace index_structure
 {
     using ibf = seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>;
+    using ibf_compressed = seqan3::interleaved_bloom_filter<seqan3::data_layout::compressed>;
+    using mapped_ibf = valik::mapped_ibf;
+    using hibf = valik::hierarchical_ibf;
+    using sharded_ibf = valik::sharded_ibf;
 
 } // namespace index_structure
 
+/**
+ * @brief Marker that precedes the archive of an index whose IBF is not an uncompressed IBF.
+ *        Archives of indices with an uncompressed IBF start with the version number and have no marker.
+ */
+template <typename data_t>
+inline constexpr std::array<char, 8> archive_magic{};
+
+template <>
+inline constexpr std::array<char, 8> archive_magic<index_structure::ibf_compressed>{'V', 'A', 'L', 'I', 'K', 'C', 'M', 'P'};
+
+template <>
+inline constexpr std::array<char, 8> archive_magic<index_structure::hibf>{'V', 'A', 'L', 'I', 'K', 'H', 'I', 'B'};
+
+//!\brief The manifest of a sharded index. The shards are stored in separate files.
+template <>
+inline constexpr std::array<char, 8> archive_magic<index_structure::sharded_ibf>{'V', 'A', 'L', 'I', 'K', 'S', 'H', 'M'};
+
+//!\brief Marker that precedes the archive of a single shard of a sharded index.
+inline constexpr std::array<char, 8> shard_magic{'V', 'A', 'L', 'I', 'K', 'S', 'H', 'D'};
+
+template <typename data_t>
+inline constexpr bool has_archive_magic = archive_magic<data_t> != std::array<char, 8>{};
+
 template <typename data_t = index_structure::ibf>
 class valik_index
 {
@@ -32,6 +66,7 @@ private:
     seqan3::shape shape_{};
     std::vector<std::string> bin_path_{};
     std::vector<size_t> entropy_ranking_{};
+    precomputed_thresholds thresholds_{};
     data_t ibf_{};
 
 public:
@@ -67,6 +102,22 @@ public:
         static_assert(data_layout_mode == seqan3::data_layout::uncompressed);
     }
 
+    /**
+     * @brief Constructor that compresses the IBF of an index that was built with an uncompressed IBF.
+     *        A compressed IBF can only be queried.
+     */
+    template <typename other_data_t>
+        requires (data_layout_mode == seqan3::data_layout::compressed &&
+                  other_data_t::data_layout_mode == seqan3::data_layout::uncompressed)
+    explicit valik_index(valik_index<other_data_t> const & other) :
+        window_size_{other.window_size_},
+        shape_{other.shape_},
+        bin_path_{other.bin_path_},
+        entropy_ranking_{other.entropy_ranking_},
+        thresholds_{other.thresholds_},
+        ibf_{other.ibf_}
+    {}
+
     uint64_t window_size() const
     {
         return window_size_;
@@ -77,6 +128,11 @@ public:
         return shape_;
     }
 
+    std::vector<std::string> & bin_path()
+    {
+        return bin_path_;
+    }
+
     std::vector<std::string> const & bin_path() const
     {
         return bin_path_;
@@ -92,6 +148,20 @@ public:
         return entropy_ranking_;
     }
 
+    /**
+     * @brief Threshold tables computed by build. They are stored after the archive of the index, in the parameters of
+     *        the mapped layout and the manifest of a sharded index, or in index_section::thresholds.
+     */
+    precomputed_thresholds & thresholds()
+    {
+        return thresholds_;
+    }
+
+    precomputed_thresholds const & thresholds() const
+    {
+        return thresholds_;
+    }
+
     data_t & ibf()
     {
         return ibf_;
@@ -171,4 +241,88 @@ public:
 
 };
 
+/**
+ * @brief Fixed size header of an index file in the mapped layout.
+ *
+ * The header is followed by a cereal archive of the index parameters and the IBF bit vector.
+ * The bit vector starts at a page boundary and is stored as raw 64 bit words in host byte order,
+ * so that it can be memory mapped and queried in place.
+ */
+struct mapped_index_header
+{
+    static constexpr std::array<char, 8> magic_bytes{'V', 'A', 'L', 'I', 'K', 'M', 'A', 'P'};
+    static constexpr uint64_t payload_alignment{4096u};
+
+    std::array<char, 8> magic{magic_bytes};
+    uint32_t version{valik_index<>::version};
+    uint32_t reserved{0};
+    uint64_t parameters_offset{};
+    uint64_t parameters_size{};
+    uint64_t payload_offset{};
+    uint64_t payload_size{};
+};
+
+static_assert(std::is_trivially_copyable_v<mapped_index_header>);
+
+//!\brief Sections of an index file in the sectioned layout.
+enum class index_section : uint32_t
+{
+    parameters = 1,         // archive of the version, window size, shape and bin paths as in version 1
+    entropy_ranking = 2,    // archive of the entropy ranking
+    ibf_parameters = 3,     // archive of the bin count, bin size and number of hash functions
+    bin_block = 4,          // raw bits of 64 consecutive bins, one 64 bit word per row
+    thresholds = 5          // archive of precomputed thresholds
+};
+
+/**
+ * @brief Fixed size header of an index file in the sectioned layout (version 2).
+ *
+ * The header is followed by a table of valik::index_section_entry and the sections themselves. Each section can be
+ * read and verified on its own, e.g. the parameters can be read without touching the IBF. The IBF is stored as blocks
+ * of 64 bins, so that a subset of the bins can be loaded.
+ */
+struct sectioned_index_header
+{
+    static constexpr std::array<char, 8> magic_bytes{'V', 'A', 'L', 'I', 'K', 'I', 'D', 'X'};
+    static constexpr uint32_t current_version{2u};
+
+    std::array<char, 8> magic{magic_bytes};
+    uint32_t version{current_version};
+    uint32_t section_count{};
+};
+
+//!\brief Position of a section in an index file in the sectioned layout.
+struct index_section_entry
+{
+    index_section kind{};
+    uint32_t index{};       // block number of an index_section::bin_block and 0 otherwise
+    uint64_t offset{};
+    uint64_t size{};
+    uint64_t checksum{};
+};
+
+static_assert(std::is_trivially_copyable_v<sectioned_index_header>);
+static_assert(std::is_trivially_copyable_v<index_section_entry>);
+
+namespace detail
+{
+
+//!\brief Checksum of a section that is stored in its table entry.
+inline uint64_t section_checksum(char const * data, size_t const size) noexcept
+{
+    uint64_t hash{0x9E3779B97F4A7C15ULL ^ size};
+    size_t i{0};
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word{};
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = std::rotl(hash ^ word, 29) * 0xBF58476D1CE4E5B9ULL;
+    }
+    for (; i < size; ++i)
+        hash = std::rotl(hash ^ static_cast<uint8_t>(data[i]), 29) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+} // namespace detail
+
 } // namespace valik
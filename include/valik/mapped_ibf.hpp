@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <memory>
+
+#include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
+
+#include <utilities/mapped_file.hpp>
+#include <valik/ibf_geometry.hpp>
+
+namespace valik
+{
+
+/**
+ * @brief A read-only uncompressed Interleaved Bloom Filter whose bit vector resides in a memory mapped index file.
+ *
+ * The IBF is queried in place, i.e. loading it does not copy the bit vector and all processes that search the same
+ * index share the pages in the OS page cache. The membership agent returns the same binning bit vectors as the
+ * seqan3::interleaved_bloom_filter it was written from.
+ */
+class mapped_ibf
+{
+private:
+    std::shared_ptr<mapped_file const> file_{};
+    uint64_t const * words_{nullptr};
+    detail::ibf_geometry geometry_{};
+
+public:
+    static constexpr seqan3::data_layout data_layout_mode = seqan3::data_layout::uncompressed;
+
+    class membership_agent_type;
+
+    mapped_ibf() = default;
+    mapped_ibf(mapped_ibf const &) = default;
+    mapped_ibf(mapped_ibf &&) = default;
+    mapped_ibf & operator=(mapped_ibf const &) = default;
+    mapped_ibf & operator=(mapped_ibf &&) = default;
+    ~mapped_ibf() = default;
+
+    /**
+     * @brief Constructor that views a bit vector inside of a mapped file.
+     *
+     * @param file Mapping that owns the bit vector.
+     * @param payload_offset Byte offset of the bit vector in the mapping. Must be aligned to 8 bytes.
+     * @param geometry Dimensions of the IBF.
+     */
+    mapped_ibf(std::shared_ptr<mapped_file const> file, size_t const payload_offset, detail::ibf_geometry const & geometry) :
+        file_{std::move(file)},
+        geometry_{geometry}
+    {
+        if (payload_offset % alignof(uint64_t) != 0)
+            throw std::runtime_error{"Misaligned IBF payload in mapped index."};
+        if (payload_offset + geometry_.word_count() * sizeof(uint64_t) > file_->size())
+            throw std::runtime_error{"Mapped index is truncated."};
+
+        words_ = reinterpret_cast<uint64_t const *>(file_->data() + payload_offset);
+    }
+
+    membership_agent_type membership_agent() const;
+
+    size_t hash_function_count() const noexcept
+    {
+        return geometry_.hash_funs;
+    }
+
+    size_t bin_count() const noexcept
+    {
+        return geometry_.bins;
+    }
+
+    size_t bin_size() const noexcept
+    {
+        return geometry_.bin_size;
+    }
+
+    size_t bit_size() const noexcept
+    {
+        return geometry_.technical_bins * geometry_.bin_size;
+    }
+
+    detail::ibf_geometry const & geometry() const noexcept
+    {
+        return geometry_;
+    }
+
+    uint64_t const * raw_words() const noexcept
+    {
+        return words_;
+    }
+};
+
+/**
+ * @brief Manages membership queries for the valik::mapped_ibf.
+ *
+ * Like seqan3::interleaved_bloom_filter::membership_agent_type the agent owns a result buffer and has to be created
+ * for each thread.
+ */
+class mapped_ibf::membership_agent_type
+{
+private:
+    mapped_ibf const * ibf_ptr{nullptr};
+
+public:
+    using binning_bitvector = seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>::membership_agent_type::binning_bitvector;
+
+    membership_agent_type() = default;
+    membership_agent_type(membership_agent_type const &) = default;
+    membership_agent_type & operator=(membership_agent_type const &) = default;
+    membership_agent_type(membership_agent_type &&) = default;
+    membership_agent_type & operator=(membership_agent_type &&) = default;
+    ~membership_agent_type() = default;
+
+    explicit membership_agent_type(mapped_ibf const & ibf) : ibf_ptr{std::addressof(ibf)}, result_buffer(ibf.bin_count()) {}
+
+    binning_bitvector result_buffer;
+
+    [[nodiscard]] binning_bitvector const & bulk_contains(size_t const value) & noexcept
+    {
+        assert(ibf_ptr != nullptr);
+        assert(result_buffer.size() == ibf_ptr->bin_count());
+
+        auto const & geometry = ibf_ptr->geometry();
+        std::array<size_t, 5> const rows = geometry.row_words(value);
+        uint64_t const * const words = ibf_ptr->raw_words();
+        uint64_t * const result = result_buffer.raw_data().data();
+
+        for (size_t batch = 0; batch < geometry.bin_words; ++batch)
+        {
+            uint64_t tmp{-1ULL};
+            for (size_t i = 0; i < geometry.hash_funs; ++i)
+                tmp &= words[rows[i] + batch];
+            result[batch] = tmp;
+        }
+
+        return result_buffer;
+    }
+
+    // `bulk_contains` cannot be called on a temporary, since the object the returned reference points to
+    // is immediately destroyed.
+    [[nodiscard]] binning_bitvector const & bulk_contains(size_t const value) && noexcept = delete;
+};
+
+inline mapped_ibf::membership_agent_type mapped_ibf::membership_agent() const
+{
+    return membership_agent_type{*this};
+}
+
+} // namespace valik
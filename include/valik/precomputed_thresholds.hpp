@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <cereal/types/vector.hpp>
+
+#include <raptor/threshold/precompute_correction.hpp>
+#include <raptor/threshold/precompute_threshold.hpp>
+#include <raptor/threshold/threshold.hpp>
+
+namespace valik
+{
+
+/**
+ * @brief Probabilistic threshold tables that are computed when the index is built and stored with the index.
+ *
+ * The window size and shape are the ones of the index. A threshold table depends on the pattern length, the number
+ * of errors and tau, a correction table on the pattern length, p_max and the FPR.
+ * A search whose parameters match stored tables does not need to precompute them.
+ */
+class precomputed_thresholds
+{
+private:
+    struct threshold_table
+    {
+        uint64_t query_length{};
+        uint8_t errors{};
+        double tau{};
+        std::vector<size_t> values{};
+
+        template <typename archive_t>
+        void serialize(archive_t & archive)
+        {
+            archive(query_length, errors, tau, values);
+        }
+    };
+
+    struct correction_table
+    {
+        uint64_t query_length{};
+        double p_max{};
+        double fpr{};
+        std::vector<size_t> values{};
+
+        template <typename archive_t>
+        void serialize(archive_t & archive)
+        {
+            archive(query_length, p_max, fpr, values);
+        }
+    };
+
+    std::vector<threshold_table> thresholds_{};
+    std::vector<correction_table> corrections_{};
+
+    threshold_table const * find_thresholds(raptor::threshold::threshold_parameters const & parameters) const
+    {
+        auto it = std::ranges::find_if(thresholds_, [&](threshold_table const & table)
+        {
+            return table.query_length == parameters.query_length && table.errors == parameters.errors &&
+                   table.tau == parameters.tau;
+        });
+        return it == thresholds_.end() ? nullptr : &*it;
+    }
+
+    correction_table const * find_correction(raptor::threshold::threshold_parameters const & parameters) const
+    {
+        auto it = std::ranges::find_if(corrections_, [&](correction_table const & table)
+        {
+            return table.query_length == parameters.query_length && table.p_max == parameters.p_max &&
+                   table.fpr == parameters.fpr;
+        });
+        return it == corrections_.end() ? nullptr : &*it;
+    }
+
+public:
+    //!\brief Only the probabilistic threshold, i.e. a window larger than the k-mer without a fixed percentage, has tables.
+    static bool is_probabilistic(raptor::threshold::threshold_parameters const & parameters) noexcept
+    {
+        return std::isnan(parameters.percentage) && parameters.window_size > parameters.shape.size() &&
+               parameters.query_length >= parameters.window_size;
+    }
+
+    bool empty() const noexcept
+    {
+        return thresholds_.empty() && corrections_.empty();
+    }
+
+    /**
+     * @brief Function that computes the tables for the parameters unless they are stored already.
+     *        Does nothing if the parameters do not use the probabilistic threshold.
+     */
+    void add(raptor::threshold::threshold_parameters parameters)
+    {
+        if (!is_probabilistic(parameters))
+            return;
+
+        parameters.cache_thresholds = false;
+        if (find_thresholds(parameters) == nullptr)
+            thresholds_.push_back(threshold_table{parameters.query_length, parameters.errors, parameters.tau,
+                                                  raptor::threshold::precompute_threshold(parameters)});
+        if (find_correction(parameters) == nullptr)
+            corrections_.push_back(correction_table{parameters.query_length, parameters.p_max, parameters.fpr,
+                                                    raptor::threshold::precompute_correction(parameters)});
+    }
+
+    /**
+     * @brief Function that creates the threshold of a search from the stored tables.
+     *        Tables that are not stored, e.g. for another number of errors, are computed on demand.
+     */
+    raptor::threshold::threshold make_threshold(raptor::threshold::threshold_parameters const & parameters) const
+    {
+        if (!is_probabilistic(parameters))
+            return raptor::threshold::threshold{parameters};
+
+        threshold_table const * thresholds = find_thresholds(parameters);
+        correction_table const * correction = find_correction(parameters);
+        return raptor::threshold::threshold{parameters,
+                                            thresholds ? thresholds->values : std::vector<size_t>{},
+                                            correction ? correction->values : std::vector<size_t>{}};
+    }
+
+    template <typename archive_t>
+    void serialize(archive_t & archive)
+    {
+        archive(thresholds_, corrections_);
+    }
+};
+
+} // namespace valik
@@ -3,6 +3,7 @@
 #include <filesystem>
 
 #include <valik/search/query_record.hpp>
+#include <valik/search/query_registry.hpp>
 
 #include <dream_stellar/stellar_query_segment.hpp>
 #include <dream_stellar/io/import_sequence.hpp>
@@ -15,18 +16,18 @@ namespace valik
 {
 
 /**
- *  \brief Function that creates a seqan2::Segment from a query_record (split or short query)
+ *  \brief Function that creates a seqan2::Segment for each query reference of a cart (split or short query)
  *
- *  \param records vector containing valik split query segments
+ *  \param records query references of a cart
+ *  \param registry owner of the query sequences and ids that the references resolve to
  *  \param seqs set of query segments (in-out)
  *  \param ids set of query segment ids (in-out)
  *  \param strOut stream for standard output
  *  \param strErr stream for error output
- *  \param hostQueries underlying sequences for query segments
- *  \param hostQueryIDs set of underlying sequence ids
  */
-template <typename rec_vec_t, typename TAlphabet, typename TId, typename TStream>
-inline bool get_cart_queries(rec_vec_t const & records,
+template <typename TAlphabet, typename TId, typename TStream>
+inline bool get_cart_queries(std::vector<query_ref> const & records,
+                             query_registry<seqan2::String<TAlphabet>> const & registry,
                              seqan2::StringSet<seqan2::Segment<seqan2::String<TAlphabet> const, seqan2::InfixSegment>, seqan2::Dependent<>> & seqs,
                              seqan2::StringSet<TId> & ids,
                              TStream & strOut,
@@ -37,13 +38,13 @@ inline bool get_cart_queries(rec_vec_t const & records,
     bool idsUnique = true;
 
     size_t seqCount{0};
-    for (auto & record : records)
+    for (query_ref const & record : records)
     {
-        seqan2::String<char> query_id = record.sequence_id;
-        seqan2::appendValue(seqs, record.querySegment, seqan2::Generous());
+        seqan2::String<char> query_id = registry.id(record.handle);
+        seqan2::appendValue(seqs, registry.segment(record), seqan2::Generous());
         seqan2::appendValue(ids, query_id, seqan2::Generous());
         seqCount++;
-        idsUnique &= dream_stellar::_checkUniqueId(uniqueIds, (seqan2::String<char>) record.sequence_id);
+        idsUnique &= dream_stellar::_checkUniqueId(uniqueIds, query_id);
     }
 
     strOut << "Loaded " << seqCount << " query sequence" << ((seqCount > 1) ? "s " : " ") << "from cart." << std::endl;
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VALIK_COUNTING_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace valik::detail
+{
+
+/**
+ * @brief Instruction set of a counting kernel.
+ */
+enum class simd_level : uint8_t
+{
+    scalar,
+    avx2,
+    avx512
+};
+
+/**
+ * @brief Kernels that accumulate binning bit vectors into byte counters and compare the counters to a threshold.
+ *
+ * The counters of bin i are stored at counts[i]. A bit vector of `word_count` words has counters for
+ * 64 * `word_count` bins. The vectorised kernels compile with target attributes and are chosen at runtime,
+ * so that the binary runs on CPUs without AVX2. Counters must not overflow, i.e. each counter is incremented
+ * at most 255 times.
+ */
+struct counting_kernel
+{
+    //!\brief Increments the counters of all bins that are set in the bit vector.
+    void (*add)(uint8_t * counts, uint64_t const * words, size_t word_count) noexcept;
+    //!\brief Decrements the counters of all bins that are set in the bit vector.
+    void (*subtract)(uint8_t * counts, uint64_t const * words, size_t word_count) noexcept;
+    //!\brief Sets bit i of the mask if counts[i] >= threshold.
+    void (*above_threshold)(uint8_t const * counts, size_t word_count, uint8_t threshold, uint64_t * mask) noexcept;
+    //!\brief Sets margins[i] to the maximum of margins[i] and counts[i] + 1 - threshold, saturated to [0, 255].
+    void (*max_margin)(uint8_t const * counts, size_t word_count, uint8_t threshold, uint8_t * margins) noexcept;
+    simd_level level;
+
+    static simd_level supported_level() noexcept;
+    static counting_kernel for_level(simd_level const level) noexcept;
+
+    //!\brief The kernel for the best instruction set of this CPU.
+    static counting_kernel const & best() noexcept
+    {
+        static counting_kernel const kernel = for_level(supported_level());
+        return kernel;
+    }
+};
+
+namespace counting_kernel_impl
+{
+
+inline void add_scalar(uint8_t * counts, uint64_t const * words, size_t const word_count) noexcept
+{
+    for (size_t w = 0; w < word_count; ++w)
+        for (uint64_t word = words[w]; word != 0; word &= word - 1)
+            ++counts[(w << 6) + std::countr_zero(word)];
+}
+
+inline void subtract_scalar(uint8_t * counts, uint64_t const * words, size_t const word_count) noexcept
+{
+    for (size_t w = 0; w < word_count; ++w)
+        for (uint64_t word = words[w]; word != 0; word &= word - 1)
+            --counts[(w << 6) + std::countr_zero(word)];
+}
+
+inline void above_threshold_scalar(uint8_t const * counts,
+                                   size_t const word_count,
+                                   uint8_t const threshold,
+                                   uint64_t * mask) noexcept
+{
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        uint64_t word{0};
+        for (size_t bit = 0; bit < 64u; ++bit)
+            word |= static_cast<uint64_t>(counts[(w << 6) + bit] >= threshold) << bit;
+        mask[w] = word;
+    }
+}
+
+inline void max_margin_scalar(uint8_t const * counts,
+                              size_t const word_count,
+                              uint8_t const threshold,
+                              uint8_t * margins) noexcept
+{
+    for (size_t i = 0; i < (word_count << 6); ++i)
+    {
+        int const margin = std::min(static_cast<int>(counts[i]) + 1 - threshold, 255);
+        margins[i] = std::max<int>(margins[i], margin);
+    }
+}
+
+#ifdef VALIK_COUNTING_KERNEL_X86
+
+// expands 32 bits to 32 bytes that are 0xFF for set bits and 0x00 otherwise
+__attribute__((target("avx2"))) inline __m256i expand_bits_avx2(uint32_t const bits) noexcept
+{
+    __m256i const byte_of_bit = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                                 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    __m256i const bit_of_byte = _mm256_set1_epi64x(static_cast<int64_t>(0x8040201008040201ULL));
+    __m256i const bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int32_t>(bits)), byte_of_bit);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bit_of_byte), bit_of_byte);
+}
+
+__attribute__((target("avx2"))) inline void add_avx2(uint8_t * counts,
+                                                      uint64_t const * words,
+                                                      size_t const word_count) noexcept
+{
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        if (words[w] == 0)
+            continue;
+        for (size_t half = 0; half < 2u; ++half)
+        {
+            __m256i * const ptr = reinterpret_cast<__m256i *>(counts + (w << 6) + (half << 5));
+            // subtracting 0xFF (-1) increments the counter
+            __m256i const set = expand_bits_avx2(static_cast<uint32_t>(words[w] >> (half << 5)));
+            _mm256_storeu_si256(ptr, _mm256_sub_epi8(_mm256_loadu_si256(ptr), set));
+        }
+    }
+}
+
+__attribute__((target("avx2"))) inline void subtract_avx2(uint8_t * counts,
+                                                           uint64_t const * words,
+                                                           size_t const word_count) noexcept
+{
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        if (words[w] == 0)
+            continue;
+        for (size_t half = 0; half < 2u; ++half)
+        {
+            __m256i * const ptr = reinterpret_cast<__m256i *>(counts + (w << 6) + (half << 5));
+            __m256i const set = expand_bits_avx2(static_cast<uint32_t>(words[w] >> (half << 5)));
+            _mm256_storeu_si256(ptr, _mm256_add_epi8(_mm256_loadu_si256(ptr), set));
+        }
+    }
+}
+
+__attribute__((target("avx2"))) inline void above_threshold_avx2(uint8_t const * counts,
+                                                                  size_t const word_count,
+                                                                  uint8_t const threshold,
+                                                                  uint64_t * mask) noexcept
+{
+    __m256i const thresholds = _mm256_set1_epi8(static_cast<char>(threshold));
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        uint64_t word{0};
+        for (size_t half = 0; half < 2u; ++half)
+        {
+            __m256i const c = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(counts + (w << 6) + (half << 5)));
+            // c >= threshold <=> max(c, threshold) == c for unsigned bytes
+            __m256i const ge = _mm256_cmpeq_epi8(_mm256_max_epu8(c, thresholds), c);
+            word |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(ge))) << (half << 5);
+        }
+        mask[w] = word;
+    }
+}
+
+__attribute__((target("avx2"))) inline void max_margin_avx2(uint8_t const * counts,
+                                                             size_t const word_count,
+                                                             uint8_t const threshold,
+                                                             uint8_t * margins) noexcept
+{
+    // counts + 1 - threshold is computed with saturating arithmetic
+    __m256i const offset = _mm256_set1_epi8(static_cast<char>(threshold == 0 ? 1 : threshold - 1));
+    for (size_t i = 0; i < (word_count << 6); i += 32u)
+    {
+        __m256i const c = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(counts + i));
+        __m256i const margin = threshold == 0 ? _mm256_adds_epu8(c, offset) : _mm256_subs_epu8(c, offset);
+        __m256i * const ptr = reinterpret_cast<__m256i *>(margins + i);
+        _mm256_storeu_si256(ptr, _mm256_max_epu8(_mm256_loadu_si256(ptr), margin));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void add_avx512(uint8_t * counts,
+                                                                    uint64_t const * words,
+                                                                    size_t const word_count) noexcept
+{
+    __m512i const ones = _mm512_set1_epi8(1);
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        if (words[w] == 0)
+            continue;
+        void * const ptr = counts + (w << 6);
+        __m512i const c = _mm512_loadu_si512(ptr);
+        _mm512_storeu_si512(ptr, _mm512_mask_add_epi8(c, words[w], c, ones));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void subtract_avx512(uint8_t * counts,
+                                                                         uint64_t const * words,
+                                                                         size_t const word_count) noexcept
+{
+    __m512i const ones = _mm512_set1_epi8(1);
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        if (words[w] == 0)
+            continue;
+        void * const ptr = counts + (w << 6);
+        __m512i const c = _mm512_loadu_si512(ptr);
+        _mm512_storeu_si512(ptr, _mm512_mask_sub_epi8(c, words[w], c, ones));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void above_threshold_avx512(uint8_t const * counts,
+                                                                                size_t const word_count,
+                                                                                uint8_t const threshold,
+                                                                                uint64_t * mask) noexcept
+{
+    __m512i const thresholds = _mm512_set1_epi8(static_cast<char>(threshold));
+    for (size_t w = 0; w < word_count; ++w)
+        mask[w] = _mm512_cmpge_epu8_mask(_mm512_loadu_si512(counts + (w << 6)), thresholds);
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void max_margin_avx512(uint8_t const * counts,
+                                                                           size_t const word_count,
+                                                                           uint8_t const threshold,
+                                                                           uint8_t * margins) noexcept
+{
+    __m512i const offset = _mm512_set1_epi8(static_cast<char>(threshold == 0 ? 1 : threshold - 1));
+    for (size_t i = 0; i < (word_count << 6); i += 64u)
+    {
+        __m512i const c = _mm512_loadu_si512(counts + i);
+        __m512i const margin = threshold == 0 ? _mm512_adds_epu8(c, offset) : _mm512_subs_epu8(c, offset);
+        _mm512_storeu_si512(margins + i, _mm512_max_epu8(_mm512_loadu_si512(margins + i), margin));
+    }
+}
+
+#endif // VALIK_COUNTING_KERNEL_X86
+
+} // namespace counting_kernel_impl
+
+inline simd_level counting_kernel::supported_level() noexcept
+{
+#ifdef VALIK_COUNTING_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return simd_level::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return simd_level::avx2;
+#endif
+    return simd_level::scalar;
+}
+
+/**
+ * @brief Function that returns the kernel for an instruction set. Unsupported instruction sets fall back to the scalar
+ *        kernel.
+ */
+inline counting_kernel counting_kernel::for_level(simd_level const level) noexcept
+{
+    using namespace counting_kernel_impl;
+#ifdef VALIK_COUNTING_KERNEL_X86
+    simd_level const supported = supported_level();
+    if (level == simd_level::avx512 && supported == simd_level::avx512)
+        return counting_kernel{add_avx512, subtract_avx512, above_threshold_avx512, max_margin_avx512, simd_level::avx512};
+    if (level != simd_level::scalar && supported != simd_level::scalar)
+        return counting_kernel{add_avx2, subtract_avx2, above_threshold_avx2, max_margin_avx2, simd_level::avx2};
+#else
+    (void) level;
+#endif
+    return counting_kernel{add_scalar, subtract_scalar, above_threshold_scalar, max_margin_scalar, simd_level::scalar};
+}
+
+} // namespace valik::detail
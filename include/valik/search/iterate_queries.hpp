@@ -1,7 +1,9 @@
 #pragma once
 
 #include <valik/search/producer_threads_parallel.hpp>
+#include <valik/search/query_registry.hpp>
 #include <valik/search/search_time_statistics.hpp>
+#include <utilities/batch_pipeline.hpp>
 
 #include <dream_stellar/utils/stellar_app_runtime.hpp>
 #include <dream_stellar/io/import_sequence.hpp>
@@ -11,49 +13,25 @@
 namespace valik::app
 {
 
-/**
- * @brief Function that sends chunks of queries to the prefilter which then writes shopping carts onto disk.
- *
- * @param arguments Command line arguments.
- * @param index Valik index of the reference database.
- * @param thresholder Threshold for number of shared k-mers.
- * @param queue Shopping cart queue for load balancing between prefiltering and Stellar search.
- */
-template <typename index_t, typename cart_queue_t>
-void iterate_distributed_queries(search_arguments const & arguments,
-                                 index_t const & index,
-                                 raptor::threshold::threshold const & thresholder,
-                                 cart_queue_t & queue)
-{
-    using fields = seqan3::fields<seqan3::field::id, seqan3::field::seq>;
-    std::vector<query_record> query_records{};
-    seqan3::sequence_file_input<dna4_traits, fields> fin{arguments.query_file};
-    for (auto &&chunked_records : fin | seqan3::views::chunk((1ULL << 20) * 10))
-    {
-        query_records.clear();
-        for (auto && fasta_record: chunked_records)
-            query_records.emplace_back(std::move(fasta_record.id()), std::move(fasta_record.sequence()));
-
-        prefilter_queries_parallel(index, arguments, query_records, thresholder, queue);
-    }
-}
+//!\brief Minimum size in bytes of a batch of query records that is prefiltered at once.
+inline constexpr size_t query_batch_bytes{(1ULL << 20) * 64};
+//!\brief Number of full batches that the query reader can be ahead of the prefilter.
+inline constexpr size_t queued_query_batches{2};
 
 /**
- * @brief Function that creates a query record from each query sequence and sends it to Stellar search.
+ * @brief Function that reads the query sequences into the registry and passes a shared query record for each one to
+ *        the batch builder.
  *
- * @param ref_seg_count Number of reference segments i.e the distribution granularity.
  * @param arguments Command line arguments.
- * @param queue Shopping cart queue for sending queries over to Stellar search.
+ * @param registry Owner of the query sequences.
+ * @param builder Batch builder of the pipeline.
  */
 template <typename TSequence>
-void iterate_all_queries(size_t const ref_seg_count,
-                         search_arguments const & arguments,
-                         cart_queue<shared_query_record<TSequence>> & queue)
+void read_shared_queries(search_arguments const & arguments,
+                         query_registry<TSequence> & registry,
+                         batch_builder<shared_query_record<TSequence>> & builder)
 {
     using TId = seqan2::CharString;
-    std::vector<shared_query_record<TSequence>> query_records{};
-    constexpr uint64_t chunk_size = (1ULL << 20) * 10;
-
     seqan2::SeqFileIn inSeqs;
     if (!open(inSeqs, arguments.query_file.c_str()))
     {
@@ -70,91 +48,221 @@ void iterate_all_queries(size_t const ref_seg_count,
         readRecord(id, seq, inSeqs);
         idsUnique &= dream_stellar::_checkUniqueId(uniqueIds, id);
 
-        query_records.emplace_back(std::move(seq), seqan2::toCString(std::move(id)));
-
-        if (query_records.size() > chunk_size)
-        {
-            search_all_parallel<shared_query_record<TSequence>>(ref_seg_count, arguments, query_records, queue);
-            query_records.clear();
-        }
+        size_t const record_bytes = seqan2::length(seq) + seqan2::length(id) + sizeof(shared_query_record<TSequence>);
+        query_handle const handle = registry.add(seqan2::toCString(id), std::move(seq));
+        shared_query_record<TSequence> record = registry.record(handle);
+        registry.release(handle);
+        if (!builder.add(std::move(record), record_bytes))
+            return;
     }
 
     if (!idsUnique)
         std::cerr << "WARNING: Non-unique query ids. Output can be ambiguous.\n";
+}
+
+/**
+ * @brief Function that sends batches of queries to the prefilter which then writes shopping carts onto disk.
+ *        Reading the next batches overlaps with prefiltering.
+ *
+ * @param arguments Command line arguments.
+ * @param index Valik index of the reference database.
+ * @param thresholder Threshold for number of shared k-mers.
+ * @param queue Shopping cart queue for load balancing between prefiltering and Stellar search.
+ * @param pool Producer threads that prefilter the batches of queries.
+ */
+template <typename index_t, typename cart_queue_t>
+void iterate_distributed_queries(search_arguments const & arguments,
+                                 index_t const & index,
+                                 raptor::threshold::threshold const & thresholder,
+                                 cart_queue_t & queue,
+                                 work_stealing_pool & pool)
+{
+    auto read_records = [&arguments](batch_builder<query_record> & builder)
+    {
+        using fields = seqan3::fields<seqan3::field::id, seqan3::field::seq>;
+        seqan3::sequence_file_input<dna4_traits, fields> fin{arguments.query_file};
+        for (auto && fasta_record : fin)
+        {
+            size_t const record_bytes = fasta_record.sequence().size() + fasta_record.id().size() + sizeof(query_record);
+            if (!builder.add(query_record{std::move(fasta_record.id()), std::move(fasta_record.sequence())}, record_bytes))
+                return;
+        }
+    };
+
+    producer_contexts<index_t> contexts{index, pool};
+    run_batch_pipeline<query_record>(read_records,
+                                     [&](std::vector<query_record> const & query_records)
+                                     {
+                                         prefilter_queries_parallel(index, arguments, query_records, thresholder, queue, pool, contexts);
+                                     },
+                                     query_batch_bytes,
+                                     queued_query_batches);
+}
 
-    search_all_parallel<shared_query_record<TSequence>>(ref_seg_count, arguments, query_records, queue);    
+/**
+ * @brief Function that creates a query record from each query sequence and sends it to Stellar search.
+ *
+ * @param ref_seg_count Number of reference segments i.e the distribution granularity.
+ * @param arguments Command line arguments.
+ * @param registry Owner of the query sequences that the carts refer to.
+ * @param queue Shopping cart queue for sending queries over to Stellar search.
+ * @param pool Producer threads that fill the queue.
+ */
+template <typename TSequence, typename cart_queue_t>
+void iterate_all_queries(size_t const ref_seg_count,
+                         search_arguments const & arguments,
+                         query_registry<TSequence> & registry,
+                         cart_queue_t & queue,
+                         work_stealing_pool & pool)
+{
+    using query_t = shared_query_record<TSequence>;
+    run_batch_pipeline<query_t>([&arguments, &registry](batch_builder<query_t> & builder)
+                                {
+                                    read_shared_queries<TSequence>(arguments, registry, builder);
+                                },
+                                [&](std::vector<query_t> const & query_records)
+                                {
+                                    search_all_parallel<query_t>(ref_seg_count, query_records, queue, pool);
+                                    registry.release(query_records);
+                                },
+                                query_batch_bytes,
+                                queued_query_batches);
 }
 
 /**
  * @brief Function that creates short query records from fasta file input and sends them for prefiltering.
+ *        Reading the next batches overlaps with prefiltering.
  *
  * @tparam index_t Valik index type containing Interleaved Bloom Filter.
  * @param arguments Command line arguments.
  * @param infex Valik index of the reference database.
  * @param thresholder Threshold for number of shared k-mers.
- * @param queue Shopping cart queue for load balancing between Valik prefiltering and Stellar search.
+ * @param registry Owner of the query sequences that the carts refer to.
+ * @param queue Shopping cart queue for load balancing between Valik prefiltering and Stellar search or
+ *              valik::prefilter_hits_writer for --prefilter-only.
+ * @param pool Producer threads that prefilter the batches of queries.
  */
-template <typename index_t, typename TSequence>
+template <typename index_t, typename TSequence, typename sink_t>
 void iterate_short_queries(search_arguments const & arguments,
                            index_t const & index,
                            raptor::threshold::threshold const & thresholder,
-                           cart_queue<shared_query_record<TSequence>> & queue)
+                           query_registry<TSequence> & registry,
+                           sink_t & queue,
+                           work_stealing_pool & pool)
 {
-    using TId = seqan2::CharString;
-    std::vector<shared_query_record<TSequence>> query_records{};
-    constexpr uint64_t chunk_size = (1ULL << 20) * 10;
-
-    seqan2::SeqFileIn inSeqs;
-    if (!open(inSeqs, arguments.query_file.c_str()))
-    {
-        throw std::runtime_error("Failed to open " + arguments.query_file.string() + " file.");
-    }
-
-    std::set<TId> uniqueIds; // set of short IDs (cut at first whitespace)
-    bool idsUnique = true;
-
-    for (; !atEnd(inSeqs);)
-    {
-        TSequence seq{};
-        TId id{};
-        readRecord(id, seq, inSeqs);
-        idsUnique &= dream_stellar::_checkUniqueId(uniqueIds, id);
-
-        query_records.emplace_back(std::move(seq), seqan2::toCString(std::move(id)));
-
-        if (query_records.size() > chunk_size)
-        {
-            prefilter_queries_parallel<shared_query_record<TSequence>>(index, arguments, query_records, thresholder, queue);
-            query_records.clear();
-        }
-    }
-
-    if (!idsUnique)
-        std::cerr << "WARNING: Non-unique query ids. Output can be ambiguous.\n";
-
-    prefilter_queries_parallel<shared_query_record<TSequence>>(index, arguments, query_records, thresholder, queue);
+    using query_t = shared_query_record<TSequence>;
+    producer_contexts<index_t> contexts{index, pool};
+    run_batch_pipeline<query_t>([&arguments, &registry](batch_builder<query_t> & builder)
+                                {
+                                    read_shared_queries<TSequence>(arguments, registry, builder);
+                                },
+                                [&](std::vector<query_t> const & query_records)
+                                {
+                                    prefilter_queries_parallel<query_t>(index, arguments, query_records, thresholder, queue, pool, contexts);
+                                    registry.release(query_records);
+                                },
+                                query_batch_bytes,
+                                queued_query_batches);
 }
 
 /**
  * @brief Function that creates split query records from fasta file input and sends them for prefiltering.
+ *        Reading the next batches overlaps with prefiltering.
  *
  * @tparam index_t Valik index type containing Interleaved Bloom Filter.
  * @param arguments Command line arguments.
  * @param index Valik index of the reference database.
  * @param thresholder Threshold for number of shared k-mers.
- * @param queue Shopping cart queue for load balancing between Valik prefiltering and Stellar search.
+ * @param registry Owner of the query sequences that the carts refer to.
+ * @param queue Shopping cart queue for load balancing between Valik prefiltering and Stellar search or
+ *              valik::prefilter_hits_writer for --prefilter-only.
  * @param meta Metadata table for split query segments.
+ * @param pool Producer threads that prefilter the batches of queries.
  */
-template <typename index_t, typename TSequence>
+template <typename index_t, typename TSequence, typename sink_t>
 void iterate_split_queries(search_arguments const & arguments,
                            index_t const & index,
                            raptor::threshold::threshold const & thresholder,
-                           cart_queue<shared_query_record<TSequence>> & queue,
-                           metadata & meta)
+                           query_registry<TSequence> & registry,
+                           sink_t & queue,
+                           metadata & meta,
+                           work_stealing_pool & pool)
+{
+    using query_t = shared_query_record<TSequence>;
+    auto read_records = [&arguments, &meta, &registry](batch_builder<query_t> & builder)
+    {
+        using TId = seqan2::CharString;
+        seqan2::SeqFileIn inSeqs;
+        if (!open(inSeqs, arguments.query_file.c_str()))
+        {
+            throw std::runtime_error("Failed to open " + arguments.query_file.string() + " file.");
+        }
+
+        std::set<TId> uniqueIds; // set of short IDs (cut at first whitespace)
+        bool idsUnique = true;
+
+        size_t seqCount{0};
+        for (; !atEnd(inSeqs); ++seqCount)
+        {
+            TSequence seq{};
+            TId id{};
+            readRecord(id, seq, inSeqs);
+            idsUnique &= dream_stellar::_checkUniqueId(uniqueIds, id);
+
+            query_handle const handle = registry.add(seqan2::toCString(id), std::move(seq));
+
+            bool consumer_stopped{false};
+            for (auto const & seg : meta.segments_from_ind(seqCount))
+            {
+                // each split query record holds a reference to the same sequence
+                // the sequence is freed when it is neither in a batch nor in a cart any more
+                size_t const record_bytes = seg.len + seqan2::length(id) + sizeof(query_t);
+                if (!builder.add(registry.record(handle, seg.start, seg.len), record_bytes))
+                {
+                    consumer_stopped = true;
+                    break;
+                }
+            }
+            registry.release(handle);
+            if (consumer_stopped)
+                return;
+        }
+
+        if (!idsUnique)
+            std::cerr << "WARNING: Non-unique query ids. Output can be ambiguous.\n";
+    };
+
+    producer_contexts<index_t> contexts{index, pool};
+    run_batch_pipeline<query_t>(read_records,
+                                [&](std::vector<query_t> const & query_records)
+                                {
+                                    prefilter_queries_parallel<query_t>(index, arguments, query_records, thresholder, queue, pool, contexts);
+                                    registry.release(query_records);
+                                },
+                                query_batch_bytes,
+                                queued_query_batches);
+}
+
+/**
+ * @brief Function that creates query records from the prefilter hits of an earlier search and sends them to Stellar search.
+ *        The query file is read sequentially and only the sequences that have prefilter hits are kept.
+ *
+ * @param arguments Command line arguments.
+ * @param registry Owner of the query sequences that the carts refer to.
+ * @param queue Shopping cart queue for sending queries over to Stellar search.
+ * @param bin_count Number of bins of the queue.
+ */
+template <typename TSequence, typename cart_queue_t>
+void iterate_prefilter_hits(search_arguments const & arguments,
+                            query_registry<TSequence> & registry,
+                            cart_queue_t & queue,
+                            size_t const bin_count)
 {
     using TId = seqan2::CharString;
-    std::vector<shared_query_record<TSequence>> query_records{};
-    constexpr uint64_t chunk_size = (1ULL << 20) * 10;
+    prefilter_hits_reader reader{arguments.prefilter_hits_file};
+    if (reader.header().bin_count != bin_count)
+        throw std::runtime_error{"The prefilter hits were computed for " + std::to_string(reader.header().bin_count) +
+                                 " bins but the search uses " + std::to_string(bin_count) + " bins."};
 
     seqan2::SeqFileIn inSeqs;
     if (!open(inSeqs, arguments.query_file.c_str()))
@@ -165,33 +273,86 @@ void iterate_split_queries(search_arguments const & arguments,
     std::set<TId> uniqueIds; // set of short IDs (cut at first whitespace)
     bool idsUnique = true;
 
-    size_t seqCount{0};
-    for (; !atEnd(inSeqs); ++seqCount)
+    // the hits are stored in the order of the query file and merged with the query sequences in a single pass
+    std::vector<prefilter_hit_record> hits{};
+    std::vector<size_t> bins{};
+    for (; !atEnd(inSeqs);)
     {
         TSequence seq{};
         TId id{};
         readRecord(id, seq, inSeqs);
         idsUnique &= dream_stellar::_checkUniqueId(uniqueIds, id);
 
-        auto query_ptr = std::make_shared<TSequence>(std::move(seq));
+        std::string const sequence_id{seqan2::toCString(id)};
+        reader.take_records(sequence_id, hits);
+        if (hits.empty())
+            continue;
 
-        for (auto const & seg : meta.segments_from_ind(seqCount))
+        size_t const query_length = seqan2::length(seq);
+        query_handle const handle = registry.add(sequence_id, std::move(seq));
+        for (prefilter_hit_record const & hit : hits)
         {
-            // each split query record contains a copy of the same shared pointer
-            query_records.emplace_back(seqan2::toCString(id), seg, query_ptr);
+            if (hit.begin + hit.length > query_length)
+                throw std::runtime_error{"The prefilter hits of " + sequence_id + " do not match the query file."};
 
-            if (query_records.size() > chunk_size)
-            {
-                prefilter_queries_parallel<shared_query_record<TSequence>>(index, arguments, query_records, thresholder, queue);
-                query_records.clear();  // shared pointers are erased -> memory is deallocated
-            }
+            // each cart entry holds a reference to the query sequence
+            bins.assign(hit.bins.begin(), hit.bins.end());
+            insert_into_carts(queue, registry.record(handle, hit.begin, hit.length), bins);
+            registry.release(handle);   // the reference of the record
         }
+        registry.release(handle);       // the reference of the reader
     }
 
+    if (!reader.finished())
+        throw std::runtime_error{"The prefilter hits contain query sequences that are not in the query file or out of order."};
+
     if (!idsUnique)
         std::cerr << "WARNING: Non-unique query ids. Output can be ambiguous.\n";
+}
+
+/**
+ * @brief Function that creates query records from the prefilter hits of an earlier search and sends them to distributed
+ *        Stellar search.
+ *
+ * @param arguments Command line arguments.
+ * @param queue Shopping cart queue for load balancing between the prefilter hits and Stellar search.
+ * @param bin_count Number of bins of the queue.
+ */
+template <typename cart_queue_t>
+void iterate_distributed_prefilter_hits(search_arguments const & arguments,
+                                        cart_queue_t & queue,
+                                        size_t const bin_count)
+{
+    prefilter_hits_reader reader{arguments.prefilter_hits_file};
+    if (reader.header().bin_count != bin_count)
+        throw std::runtime_error{"The prefilter hits were computed for " + std::to_string(reader.header().bin_count) +
+                                 " bins but the search uses " + std::to_string(bin_count) + " bins."};
+
+    using fields = seqan3::fields<seqan3::field::id, seqan3::field::seq>;
+    seqan3::sequence_file_input<dna4_traits, fields> fin{arguments.query_file};
+    std::vector<prefilter_hit_record> hits{};
+    for (auto && fasta_record : fin)
+    {
+        reader.take_records(fasta_record.id(), hits);
+        if (hits.empty())
+            continue;
+
+        auto const & sequence = fasta_record.sequence();
+        for (prefilter_hit_record const & hit : hits)
+        {
+            if (hit.begin + hit.length > sequence.size())
+                throw std::runtime_error{"The prefilter hits of " + fasta_record.id() + " do not match the query file."};
+
+            query_record const record{fasta_record.id(),
+                                      std::vector<seqan3::dna4>(sequence.begin() + hit.begin,
+                                                                sequence.begin() + hit.begin + hit.length)};
+            for (uint32_t const bin : hit.bins)
+                queue.insert(bin, record);
+        }
+    }
 
-    prefilter_queries_parallel<shared_query_record<TSequence>>(index, arguments, query_records, thresholder, queue);
+    if (!reader.finished())
+        throw std::runtime_error{"The prefilter hits contain query sequences that are not in the query file or out of order."};
 }
 
 }   // namespace valik::app
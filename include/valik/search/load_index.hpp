@@ -1,20 +1,469 @@
 #pragma once
 
+#include <cstring>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <sstream>
 
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <utilities/mapped_file.hpp>
 #include <valik/index.hpp>
 #include <valik/shared.hpp>
 
 namespace valik
 {
 
+namespace detail
+{
+
+//!\brief The first 8 bytes of a file, or zeros if the file is shorter.
+inline std::array<char, 8> read_index_magic(std::filesystem::path const & index_file)
+{
+    std::ifstream is{index_file, std::ios::binary};
+    std::array<char, 8> magic{};
+    is.read(magic.data(), magic.size());
+    if (is.gcount() != static_cast<std::streamsize>(magic.size()))
+        magic.fill('\0');
+    return magic;
+}
+
+inline mapped_index_header read_mapped_index_header(std::byte const * data, size_t const size)
+{
+    mapped_index_header header{};
+    if (size < sizeof(header))
+        throw sharg::validation_error{"Cannot read index: file is too short."};
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != mapped_index_header::magic_bytes)
+        throw sharg::validation_error{"Cannot read index: not a mapped index."};
+    if (header.version != valik_index<>::version)
+        throw sharg::validation_error{"Unsupported index version. Check valik upgrade."}; // GCOVR_EXCL_LINE
+    if (header.parameters_offset + header.parameters_size > size || header.payload_offset + header.payload_size > size)
+        throw sharg::validation_error{"Cannot read index: file is truncated."};
+
+    return header;
+}
+
+} // namespace detail
+
+/**
+ * @brief Function that checks if an index file was stored in the mapped layout.
+ *
+ * @param index_file Path to index.
+ */
+inline bool is_mapped_index(std::filesystem::path const & index_file)
+{
+    return detail::read_index_magic(index_file) == mapped_index_header::magic_bytes;
+}
+
+/**
+ * @brief Function that checks if an index file contains a compressed IBF.
+ *
+ * @param index_file Path to index.
+ */
+inline bool is_compressed_index(std::filesystem::path const & index_file)
+{
+    return detail::read_index_magic(index_file) == archive_magic<index_structure::ibf_compressed>;
+}
+
+/**
+ * @brief Function that checks if an index file contains a hierarchical IBF.
+ *
+ * @param index_file Path to index.
+ */
+inline bool is_hierarchical_index(std::filesystem::path const & index_file)
+{
+    return detail::read_index_magic(index_file) == archive_magic<index_structure::hibf>;
+}
+
+/**
+ * @brief Function that checks if an index file was stored in the sectioned layout.
+ *
+ * @param index_file Path to index.
+ */
+inline bool is_sectioned_index(std::filesystem::path const & index_file)
+{
+    return detail::read_index_magic(index_file) == sectioned_index_header::magic_bytes;
+}
+
+/**
+ * @brief Reads single sections of an index stored in the sectioned layout (see valik::sectioned_index_header).
+ *
+ * Only the header and the section table are read on construction. Each section is verified against its checksum
+ * when it is read.
+ */
+class sectioned_index_reader
+{
+private:
+    std::filesystem::path path_{};
+    std::ifstream is_{};
+    std::vector<index_section_entry> table_{};
+
+    index_section_entry const * find(index_section const kind, uint32_t const block = 0u) const
+    {
+        auto it = std::ranges::find_if(table_, [&](index_section_entry const & entry)
+        {
+            return entry.kind == kind && entry.index == block;
+        });
+        return (it == table_.end()) ? nullptr : std::addressof(*it);
+    }
+
+    std::string read(index_section_entry const & entry)
+    {
+        std::string bytes(entry.size, '\0');
+        is_.seekg(entry.offset);
+        is_.read(bytes.data(), bytes.size());
+        if (is_.gcount() != static_cast<std::streamsize>(bytes.size()))
+            throw sharg::validation_error{"Cannot read index: file is truncated."};
+        if (detail::section_checksum(bytes.data(), bytes.size()) != entry.checksum)
+            throw sharg::validation_error{"Cannot read index: checksum mismatch in " + path_.string() + "."};
+        return bytes;
+    }
+
+    std::string read(index_section const kind)
+    {
+        index_section_entry const * entry = find(kind);
+        if (entry == nullptr)
+            throw sharg::validation_error{"Cannot read index: missing section."};
+        return read(*entry);
+    }
+
+public:
+    explicit sectioned_index_reader(std::filesystem::path path) : path_{std::move(path)}, is_{path_, std::ios::binary}
+    {
+        sectioned_index_header header{};
+        is_.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!is_ || header.magic != sectioned_index_header::magic_bytes)
+            throw sharg::validation_error{"Cannot read index: not a sectioned index."};
+        if (header.version != sectioned_index_header::current_version)
+            throw sharg::validation_error{"Unsupported index version. Check valik upgrade."}; // GCOVR_EXCL_LINE
+
+        table_.resize(header.section_count);
+        is_.read(reinterpret_cast<char *>(table_.data()), table_.size() * sizeof(index_section_entry));
+        if (!is_)
+            throw sharg::validation_error{"Cannot read index: file is truncated."};
+    }
+
+    bool has_section(index_section const kind) const
+    {
+        return find(kind) != nullptr;
+    }
+
+    template <typename data_t>
+    void read_parameters(valik_index<data_t> & index)
+    {
+        std::istringstream parameters{read(index_section::parameters), std::ios::binary};
+        cereal::BinaryInputArchive iarchive{parameters};
+        index.load_parameters(iarchive);
+    }
+
+    std::vector<size_t> read_entropy_ranking()
+    {
+        std::istringstream bytes{read(index_section::entropy_ranking), std::ios::binary};
+        cereal::BinaryInputArchive iarchive{bytes};
+        std::vector<size_t> entropy_ranking{};
+        iarchive(entropy_ranking);
+        return entropy_ranking;
+    }
+
+    detail::ibf_geometry read_ibf_parameters()
+    {
+        std::istringstream bytes{read(index_section::ibf_parameters), std::ios::binary};
+        cereal::BinaryInputArchive iarchive{bytes};
+        uint64_t bin_count{};
+        uint64_t bin_size{};
+        uint64_t hash_count{};
+        iarchive(bin_count, bin_size, hash_count);
+        return detail::ibf_geometry{bin_count, bin_size, hash_count};
+    }
+
+    //!\brief Function that reads the threshold tables. Indices without index_section::thresholds have none.
+    precomputed_thresholds read_thresholds()
+    {
+        precomputed_thresholds thresholds{};
+        if (std::optional<std::string> const bytes = read_section(index_section::thresholds))
+        {
+            std::istringstream is{*bytes, std::ios::binary};
+            cereal::BinaryInputArchive iarchive{is};
+            iarchive(thresholds);
+        }
+        return thresholds;
+    }
+
+    /**
+     * @brief Function that reads the bins [64 * block, 64 * block + 64) into an IBF of their own.
+     *        The result can be added to a valik::sharded_ibf.
+     */
+    index_structure::ibf read_bin_block(size_t const block)
+    {
+        detail::ibf_geometry const geometry = read_ibf_parameters();
+        index_section_entry const * entry = find(index_section::bin_block, block);
+        if (block >= geometry.bin_words || entry == nullptr || entry->size != geometry.bin_size * sizeof(uint64_t))
+            throw sharg::validation_error{"Cannot read index: missing or corrupted bin block."};
+
+        index_structure::ibf ibf{seqan3::bin_count{std::min<size_t>(64u, geometry.bins - (block << 6))},
+                                 seqan3::bin_size{geometry.bin_size},
+                                 seqan3::hash_function_count{geometry.hash_funs}};
+        std::string const bytes = read(*entry);
+        std::memcpy(ibf.raw_data().data(), bytes.data(), bytes.size());
+        return ibf;
+    }
+
+    //!\brief Function that reads all bin blocks into an interleaved IBF.
+    index_structure::ibf read_ibf()
+    {
+        detail::ibf_geometry const geometry = read_ibf_parameters();
+        index_structure::ibf ibf{seqan3::bin_count{geometry.bins},
+                                 seqan3::bin_size{geometry.bin_size},
+                                 seqan3::hash_function_count{geometry.hash_funs}};
+        uint64_t * const words = ibf.raw_data().data();
+        for (size_t block = 0; block < geometry.bin_words; ++block)
+        {
+            index_section_entry const * entry = find(index_section::bin_block, block);
+            if (entry == nullptr || entry->size != geometry.bin_size * sizeof(uint64_t))
+                throw sharg::validation_error{"Cannot read index: missing or corrupted bin block."};
+
+            std::string const bytes = read(*entry);
+            for (size_t row = 0; row < geometry.bin_size; ++row)
+                std::memcpy(words + row * geometry.bin_words + block, bytes.data() + row * sizeof(uint64_t), sizeof(uint64_t));
+        }
+        return ibf;
+    }
+
+    //!\brief Function that returns the raw bytes of an optional section, e.g. index_section::thresholds.
+    std::optional<std::string> read_section(index_section const kind)
+    {
+        if (!has_section(kind))
+            return std::nullopt;
+        return read(kind);
+    }
+};
+
+/**
+ * @brief Function that checks if an index file is the manifest of a sharded index.
+ *
+ * @param index_file Path to index.
+ */
+inline bool is_sharded_index(std::filesystem::path const & index_file)
+{
+    return detail::read_index_magic(index_file) == archive_magic<index_structure::sharded_ibf>;
+}
+
 template <typename index_t>
 void load_index(index_t & index, std::filesystem::path const & index_file)
 {
+    using data_t = std::remove_cvref_t<decltype(index.ibf())>;
+    if constexpr (std::same_as<data_t, index_structure::ibf>)
+    {
+        if (is_sectioned_index(index_file))
+        {
+            sectioned_index_reader reader{index_file};
+            reader.read_parameters(index);
+            index.entropy_ranking() = reader.read_entropy_ranking();
+            index.thresholds() = reader.read_thresholds();
+            index.ibf() = reader.read_ibf();
+            return;
+        }
+    }
+
     std::ifstream is{index_file, std::ios::binary};
+    if constexpr (has_archive_magic<data_t>)
+    {
+        std::array<char, 8> magic{};
+        is.read(magic.data(), magic.size());
+        if (magic != archive_magic<data_t>)
+            throw sharg::validation_error{"Cannot read index: the IBF is stored in a different layout."};
+    }
     cereal::BinaryInputArchive iarchive{is};
 
     iarchive(index);
+    // threshold tables follow the index if build computed them
+    if (is.peek() != std::ifstream::traits_type::eof())
+        iarchive(index.thresholds());
+}
+
+/**
+ * @brief Function that memory maps an index stored in the mapped layout. The IBF is not copied.
+ *
+ * @param index Index that views the mapping (out-parameter).
+ * @param index_file Path to index.
+ */
+inline void load_index(valik_index<index_structure::mapped_ibf> & index, std::filesystem::path const & index_file)
+{
+    auto file = std::make_shared<mapped_file const>(index_file);
+    mapped_index_header const header = detail::read_mapped_index_header(file->data(), file->size());
+
+    std::istringstream parameters{std::string{reinterpret_cast<char const *>(file->data() + header.parameters_offset),
+                                              header.parameters_size},
+                                  std::ios::binary};
+    cereal::BinaryInputArchive iarchive{parameters};
+    index.load_parameters(iarchive);
+
+    uint64_t bin_count{};
+    uint64_t bin_size{};
+    uint64_t hash_count{};
+    try
+    {
+        iarchive(index.entropy_ranking(), bin_count, bin_size, hash_count);
+        if (parameters.peek() != std::istringstream::traits_type::eof())
+            iarchive(index.thresholds());
+    }
+    catch (std::exception const & e)
+    {
+        throw sharg::validation_error{"Cannot read index: " + std::string{e.what()}};
+    }
+
+    detail::ibf_geometry const geometry{bin_count, bin_size, hash_count};
+    if (geometry.word_count() * sizeof(uint64_t) != header.payload_size)
+        throw sharg::validation_error{"Cannot read index: IBF size does not match the stored parameters."};
+
+    index.ibf() = mapped_ibf{std::move(file), header.payload_offset, geometry};
+}
+
+/**
+ * @brief Function that reads the manifest of a sharded index and loads a range of its shards.
+ *        In an index of version 2, each bin block of 64 bins is a shard. Only the sections of the chosen blocks are read.
+ *
+ * @param index Index with the loaded shards (out-parameter).
+ * @param index_file Path to the manifest or to an index of version 2.
+ * @param first_shard First shard to load.
+ * @param last_shard Last shard to load (inclusive). All shards by default.
+ */
+inline void load_index(valik_index<index_structure::sharded_ibf> & index,
+                       std::filesystem::path const & index_file,
+                       size_t const first_shard = 0,
+                       size_t const last_shard = std::numeric_limits<size_t>::max())
+{
+    if (is_sectioned_index(index_file))
+    {
+        sectioned_index_reader reader{index_file};
+        reader.read_parameters(index);
+        index.entropy_ranking() = reader.read_entropy_ranking();
+        index.thresholds() = reader.read_thresholds();
+        detail::ibf_geometry const geometry = reader.read_ibf_parameters();
+        if (first_shard > last_shard || first_shard >= geometry.bin_words)
+            throw sharg::validation_error{"Cannot read index: the index has only " + std::to_string(geometry.bin_words) +
+                                          " shards."};
+
+        index.ibf() = sharded_ibf{geometry.bins, geometry.bin_size, geometry.hash_funs};
+        for (size_t block = first_shard; block <= std::min(last_shard, geometry.bin_words - 1); ++block)
+            index.ibf().add_shard(block << 6, reader.read_bin_block(block));
+        return;
+    }
+
+    std::vector<uint64_t> first_bins{};
+    std::vector<uint64_t> bin_counts{};
+    std::vector<std::string> shard_files{};
+    {
+        std::ifstream is{index_file, std::ios::binary};
+        std::array<char, 8> magic{};
+        is.read(magic.data(), magic.size());
+        if (magic != archive_magic<index_structure::sharded_ibf>)
+            throw sharg::validation_error{"Cannot read index: not a sharded index."};
+
+        cereal::BinaryInputArchive iarchive{is};
+        index.load_parameters(iarchive);
+
+        uint64_t bin_count{};
+        uint64_t bin_size{};
+        uint64_t hash_count{};
+        try
+        {
+            iarchive(index.entropy_ranking(), bin_count, bin_size, hash_count);
+            iarchive(first_bins, bin_counts, shard_files);
+            if (is.peek() != std::ifstream::traits_type::eof())
+                iarchive(index.thresholds());
+        }
+        catch (std::exception const & e)
+        {
+            throw sharg::validation_error{"Cannot read index: " + std::string{e.what()}};
+        }
+        index.ibf() = sharded_ibf{bin_count, bin_size, hash_count};
+    }
+
+    if (first_shard > last_shard || first_shard >= shard_files.size())
+        throw sharg::validation_error{"Cannot read index: the index has only " + std::to_string(shard_files.size()) +
+                                      " shards."};
+
+    for (size_t shard = first_shard; shard <= std::min(last_shard, shard_files.size() - 1); ++shard)
+    {
+        std::ifstream is{index_file.parent_path() / shard_files[shard], std::ios::binary};
+        std::array<char, 8> magic{};
+        is.read(magic.data(), magic.size());
+        if (magic != shard_magic)
+            throw sharg::validation_error{"Cannot read index: shard " + shard_files[shard] + " is missing or corrupted."};
+
+        uint32_t version{};
+        uint64_t first_bin{};
+        sharded_ibf::ibf_t ibf{};
+        try
+        {
+            cereal::BinaryInputArchive iarchive{is};
+            iarchive(version, first_bin, ibf);
+        }
+        catch (std::exception const & e)
+        {
+            throw sharg::validation_error{"Cannot read index: " + std::string{e.what()}};
+        }
+
+        if (version != valik_index<>::version)
+            throw sharg::validation_error{"Unsupported index version. Check valik upgrade."}; // GCOVR_EXCL_LINE
+        if (first_bin != first_bins[shard] || ibf.bin_count() != bin_counts[shard])
+            throw sharg::validation_error{"Cannot read index: shard " + shard_files[shard] + " does not match the manifest."};
+
+        index.ibf().add_shard(first_bin, std::move(ibf));
+    }
+}
+
+/**
+ * @brief Function that loads the index of a search. Only the chosen shards of a sharded index are loaded.
+ *
+ * @param index Loaded index (out-parameter).
+ * @param arguments Search arguments with the index path and shard range.
+ */
+template <typename data_t>
+void load_index(valik_index<data_t> & index, search_arguments const & arguments)
+{
+    if constexpr (std::same_as<data_t, index_structure::sharded_ibf>)
+        load_index(index, arguments.index_file, arguments.first_shard, arguments.last_shard);
+    else
+        load_index(index, arguments.index_file);
+}
+
+/**
+ * @brief Function that only reads the window size, shape and bin paths of an index in any layout.
+ *
+ * @param index Index with parameters set (out-parameter).
+ * @param index_file Path to index.
+ */
+template <typename data_t>
+void load_index_parameters(valik_index<data_t> & index, std::filesystem::path const & index_file)
+{
+    if (is_sectioned_index(index_file))
+    {
+        sectioned_index_reader{index_file}.read_parameters(index);
+        return;
+    }
+
+    std::ifstream is{index_file, std::ios::binary};
+    if (is_mapped_index(index_file))
+    {
+        mapped_index_header header{};
+        is.read(reinterpret_cast<char *>(&header), sizeof(header));
+        is.seekg(header.parameters_offset);
+    }
+    else if (is_compressed_index(index_file) || is_hierarchical_index(index_file) || is_sharded_index(index_file))
+    {
+        is.seekg(archive_magic<index_structure::ibf_compressed>.size());
+    }
+
+    cereal::BinaryInputArchive iarchive{is};
+    index.load_parameters(iarchive);
 }
 
 } // namespace valik
@@ -1,12 +1,20 @@
 #pragma once
 
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <numeric>
 #include <span>
+#include <utility>
 
 #include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
 #include <seqan3/search/views/minimiser_hash.hpp>
 
 #include <raptor/threshold/threshold.hpp>
 
+#include <valik/batched_membership_agent.hpp>
+#include <valik/hierarchical_ibf.hpp>
+#include <valik/search/counting_kernel.hpp>
 #include <valik/search/query_record.hpp>
 #include <valik/shared.hpp> // search_arguments
 #include <valik/search/compat.hpp>
@@ -104,63 +112,591 @@ pattern_bounds make_pattern_bounds(size_t const & begin,
 }
 
 /**
- * @brief Function that for a single pattern counts matching k-mers and returns bins that exceed the threshold.
+ * @brief Set of bins stored as a bit vector. Inserting, clearing and iterating do not allocate.
+ */
+class bin_hits
+{
+private:
+    std::vector<uint64_t> words_{};
+    size_t count_{0};
+
+public:
+    bin_hits() = default;
+    bin_hits(bin_hits const &) = default;
+    bin_hits(bin_hits &&) = default;
+    bin_hits & operator=(bin_hits const &) = default;
+    bin_hits & operator=(bin_hits &&) = default;
+    ~bin_hits() = default;
+
+    explicit bin_hits(size_t const bin_count) : words_((bin_count + 63) >> 6, 0) {}
+
+    void insert(size_t const bin)
+    {
+        uint64_t & word = words_[bin >> 6];
+        uint64_t const bit = 1ULL << (bin & 63);
+        count_ += (word & bit) == 0;
+        word |= bit;
+    }
+
+    bool contains(size_t const bin) const
+    {
+        return (words_[bin >> 6] >> (bin & 63)) & 1ULL;
+    }
+
+    //!\brief Number of bins in the set.
+    size_t size() const noexcept
+    {
+        return count_;
+    }
+
+    bool empty() const noexcept
+    {
+        return count_ == 0;
+    }
+
+    void clear()
+    {
+        if (count_ > 0)
+            std::ranges::fill(words_, 0);
+        count_ = 0;
+    }
+
+    //!\brief Function that empties the set and sets the number of bins. Does not allocate for fewer bins than before.
+    void resize(size_t const bin_count)
+    {
+        words_.assign((bin_count + 63) >> 6, 0);
+        count_ = 0;
+    }
+
+    //!\brief Calls the callback for each bin in the set in ascending order.
+    template <typename callback_t>
+    void for_each(callback_t && callback) const
+    {
+        for (size_t w = 0; w < words_.size(); ++w)
+            for (uint64_t word = words_[w]; word != 0; word &= word - 1)
+                callback((w << 6) + std::countr_zero(word));
+    }
+};
+
+/**
+ * @brief The distinct values of a sequence of minimisers and the index of the distinct value at each position.
+ *
+ * Repetitive queries contain the same minimiser many times. The IBF only has to be queried once for each distinct
+ * minimiser, i.e. the cost of a low-complexity query is proportional to its number of distinct minimisers.
+ * The hash table is reused for all records that are prefiltered by a thread.
+ */
+class distinct_minimisers
+{
+private:
+    // distinct values in the order of their first occurrence
+    std::vector<uint64_t> values_{};
+    // index into values_ for each position
+    std::vector<uint32_t> ids_{};
+    // open addressing hash table of id + 1; 0 marks an empty slot
+    std::vector<uint32_t> slots_{};
+
+public:
+    /**
+     * @brief Function that finds the distinct values of a sequence of minimisers.
+     *
+     * @param minimisers The minimisers of a query.
+     */
+    void assign(std::vector<uint64_t> const & minimisers)
+    {
+        assert(minimisers.size() < std::numeric_limits<uint32_t>::max());
+        values_.clear();
+        ids_.resize(minimisers.size());
+
+        // a load factor of at most one half
+        size_t const slot_count = std::bit_ceil(std::max<size_t>(minimisers.size() * 2, 16u));
+        slots_.assign(slot_count, 0u);
+        size_t const shift = 64 - std::countr_zero(slot_count);
+
+        for (size_t i{0}; i < minimisers.size(); ++i)
+        {
+            uint64_t const value = minimisers[i];
+            size_t slot = (value * 11400714819323198485ULL) >> shift;
+            while (true)
+            {
+                uint32_t const entry = slots_[slot];
+                if (entry == 0)
+                {
+                    values_.push_back(value);
+                    slots_[slot] = values_.size();
+                    ids_[i] = values_.size() - 1;
+                    break;
+                }
+                if (values_[entry - 1] == value)
+                {
+                    ids_[i] = entry - 1;
+                    break;
+                }
+                slot = (slot + 1) & (slot_count - 1);
+            }
+        }
+    }
+
+    //!\brief Distinct values in the order of their first occurrence.
+    std::vector<uint64_t> const & values() const noexcept
+    {
+        return values_;
+    }
+
+    //!\brief Index of the distinct value at each position.
+    std::vector<uint32_t> const & ids() const noexcept
+    {
+        return ids_;
+    }
+};
+
+/**
+ * @brief Rows of binning bit vectors stored in a single contiguous buffer.
+ *
+ * Rows: minimisers of the query. Columns: bins of the IBF.
+ * Rows of equal minimisers share one distinct row, so that each distinct minimiser is looked up once.
+ * The buffers only grow, so that they can be reused for all records that are prefiltered by a thread.
+ */
+class counting_matrix
+{
+private:
+    std::vector<uint64_t> words_{};
+    // index of the distinct row of each row
+    std::vector<uint32_t> row_ids_{};
+    size_t distinct_count_{0};
+    size_t word_count_{0};
+
+    void reserve_words(size_t const bin_count)
+    {
+        word_count_ = (bin_count + 63) >> 6;
+        if (words_.size() < distinct_count_ * word_count_)
+            words_.resize(distinct_count_ * word_count_);
+    }
+
+public:
+    /**
+     * @brief Function that resizes the matrix to rows that are all distinct.
+     *        The content of the rows is undefined until they are assigned.
+     *
+     * @param row_count Number of rows.
+     * @param bin_count Number of bins of the IBF.
+     */
+    void reset(size_t const row_count, size_t const bin_count)
+    {
+        row_ids_.resize(row_count);
+        std::iota(row_ids_.begin(), row_ids_.end(), 0u);
+        distinct_count_ = row_count;
+        reserve_words(bin_count);
+    }
+
+    /**
+     * @brief Function that resizes the matrix to rows that share distinct rows.
+     *        The content of the rows is undefined until the distinct rows are assigned.
+     *
+     * @param row_ids Index of the distinct row of each row, e.g. distinct_minimisers::ids().
+     * @param distinct_count Number of distinct rows.
+     * @param bin_count Number of bins of the IBF.
+     */
+    void reset(std::span<uint32_t const> const row_ids, size_t const distinct_count, size_t const bin_count)
+    {
+        row_ids_.assign(row_ids.begin(), row_ids.end());
+        distinct_count_ = distinct_count;
+        reserve_words(bin_count);
+    }
+
+    template <typename binning_bitvector_t>
+    void assign_row(size_t const i, binning_bitvector_t const & bits)
+    {
+        assert(i < row_ids_.size());
+        assign_distinct_row(row_ids_[i], bits);
+    }
+
+    template <typename binning_bitvector_t>
+    void assign_distinct_row(size_t const j, binning_bitvector_t const & bits)
+    {
+        assert(j < distinct_count_);
+        std::memcpy(distinct_row(j), bits.raw_data().data(), word_count_ * sizeof(uint64_t));
+    }
+
+    uint64_t * distinct_row(size_t const j) noexcept
+    {
+        return words_.data() + j * word_count_;
+    }
+
+    uint64_t const * row(size_t const i) const noexcept
+    {
+        return words_.data() + row_ids_[i] * word_count_;
+    }
+
+    size_t size() const noexcept
+    {
+        return row_ids_.size();
+    }
+
+    size_t distinct_size() const noexcept
+    {
+        return distinct_count_;
+    }
+
+    size_t word_count() const noexcept
+    {
+        return word_count_;
+    }
+};
+
+/**
+ * @brief Number of matching minimisers in each bin for the patterns of a query.
+ *
+ * Consecutive patterns of a query share most of their minimisers. Instead of summing all rows of the counting table
+ * for every pattern, the counts of the previous pattern are updated by adding the rows of the minimisers that enter
+ * the pattern and subtracting the rows of the minimisers that leave it. The cost per pattern is then proportional to
+ * the step between the patterns. The counts are recomputed if a pattern does not start after the previous one or
+ * shares less than half of its minimisers with it.
+ * Rows are accumulated by the vectorised detail::counting_kernel that is chosen for the CPU at runtime.
+ *
+ * Additionally, the largest margin by which each bin exceeds the threshold of any pattern is kept. A bin is a hit for
+ * a threshold correction c if its margin is at least c + 1, i.e. it reaches the threshold + c of at least one pattern.
+ */
+class pattern_counts
+{
+private:
+    detail::counting_kernel const * kernel_{std::addressof(detail::counting_kernel::best())};
+    size_t bin_count_{};
+    size_t word_count_{};
+    // one counter per bin of the padded bit vectors
+    std::vector<uint8_t> counts_{};
+    // largest count + 1 - threshold of all patterns; 0 if no pattern reached its threshold
+    std::vector<uint8_t> margins_{};
+    std::vector<uint64_t> hits_{};
+    size_t begin_position_{0};
+    size_t end_position_{0};
+
+    //!\brief Sets the bits of hits_ for all bins whose counter reaches the threshold.
+    bool find_above(std::vector<uint8_t> const & counters, size_t const threshold)
+    {
+        if (threshold > std::numeric_limits<uint8_t>::max())
+            return false;
+
+        kernel_->above_threshold(counters.data(), word_count_, static_cast<uint8_t>(threshold), hits_.data());
+        if (bin_count_ & 63)
+            hits_.back() &= (1ULL << (bin_count_ & 63)) - 1;
+        return true;
+    }
+
+    template <typename callback_t>
+    void for_each_hit(callback_t && callback) const
+    {
+        for (size_t w = 0; w < word_count_; ++w)
+            for (uint64_t word = hits_[w]; word != 0; word &= word - 1)
+                callback((w << 6) + std::countr_zero(word));
+    }
+
+public:
+    pattern_counts() = default;
+    pattern_counts(pattern_counts const &) = default;
+    pattern_counts(pattern_counts &&) = default;
+    pattern_counts & operator=(pattern_counts const &) = default;
+    pattern_counts & operator=(pattern_counts &&) = default;
+    ~pattern_counts() = default;
+
+    /**
+     * @brief Constructor that allocates the counters.
+     *
+     * @param bin_count Number of bins of the IBF.
+     * @param kernel Counting kernel, by default the best kernel for this CPU.
+     */
+    explicit pattern_counts(size_t const bin_count,
+                            detail::counting_kernel const & kernel = detail::counting_kernel::best()) :
+        kernel_{std::addressof(kernel)},
+        bin_count_{bin_count},
+        word_count_{(bin_count + 63) >> 6},
+        counts_(word_count_ << 6, 0),
+        margins_(word_count_ << 6, 0),
+        hits_(word_count_, 0)
+    {}
+
+    /**
+     * @brief Function that moves the counts to the minimisers of the given pattern.
+     *
+     * @param pattern The next pattern of the query.
+     * @param counting_table Rows: minimisers of the query. Columns: bins of the IBF.
+     * @return The number of minimisers of the pattern in each bin.
+     */
+    std::span<uint8_t const> slide_to(pattern_bounds const & pattern, counting_matrix const & counting_table)
+    {
+        assert(counting_table.word_count() == word_count_);
+        size_t const shared_begin = std::max(begin_position_, pattern.begin_position);
+        size_t const shared_end = std::min(end_position_, pattern.end_position);
+        bool const is_sliding = pattern.begin_position >= begin_position_ && pattern.end_position >= end_position_ &&
+                                shared_end > shared_begin && 2 * (shared_end - shared_begin) > pattern.minimiser_count();
+
+        if (is_sliding)
+        {
+            for (size_t i = begin_position_; i < pattern.begin_position; i++)
+                kernel_->subtract(counts_.data(), counting_table.row(i), word_count_);
+            for (size_t i = end_position_; i < pattern.end_position; i++)
+                kernel_->add(counts_.data(), counting_table.row(i), word_count_);
+        }
+        else
+        {
+            std::ranges::fill(counts_, 0);
+            for (size_t i = pattern.begin_position; i < pattern.end_position; i++)
+                kernel_->add(counts_.data(), counting_table.row(i), word_count_);
+        }
+
+        begin_position_ = pattern.begin_position;
+        end_position_ = pattern.end_position;
+        return std::span<uint8_t const>{counts_.data(), bin_count_};
+    }
+
+    //!\brief Function that forgets the previous pattern and the margins, e.g. before the patterns of the next query.
+    void reset() noexcept
+    {
+        begin_position_ = 0;
+        end_position_ = 0;
+        std::ranges::fill(margins_, 0);
+    }
+
+    /**
+     * @brief Function that sets the number of bins and resets the counts, e.g. before querying another IBF of a hierarchy.
+     *        Does not allocate for fewer bins than before.
+     */
+    void resize(size_t const bin_count)
+    {
+        bin_count_ = bin_count;
+        word_count_ = (bin_count + 63) >> 6;
+        counts_.assign(word_count_ << 6, 0);
+        margins_.assign(word_count_ << 6, 0);
+        hits_.assign(word_count_, 0);
+        begin_position_ = 0;
+        end_position_ = 0;
+    }
+
+    /**
+     * @brief Function that updates the margins with the counts of the current pattern.
+     *
+     * @param threshold Threshold of the current pattern.
+     */
+    void update_margins(size_t const threshold)
+    {
+        if (threshold <= std::numeric_limits<uint8_t>::max())
+            kernel_->max_margin(counts_.data(), word_count_, static_cast<uint8_t>(threshold), margins_.data());
+    }
+
+    /**
+     * @brief Function that calls the callback for each bin whose count for the current pattern reaches the threshold.
+     *
+     * @param threshold Minimum number of matching minimisers.
+     * @param callback Called with the bin index in ascending order.
+     */
+    template <typename callback_t>
+    void for_each_bin_above(size_t const threshold, callback_t && callback)
+    {
+        if (find_above(counts_, threshold))
+            for_each_hit(callback);
+    }
+
+    /**
+     * @brief Function that calls the callback for each bin that is a hit for the given threshold correction.
+     *
+     * @param correction Threshold correction.
+     * @param callback Called with the bin index in ascending order.
+     */
+    template <typename callback_t>
+    void for_each_bin_with_correction(size_t const correction, callback_t && callback)
+    {
+        if (find_above(margins_, correction + 1))
+            for_each_hit(callback);
+    }
+
+    //!\brief Number of bins that are a hit for the given threshold correction.
+    size_t count_bins_with_correction(size_t const correction)
+    {
+        if (!find_above(margins_, correction + 1))
+            return 0;
+
+        size_t count{0};
+        for (uint64_t const word : hits_)
+            count += std::popcount(word);
+        return count;
+    }
+};
+
+/**
+ * @brief Function that for a single pattern counts matching k-mers and updates by how much each bin exceeds the
+ *        threshold.
  *
  * @param pattern Slice of a query record that is being considered.
- * @param correction Threshold correction determined from a sample of patterns.
- * @param bin_count Number of bins in the IBF.
  * @param counting_table Rows: minimisers of the query. Columns: bins of the IBF.
- * @param sequence_hits Bins that likely contain a match for the pattern (IN-OUT parameter).
+ * @param counts Counts of the previous pattern of the query that are updated to this pattern (IN-OUT parameter).
  */
-template <typename binning_bitvector_t>
-void find_pattern_bins(pattern_bounds const & pattern,
-                       size_t const bin_count,
-                       binning_bitvector_t const & counting_table,
-                       std::unordered_set<size_t> & sequence_hits,
-                       uint8_t const correction = 0)
+inline void find_pattern_bins(pattern_bounds const & pattern,
+                              counting_matrix const & counting_table,
+                              pattern_counts & counts)
 {
-    // counting vector for the current pattern
-    seqan3::counting_vector<uint8_t> total_counts(bin_count, 0);
-
-    for (size_t i = pattern.begin_position; i < pattern.end_position; i++)
-        total_counts += counting_table[i];
+    counts.slide_to(pattern, counting_table);
+    counts.update_margins(pattern.threshold);
+}
 
-    for (size_t current_bin = 0; current_bin < total_counts.size(); current_bin++)
+/**
+ * @brief Buffers of local_prefilter that are reused for all records prefiltered by a thread.
+ *
+ * After the first records the buffers have grown to the size of the longest record and prefiltering a record does
+ * not allocate memory.
+ */
+struct prefilter_workspace
+{
+    std::vector<uint64_t> minimiser_values{};
+    // the beginning of the first window each minimiser is in
+    std::vector<size_t> window_span_begin{};
+    distinct_minimisers distinct_values{};
+    counting_matrix counting_table{};
+    pattern_counts counts{};
+    bin_hits sequence_hits{};
+    // technical bins of an IBF of a hierarchy that pass the threshold and the lower level IBFs that are queried next
+    bin_hits technical_hits{};
+    std::vector<size_t> pending_ibfs{};
+
+    prefilter_workspace() = default;
+    prefilter_workspace(prefilter_workspace const &) = default;
+    prefilter_workspace(prefilter_workspace &&) = default;
+    prefilter_workspace & operator=(prefilter_workspace const &) = default;
+    prefilter_workspace & operator=(prefilter_workspace &&) = default;
+    ~prefilter_workspace() = default;
+
+    explicit prefilter_workspace(size_t const bin_count) : counts{bin_count}, sequence_hits{bin_count} {}
+
+    /**
+     * @brief Function that stores the minimisers of a query, their distinct values and the beginning of the first window
+     *        they are in.
+     */
+    template <typename minimiser_view_t>
+    void set_minimisers(minimiser_view_t && minimiser_hash)
     {
-        if (total_counts[current_bin] >= (pattern.threshold + correction))
+        minimiser_values.clear();
+        window_span_begin.clear();
+        auto it = minimiser_hash.begin();
+        auto const sentinel = minimiser_hash.end();
+        auto const hash_begin = it.base();
+        for (; it != sentinel; ++it)
         {
-            // the result is a union of results from all patterns of a read
-            sequence_hits.insert(current_bin);
+            minimiser_values.push_back(*it);
+            window_span_begin.push_back(it.base() - hash_begin);
         }
+        distinct_values.assign(minimiser_values);
+    }
+};
+
+/**
+ * @brief Function that returns the agent that local_prefilter queries the IBF with.
+ *        Uncompressed IBFs are queried with a valik::batched_membership_agent, other IBFs with their membership agent.
+ */
+template <typename ibf_t>
+auto make_prefilter_agent(ibf_t const & ibf)
+{
+    if constexpr (std::constructible_from<batched_membership_agent, ibf_t const &>)
+        return batched_membership_agent{ibf};
+    else
+        return ibf.membership_agent();
+}
+
+/**
+ * @brief Agent and buffers of local_prefilter for an IBF.
+ *        A producer thread creates one context and reuses it for all records it prefilters, so that neither the agent
+ *        nor the buffers are allocated per batch of records.
+ *
+ * @tparam ibf_t A seqan3::interleaved_bloom_filter, valik::mapped_ibf or valik::sharded_ibf.
+ */
+template <typename ibf_t>
+struct prefilter_context
+{
+    // concurrent invocations of the membership agent are not thread safe
+    decltype(make_prefilter_agent(std::declval<ibf_t const &>())) agent;
+    prefilter_workspace workspace;
+
+    explicit prefilter_context(ibf_t const & ibf) : agent{make_prefilter_agent(ibf)}, workspace{ibf.bin_count()} {}
+};
+
+/**
+ * @brief Agents of all IBFs of a hierarchy and the buffers of local_prefilter.
+ *        The buffers of a level are sized for the largest IBF of the hierarchy and reused for all levels.
+ */
+template <>
+struct prefilter_context<hierarchical_ibf>
+{
+    std::vector<batched_membership_agent> agents{};
+    prefilter_workspace workspace{};
+
+    explicit prefilter_context(hierarchical_ibf const & hibf)
+    {
+        for (auto const & ibf : hibf.ibf_vector())
+            agents.emplace_back(ibf);
+
+        size_t max_bin_count{0};
+        for (auto const & user_bin_ids : hibf.ibf_bin_to_user_bin_id())
+            max_bin_count = std::max(max_bin_count, user_bin_ids.size());
+
+        workspace.counts = pattern_counts{max_bin_count};
+        workspace.technical_hits = bin_hits{max_bin_count};
+        workspace.sequence_hits = bin_hits{hibf.bin_count()};
+    }
+};
+
+/**
+ * @brief Function that fills the counting table with the binning bit vectors of the minimisers of a query.
+ *        Each distinct minimiser is looked up once.
+ *
+ * @param agent Agent returned by make_prefilter_agent.
+ * @param minimisers Distinct minimisers of the query.
+ * @param counting_table Table with one row per minimiser.
+ * @param bin_count Number of bins of the IBF.
+ */
+template <typename agent_t>
+void fill_counting_table(agent_t & agent,
+                         distinct_minimisers const & minimisers,
+                         counting_matrix & counting_table,
+                         size_t const bin_count)
+{
+    std::vector<uint64_t> const & values = minimisers.values();
+    counting_table.reset(minimisers.ids(), values.size(), bin_count);
+    if constexpr (std::same_as<agent_t, batched_membership_agent>)
+    {
+        assert(counting_table.word_count() == agent.word_count());
+        agent.bulk_contains(values, counting_table.distinct_row(0));
+    }
+    else
+    {
+        for (size_t j{0}; j < values.size(); j++)
+            counting_table.assign_distinct_row(j, agent.bulk_contains(values[j]));
     }
 }
 
 /**
  * @brief Function that queries the IBF for local matches in a batch of records.
  *
+ * @tparam ibf_t A seqan3::interleaved_bloom_filter, valik::mapped_ibf or valik::sharded_ibf.
  * @param records Query records.
  * @param ibf Interleaved Bloom Filter of the reference database.
+ * @param context Agent and buffers of the calling thread, created for ibf.
  * @param arguments Command line arguments.
  *                  arguments.pattern_size and arguments.error_rate define the minimum length and maximum error rate of a local match respectively.
  *                  arguments.query_every defines how many match locations are considered per record.
  * @param thresholder Threshold for the number of shared k-mers to constitute a likely local match.
  * @param result_cb Lambda that inserts the prefiltering results (record-bin pairs) into the shopping carts.
  */
-template <seqan3::data_layout ibf_data_layout, typename result_cb_t, typename query_t>
+template <typename ibf_t, typename result_cb_t, typename query_t>
 void local_prefilter(
     std::span<query_t const> const & records,
-    seqan3::interleaved_bloom_filter<ibf_data_layout> const & ibf,
+    ibf_t const & ibf,
+    prefilter_context<ibf_t> & context,
     search_arguments const & arguments,
     raptor::threshold::threshold const & thresholder,
     result_cb_t result_cb)
 {
-    // concurrent invocations of the membership agent are not thread safe
-    // agent has to be created for each thread
-    auto agent = ibf.membership_agent();
+    auto & agent = context.agent;
     size_t const bin_count = ibf.bin_count();
-
-    // vector holding all the minimisers and their starting position for the read
-    std::vector<std::tuple<uint64_t, size_t>> minimiser;
+    prefilter_workspace & workspace = context.workspace;
+    auto & [minimiser_values, window_span_begin, distinct_values, counting_table, counts, sequence_hits,
+            technical_hits, pending_ibfs] = workspace;
 
     auto minimiser_hash_adaptor = seqan3::views::minimiser_hash(
         arguments.shape,
@@ -173,73 +709,191 @@ void local_prefilter(
         if (record.size() < arguments.pattern_size)
             continue;
 
-        // basically: minimiser = seq | minimiser_hash_adaptor | seqan3::views::to<decltype(minimiser)>;
-        {
-            auto const minimiser_hash = [&]()
-                                        {
-                                            if constexpr (std::same_as<query_t, valik::query_record>)
-                                                return minimiser_hash_adaptor(record.sequence); 
-                                            else
-                                                return minimiser_hash_adaptor(record.querySegment);
-                                        }();
-            auto it = minimiser_hash.begin();
-            auto const sentinel = minimiser_hash.end();
-            auto const hash_begin = it.base();
-            for (; it != sentinel; ++it)
-                minimiser.emplace_back(*it, it.base() - hash_begin);
-        }
+        if constexpr (std::same_as<query_t, valik::query_record>)
+            workspace.set_minimisers(minimiser_hash_adaptor(record.sequence));
+        else
+            workspace.set_minimisers(minimiser_hash_adaptor(record.querySegment));
 
         //-----------------------------
         //
-        // Table of counting vectors newly created for each read
+        // Table of binning bit vectors filled for each read
         // rows: each minimiser of read
         // columns: each bin of IBF
         //
         //-----------------------------
-        using binning_bitvector_t = typename std::remove_cvref_t<decltype(ibf)>::membership_agent_type::binning_bitvector;
-        std::vector<binning_bitvector_t> counting_table(minimiser.size(),
-                                                        binning_bitvector_t(bin_count));
-
-        // the beginning of the first window this minimiser is in
-        std::vector<size_t> window_span_begin(minimiser.size(), 0);
+        fill_counting_table(agent, distinct_values, counting_table, bin_count);
 
-        for (size_t i{0}; i < minimiser.size(); i++)
-        {
-            const auto &[min, start_pos] = minimiser[i];
-            window_span_begin[i] = start_pos;
-            counting_table[i].raw_data() |= agent.bulk_contains(min).raw_data();
-        }
-
-        minimiser.clear();
-
-        std::unordered_set<size_t> sequence_hits{};
-        uint8_t threshold_correction{0};
+        counts.reset();
         auto find_bins_for_begin = [&](size_t const begin) -> bool
         {
             pattern_bounds const pattern = make_pattern_bounds(begin, arguments, window_span_begin, thresholder);
             //seqan3::debug_stream << "pattern.minimiser_count()\t" << pattern.minimiser_count() << '\n';
-            if ((pattern.threshold + threshold_correction) > pattern.minimiser_count())
+            if (pattern.threshold > pattern.minimiser_count())
                 return true;
             else
             {
-                find_pattern_bins(pattern, bin_count, counting_table, sequence_hits, threshold_correction);
+                find_pattern_bins(pattern, counting_table, counts);
                 return false;
             }
         };
 
         pattern_begin_positions(record.size(), arguments.pattern_size, arguments.query_every, find_bins_for_begin);
 
-        while (sequence_hits.size() > std::max<size_t>(1, std::round(bin_count * arguments.best_bin_cutoff)))
+        // Raise the threshold until few enough bins remain. A count never exceeds the minimiser count of its pattern,
+        // so bins with a margin of at least correction + 1 are exactly the bins that pass the corrected threshold.
+        // The correction stops growing once the threshold of the last pattern exceeds its minimiser count.
+        size_t const last_begin = (record.size() - arguments.pattern_size) / arguments.query_every * arguments.query_every;
+        pattern_bounds const last_pattern = make_pattern_bounds(last_begin, arguments, window_span_begin, thresholder);
+        size_t const max_hits = std::max<size_t>(1, std::round(bin_count * arguments.best_bin_cutoff));
+        size_t threshold_correction{0};
+        while (counts.count_bins_with_correction(threshold_correction) > max_hits)
+        {
+            threshold_correction++;
+            if (last_pattern.threshold + threshold_correction > last_pattern.minimiser_count())
+                break;
+        }
+
+        sequence_hits.clear();
+        counts.for_each_bin_with_correction(threshold_correction, [&](size_t const bin) { sequence_hits.insert(bin); });
+
+        result_cb(record, std::as_const(sequence_hits));
+    }
+}
+
+/**
+ * @brief Function that queries a hierarchical IBF for local matches in a batch of records.
+ *        Lower level IBFs are only queried for merged bins that contain a likely local match.
+ *
+ * @param records Query records.
+ * @param hibf Hierarchical Interleaved Bloom Filter of the reference database.
+ * @param context Agents and buffers of the calling thread, created for hibf.
+ * @param arguments Command line arguments.
+ * @param thresholder Threshold for the number of shared k-mers to constitute a likely local match.
+ * @param result_cb Lambda that inserts the prefiltering results (record-bin pairs) into the shopping carts.
+ */
+template <typename result_cb_t, typename query_t>
+void local_prefilter(
+    std::span<query_t const> const & records,
+    hierarchical_ibf const & hibf,
+    prefilter_context<hierarchical_ibf> & context,
+    search_arguments const & arguments,
+    raptor::threshold::threshold const & thresholder,
+    result_cb_t result_cb)
+{
+    auto & agents = context.agents;
+    prefilter_workspace & workspace = context.workspace;
+    auto & [minimiser_values, window_span_begin, distinct_values, counting_table, level_counts, sequence_hits,
+            technical_hits, pending_ibfs] = workspace;
+
+    auto minimiser_hash_adaptor = seqan3::views::minimiser_hash(
+        arguments.shape,
+        seqan3::window_size{arguments.window_size},
+        seqan3::seed{adjust_seed(arguments.shape_weight)});
+
+    for (query_t const & record : records)
+    {
+        if (record.size() < arguments.pattern_size)
+            continue;
+
+        if constexpr (std::same_as<query_t, valik::query_record>)
+            workspace.set_minimisers(minimiser_hash_adaptor(record.sequence));
+        else
+            workspace.set_minimisers(minimiser_hash_adaptor(record.querySegment));
+
+        sequence_hits.clear();
+        uint8_t threshold_correction{0};
+
+        // queries the IBFs of merged bins that contain a likely local match, starting at the top level
+        // returns true if the threshold of the last pattern exceeds its minimiser count in the top level
+        auto query_hierarchy = [&]() -> bool
+        {
+            bool max_threshold{false};
+            pending_ibfs.clear();
+            pending_ibfs.push_back(0u);
+            while (!pending_ibfs.empty())
+            {
+                size_t const ibf_idx = pending_ibfs.back();
+                pending_ibfs.pop_back();
+
+                auto const & user_bin_ids = hibf.ibf_bin_to_user_bin_id()[ibf_idx];
+                size_t const bin_count = user_bin_ids.size();
+                fill_counting_table(agents[ibf_idx], distinct_values, counting_table, bin_count);
+
+                // technical bins that pass the threshold; for split user bins the first technical bin
+                technical_hits.resize(bin_count);
+                level_counts.resize(bin_count);
+                auto find_bins_for_begin = [&](size_t const begin) -> bool
+                {
+                    pattern_bounds const pattern = make_pattern_bounds(begin, arguments, window_span_begin, thresholder);
+                    if ((pattern.threshold + threshold_correction) > pattern.minimiser_count())
+                        return true;
+
+                    std::span<uint8_t const> const total_counts = level_counts.slide_to(pattern, counting_table);
+
+                    // each k-mer of a split user bin is stored in one of its technical bins
+                    for (size_t bin{0}; bin < bin_count;)
+                    {
+                        size_t const first_bin = bin;
+                        size_t count = total_counts[bin++];
+                        if (user_bin_ids[first_bin] != hierarchical_ibf::merged_bin)
+                            for (; bin < bin_count && user_bin_ids[bin] == user_bin_ids[first_bin]; ++bin)
+                                count += total_counts[bin];
+
+                        if (count >= (pattern.threshold + threshold_correction))
+                            technical_hits.insert(first_bin);
+                    }
+                    return false;
+                };
+
+                bool const level_max_threshold = pattern_begin_positions(record.size(), arguments.pattern_size,
+                                                                         arguments.query_every, find_bins_for_begin);
+                if (ibf_idx == 0u)
+                    max_threshold = level_max_threshold;
+
+                technical_hits.for_each([&](size_t const bin)
+                {
+                    if (user_bin_ids[bin] == hierarchical_ibf::merged_bin)
+                        pending_ibfs.push_back(hibf.next_ibf_id()[ibf_idx][bin]);
+                    else
+                        sequence_hits.insert(user_bin_ids[bin]);
+                });
+            }
+            return max_threshold;
+        };
+
+        query_hierarchy();
+
+        while (sequence_hits.size() > std::max<size_t>(1, std::round(hibf.bin_count() * arguments.best_bin_cutoff)))
         {
             threshold_correction++;
             sequence_hits.clear();
-            bool max_threshold = pattern_begin_positions(record.size(), arguments.pattern_size, arguments.query_every, find_bins_for_begin);
-            if (max_threshold)
+            if (query_hierarchy())
                 break;
         }
 
-        result_cb(record, sequence_hits);
+        result_cb(record, std::as_const(sequence_hits));
     }
 }
 
+/**
+ * @brief Function that queries the IBF for local matches in a batch of records with a new agent and new buffers.
+ *
+ * @param records Query records.
+ * @param ibf Interleaved Bloom Filter or Hierarchical Interleaved Bloom Filter of the reference database.
+ * @param arguments Command line arguments.
+ * @param thresholder Threshold for the number of shared k-mers to constitute a likely local match.
+ * @param result_cb Lambda that inserts the prefiltering results (record-bin pairs) into the shopping carts.
+ */
+template <typename ibf_t, typename result_cb_t, typename query_t>
+void local_prefilter(
+    std::span<query_t const> const & records,
+    ibf_t const & ibf,
+    search_arguments const & arguments,
+    raptor::threshold::threshold const & thresholder,
+    result_cb_t result_cb)
+{
+    prefilter_context<ibf_t> context{ibf};
+    local_prefilter(records, ibf, context, arguments, thresholder, std::move(result_cb));
+}
+
 } // namespace valik
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <seqan3/search/kmer_index/shape.hpp>
+
+#include <valik/search/query_record.hpp>
+
+namespace valik
+{
+
+/**
+ * @brief Parameters of the search that wrote a prefilter hits file.
+ *
+ * The reference metadata and the bin paths are stored, so that the hits can be verified without the index.
+ */
+struct prefilter_hits_header
+{
+    static constexpr std::array<char, 8> magic_bytes{'V', 'A', 'L', 'I', 'K', 'H', 'I', 'T'};
+    static constexpr uint32_t current_version{1u};
+
+    uint32_t version{current_version};
+    uint64_t bin_count{};
+    bool split_query{false};
+    uint32_t window_size{};
+    seqan3::shape shape{};
+    std::string ref_meta_path{};
+    std::vector<std::string> bin_path{};
+
+    template <typename archive_t>
+    void serialize(archive_t & archive)
+    {
+        archive(version, bin_count, split_query, window_size, shape, ref_meta_path, bin_path);
+    }
+};
+
+/**
+ * @brief The bins that the prefilter found for a query record.
+ *
+ * A record is identified by the id of its query sequence and the interval [begin, begin + length) of the sequence.
+ */
+struct prefilter_hit_record
+{
+    std::string sequence_id{};
+    uint64_t begin{};
+    uint64_t length{};
+    std::vector<uint32_t> bins{};
+
+    template <typename archive_t>
+    void serialize(archive_t & archive)
+    {
+        archive(sequence_id, begin, length, bins);
+    }
+};
+
+//!\brief Position of the first base of a query record in its query sequence.
+template <typename query_t>
+uint64_t query_record_begin(query_t const & record)
+{
+    if constexpr (std::same_as<query_t, query_record>)
+        return 0u;
+    else
+        return seqan2::beginPosition(record.querySegment);
+}
+
+/**
+ * @brief Writes the results of the prefilter to a binary file. Records can be written from several threads.
+ *
+ * The file consists of prefilter_hits_header::magic_bytes followed by a cereal archive of the header and one block of
+ * records per batch of queries. A block is the number of its records followed by one archive per query record.
+ * The blocks are in the order of the query file, the records within a block are in the order they were found.
+ */
+class prefilter_hits_writer
+{
+private:
+    std::ofstream os;
+    cereal::BinaryOutputArchive archive;
+    std::vector<prefilter_hit_record> batch{};  // records of the current batch of queries
+    size_t record_count_{0};
+    std::mutex write_mutex;
+
+public:
+    prefilter_hits_writer() = delete;
+    prefilter_hits_writer(prefilter_hits_writer const &) = delete;
+    prefilter_hits_writer & operator=(prefilter_hits_writer const &) = delete;
+    prefilter_hits_writer(prefilter_hits_writer &&) = delete;
+    prefilter_hits_writer & operator=(prefilter_hits_writer &&) = delete;
+
+    ~prefilter_hits_writer()
+    {
+        finish_batch();
+    }
+
+    prefilter_hits_writer(std::filesystem::path const & path, prefilter_hits_header const & header) :
+        os{path, std::ios::binary},
+        archive{os}
+    {
+        if (!os)
+            throw std::runtime_error{"Could not write prefilter hits " + path.string()};
+
+        os.write(prefilter_hits_header::magic_bytes.data(), prefilter_hits_header::magic_bytes.size());
+        archive(header);
+    }
+
+    template <typename query_t>
+    void write(query_t const & record, std::vector<uint32_t> const & bins)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        batch.push_back(prefilter_hit_record{std::string{record.sequence_id},
+                                             query_record_begin(record),
+                                             static_cast<uint64_t>(record.size()),
+                                             bins});
+        ++record_count_;
+    }
+
+    //!\brief Writes the records of the current batch of queries as one block. Called after each batch.
+    void finish_batch()
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (batch.empty())
+            return;
+
+        archive(static_cast<uint64_t>(batch.size()));
+        for (prefilter_hit_record const & record : batch)
+            archive(record);
+        batch.clear();
+    }
+
+    size_t record_count() const noexcept
+    {
+        return record_count_;
+    }
+};
+
+/**
+ * @brief Reads a prefilter hits file one block at a time.
+ */
+class prefilter_hits_reader
+{
+private:
+    std::ifstream is;
+    cereal::BinaryInputArchive archive;
+    prefilter_hits_header header_{};
+    std::vector<prefilter_hit_record> block{};
+    // records of the current block that were not taken yet, grouped by query sequence id
+    std::unordered_map<std::string, std::vector<prefilter_hit_record>> pending{};
+
+    bool load_block()
+    {
+        if (!read_batch(block))
+            return false;
+
+        for (prefilter_hit_record & record : block)
+            pending[record.sequence_id].push_back(std::move(record));
+        return true;
+    }
+
+public:
+    prefilter_hits_reader(std::filesystem::path const & path) : is{path, std::ios::binary}, archive{is}
+    {
+        std::array<char, 8> magic{};
+        is.read(magic.data(), magic.size());
+        if (!is || magic != prefilter_hits_header::magic_bytes)
+            throw std::runtime_error{"Cannot read prefilter hits: " + path.string() + " is not a prefilter hits file."};
+
+        archive(header_);
+        if (header_.version != prefilter_hits_header::current_version)
+            throw std::runtime_error{"Unsupported prefilter hits version " + std::to_string(header_.version) + "."};
+    }
+
+    prefilter_hits_header const & header() const noexcept
+    {
+        return header_;
+    }
+
+    /**
+     * @brief Reads the records of the next batch of queries.
+     *
+     * @param records The records of the batch (OUT parameter).
+     * @return False if the end of the file was reached.
+     */
+    bool read_batch(std::vector<prefilter_hit_record> & records)
+    {
+        records.clear();
+        while (records.empty())
+        {
+            if (is.peek() == std::ifstream::traits_type::eof())
+                return false;
+
+            uint64_t record_count{};
+            archive(record_count);
+            records.resize(record_count);
+            for (prefilter_hit_record & record : records)
+            {
+                archive(record);
+                for (uint32_t const bin : record.bins)
+                    if (bin >= header_.bin_count)
+                        throw std::runtime_error{"Prefilter hits contain bin " + std::to_string(bin) + " of " +
+                                                 std::to_string(header_.bin_count) + " bins."};
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Moves the records of a query sequence into records.
+     *        The query sequences have to be visited in the order of the query file, so that only the block of the
+     *        current batch of queries is held in memory.
+     *
+     * @param sequence_id Id of the query sequence.
+     * @param records The records of the query sequence (OUT parameter).
+     */
+    void take_records(std::string const & sequence_id, std::vector<prefilter_hit_record> & records)
+    {
+        records.clear();
+        while (!pending.empty() || load_block())
+        {
+            auto it = pending.find(sequence_id);
+            if (it == pending.end())
+                return;
+
+            std::ranges::move(it->second, std::back_inserter(records));
+            pending.erase(it);
+            // the records of a query sequence that ends a batch continue in the next block
+            if (!pending.empty())
+                return;
+        }
+    }
+
+    //!\brief Whether all records were taken.
+    bool finished()
+    {
+        return pending.empty() && is.peek() == std::ifstream::traits_type::eof();
+    }
+};
+
+} // namespace valik
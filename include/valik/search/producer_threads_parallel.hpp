@@ -1,16 +1,23 @@
 #pragma once
 
+#include <cassert>
 #include <chrono>
+#include <numeric>
+#include <optional>
 #include <thread>
+#include <type_traits>
 
 #include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
 #include <seqan3/core/debug_stream.hpp>
 
 #include <valik/shared.hpp>
 #include <valik/search/local_prefilter.hpp>
+#include <valik/search/prefilter_hits.hpp>
 #include <valik/search/query_record.hpp>
+#include <valik/search/query_registry.hpp>
 #include <valik/search/sync_out.hpp>
 #include <utilities/cart_queue.hpp>
+#include <utilities/work_stealing_pool.hpp>
 #include <utilities/threshold/basics.hpp>
 
 #include <raptor/threshold/threshold.hpp>
@@ -18,15 +25,74 @@
 namespace valik::app
 {
 
+//!\brief Number of tasks per producer thread. More tasks let idle workers steal from slow ones.
+inline constexpr size_t producer_tasks_per_thread{16};
+
+/**
+ * @brief Function that splits the records into ranges of roughly equal total sequence length.
+ *
+ * @param records Query records.
+ * @param task_count Desired number of ranges.
+ */
+template <typename query_t>
+inline std::vector<std::span<query_t const>> balanced_record_ranges(std::vector<query_t> const & records,
+                                                                     size_t const task_count)
+{
+    std::vector<std::span<query_t const>> slices{};
+    for (auto const & [begin, end] : balanced_ranges(records.size(), task_count, [&records](size_t const i)
+                                                     {
+                                                         return records[i].size() + 1u;
+                                                     }))
+        slices.emplace_back(records.data() + begin, end - begin);
+    return slices;
+}
+
+/**
+ * @brief Agents and buffers of local_prefilter, one per worker of the producer pool.
+ *        A worker creates its context on its first task and reuses it for all later tasks and batches of queries.
+ */
+template <typename index_t>
+class producer_contexts
+{
+    using ibf_t = std::remove_cvref_t<decltype(std::declval<index_t const &>().ibf())>;
+
+    index_t const & index;
+    std::vector<std::optional<prefilter_context<ibf_t>>> contexts;
+
+public:
+    producer_contexts(index_t const & index, work_stealing_pool const & pool) :
+        index{index},
+        contexts(pool.thread_count())
+    {}
+
+    //!\brief Returns the context of the worker that runs the calling task.
+    prefilter_context<ibf_t> & local()
+    {
+        size_t const worker = work_stealing_pool::worker_id();
+        assert(worker < contexts.size());
+        auto & context = contexts[worker];
+        if (!context)
+            context.emplace(index.ibf());
+        return *context;
+    }
+};
+
 /**
  * @brief Create parallel prefiltering jobs.
+ *
+ * The records are split into ranges of equal total sequence length that are prefiltered on the producer pool.
+ * The bins of each record are inserted into the shopping cart queue or, with --prefilter-only, written to the
+ * prefilter hits file. Returns when all records have been prefiltered.
+ * Each worker prefilters with its context from contexts.
 */
-template <typename query_t, typename index_t>
+template <typename query_t, typename index_t, typename sink_t>
 inline void prefilter_queries_parallel(index_t const & index,
                                        search_arguments const & arguments,
                                        std::vector<query_t> const & records,
                                        raptor::threshold::threshold const & thresholder,
-                                       cart_queue<query_t> & queue)
+                                       sink_t & queue,
+                                       work_stealing_pool & pool,
+                                       producer_contexts<index_t> & contexts)
 {
     if (records.empty())
         return;
@@ -34,113 +100,128 @@ inline void prefilter_queries_parallel(index_t const & index,
     // Must be before tasks. sync_out's mutex must outlive tasks.
     sync_out verbose_out(arguments.disabledQueriesFile);
 
-    std::vector<std::jthread> tasks;
-    size_t const num_records = records.size();
-    size_t const records_per_thread = num_records / arguments.threads;
-
-    for (size_t i = 0; i < arguments.threads; ++i)
+    // calls insert_bin for each bin that the record is searched in
+    auto select_bins = [&arguments,&verbose_out,&index](query_t const & record, 
+                                                        valik::bin_hits const & bin_hits,
+                                                        auto && insert_bin)
     {
-        size_t const start = records_per_thread * i;
-        size_t const extent = (i + 1u == arguments.threads) ? num_records - i * records_per_thread : records_per_thread;
+        auto & ibf = index.ibf();
+        auto max_bin_hits = std::max((size_t) 1, (size_t) std::round(ibf.bin_count() * arguments.best_bin_entropy_cutoff));
 
-        std::span<query_t const> records_slice{records.data() + start, extent};
-
-        auto prefilter_cb = [&queue,&arguments,&verbose_out,&index](query_t const & record, 
-                                                                    std::unordered_set<size_t> const & bin_hits)
+        if (bin_hits.size() > max_bin_hits)
         {
-            auto & ibf = index.ibf();
-            auto max_bin_hits = std::max((size_t) 1, (size_t) std::round(ibf.bin_count() * arguments.best_bin_entropy_cutoff));
-
-            if (bin_hits.size() > max_bin_hits)
+            if (arguments.verbose)
+                verbose_out.write_warning(record, bin_hits.size());
+            if (arguments.best_bin_entropy_cutoff == 0)
             {
-                if (arguments.verbose)
-                    verbose_out.write_warning(record, bin_hits.size());
-                if (arguments.best_bin_entropy_cutoff == 0)
-                {
-                    return;
-                }
-                else if (arguments.best_bin_entropy_cutoff < 1.0)    // keep hits for bins with the highest entropy
+                return;
+            }
+            else if (arguments.best_bin_entropy_cutoff < 1.0)    // keep hits for bins with the highest entropy
+            {
+                auto const & entropy_ranking = index.entropy_ranking();
+                size_t inserted_bins{0};
+                size_t i{0};
+                while (inserted_bins < max_bin_hits)
                 {
-                    auto const & entropy_ranking = index.entropy_ranking();
-                    size_t inserted_bins{0};
-                    size_t i{0};
-                    while (inserted_bins < max_bin_hits)
+                    size_t bin = entropy_ranking[i];
+                    if (bin_hits.contains(bin))
                     {
-                        size_t bin = entropy_ranking[i];
-                        if (bin_hits.count(bin) > 0)
-                        {
-                            queue.insert(bin, record);
-                            inserted_bins++;
-                        }
-                        i++;
+                        insert_bin(bin);
+                        inserted_bins++;
                     }
+                    i++;
                 }
-
-                return;
             }
-            
-            for (auto const bin : bin_hits)
-            {
-                queue.insert(bin, record);
-            }
-        };
 
-        // The following calls `local_prefilter(records, ibf, arguments, threshold)` on a thread.
-        tasks.emplace_back([=, &index, &arguments, &thresholder]()
+            return;
+        }
+        
+        bin_hits.for_each([&](size_t const bin)
         {
-            local_prefilter(records_slice, index.ibf(), arguments, thresholder, prefilter_cb);
+            insert_bin(bin);
+        });
+    };
+
+    auto prefilter_cb = [&queue,&select_bins](query_t const & record, valik::bin_hits const & bin_hits)
+    {
+        if constexpr (std::same_as<sink_t, prefilter_hits_writer>)
+        {
+            std::vector<uint32_t> bins{};
+            select_bins(record, bin_hits, [&](size_t const bin) { bins.push_back(bin); });
+            if (!bins.empty())
+                queue.write(record, bins);
+        }
+        else
+        {
+            // the bins are collected first, so that a shared record takes the references for all carts at once
+            thread_local std::vector<size_t> bins{};
+            bins.clear();
+            select_bins(record, bin_hits, [&](size_t const bin) { bins.push_back(bin); });
+            insert_into_carts(queue, record, bins);
+        }
+    };
+
+    std::vector<work_stealing_pool::task_t> tasks;
+    for (auto const records_slice : balanced_record_ranges(records, pool.thread_count() * producer_tasks_per_thread))
+    {
+        // The following calls `local_prefilter(records, ibf, context, arguments, threshold)` on a pool thread.
+        tasks.emplace_back([=, &index, &arguments, &thresholder, &prefilter_cb, &contexts]()
+        {
+            local_prefilter(records_slice, index.ibf(), contexts.local(), arguments, thresholder, prefilter_cb);
         });
     }
+    pool.run(std::move(tasks));
+
+    // the hits of a batch are written as one block, so that the blocks are in the order of the query file
+    if constexpr (std::same_as<sink_t, prefilter_hits_writer>)
+        queue.finish_batch();
 }
 
 /**
  * @brief Fill the shopping cart queue with all matches. Search each query record in each reference bin without prefiltering.
 */
-template <typename query_t>
+template <typename query_t, typename cart_queue_t>
 inline void search_all_parallel(size_t const ref_seg_count,
-                                search_arguments const & arguments,
                                 std::vector<query_t> const & records,
-                                cart_queue<query_t> & queue)
+                                cart_queue_t & queue,
+                                work_stealing_pool & pool)
 {
     if (records.empty())
         return;
 
-    std::vector<std::jthread> tasks;
-    size_t const num_records = records.size();
-    size_t const records_per_thread = num_records / arguments.threads;
-
-    for (size_t i = 0; i < arguments.threads; ++i)
+    std::vector<size_t> all_bins(ref_seg_count);
+    std::iota(all_bins.begin(), all_bins.end(), size_t{0});
+    auto all_cb = [&all_bins,&queue](query_t const& record)
     {
-        size_t const start = records_per_thread * i;
-        size_t const extent = (i + 1u == arguments.threads) ? num_records - i * records_per_thread : records_per_thread;
-
-        std::span<query_t const> records_slice{records.data() + start, extent};
-
-        auto all_cb = [=,&queue](query_t const& record)
-        {
-            for (size_t bin{0}; bin < ref_seg_count; bin++)
-            {
-                queue.insert(bin, record);
-            }
-        };
-
-        tasks.emplace_back([=]()
+        insert_into_carts(queue, record, all_bins);
+    };
+
+    // each record is inserted into every bin, i.e. the work does not depend on the sequence length
+    std::vector<work_stealing_pool::task_t> tasks;
+    for (auto const & [begin, end] : balanced_ranges(records.size(),
+                                                     pool.thread_count() * producer_tasks_per_thread,
+                                                     [] (size_t const) { return 1u; }))
+    {
+        std::span<query_t const> records_slice{records.data() + begin, end - begin};
+        tasks.emplace_back([=, &all_cb]()
         {
             for (query_t const & record : records_slice)
                 all_cb(record);
         });
     }
+    pool.run(std::move(tasks));
 }
 
 /**
  * @brief Create a queue of bin indices to send for distributed search. Search each query record in each reference bin without prefiltering.
  *        Query I/O from disk in external process. 
 */
-template <typename query_t>
+template <typename cart_queue_t>
 inline void fill_queue_with_bin_ids(size_t const ref_seg_count,
                                     search_arguments const & arguments,
-                                    cart_queue<query_t> & queue)
+                                    cart_queue_t & queue)
 {
+    using query_t = typename cart_queue_t::cart::value_type;
     std::vector<std::jthread> tasks;
     size_t const bins_per_thread = ref_seg_count / arguments.threads;
 
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 
@@ -27,34 +29,45 @@ struct query_record
     }
 };
 
+//!\brief Identifies a query sequence in a query_registry.
+using query_handle = uint32_t;
+
 /**
- * @brief Query sequence resources are shared between records.
+ * @brief The interval [begin, begin + length) of a query sequence in a query_registry.
  *
+ * Carts store query references instead of records, i.e. inserting a query into many carts copies 12 bytes per cart.
  */
-template <typename TSequence>
-struct shared_query_record
+struct query_ref
 {
-    std::string sequence_id;
-    seqan2::Segment<TSequence const, seqan2::InfixSegment> querySegment;
-    std::shared_ptr<TSequence> underlyingData;
+    query_handle handle{};
+    uint32_t begin{};
+    uint32_t length{};
 
-    shared_query_record(TSequence && seq, std::string && id) : sequence_id(std::move(id))
+    size_t size() const
     {
-        // make_shared returns a newly allocated object
-        underlyingData = std::make_shared<TSequence>(std::move(seq));
-        querySegment = seqan2::infix(*underlyingData, 0, seqan2::length(*underlyingData));
+        return length;
     }
+};
 
-    shared_query_record(std::string const & id, metadata::segment_stats const & seg, std::shared_ptr<TSequence> const & query_ptr) : sequence_id(id)
-    {
-        seqan2::Segment<TSequence const, seqan2::InfixSegment> inf = seqan2::infixWithLength(*query_ptr, seg.start, seg.len);
-        querySegment = inf;
-        underlyingData = query_ptr;
-    }
+template <typename TSequence>
+class query_registry;
+
+/**
+ * @brief A query record whose sequence and ID are owned by a query_registry.
+ *
+ * The record holds a reference to its query sequence, so that the sequence is kept while the record is prefiltered.
+ */
+template <typename TSequence>
+struct shared_query_record
+{
+    std::string_view sequence_id;
+    seqan2::Segment<TSequence const, seqan2::InfixSegment> querySegment;
+    query_ref ref;
+    query_registry<TSequence> * registry;
 
     size_t size() const
     {
-        return seqan2::length(querySegment);
+        return ref.size();
     }
 };
 
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <valik/search/query_record.hpp>
+
+#include <seqan/sequence.h>
+
+namespace valik
+{
+
+/**
+ * @brief Owns the query sequences and IDs of a search. Carts refer to them by a 32 bit query_handle.
+ *
+ * Each query sequence counts the references to it, i.e. records that are prefiltered and entries of carts.
+ * A sequence and its ID are freed when the last reference is released. References are taken once per record and
+ * once per cart entry, instead of copying the ID and a shared pointer into each cart.
+ *
+ * Sequences are added by a single reader thread. Adding sequences, taking and releasing references and resolving
+ * handles can happen concurrently. A handle is resolved only while a reference to it is held.
+ */
+template <typename TSequence>
+class query_registry
+{
+public:
+    using segment_type = seqan2::Segment<TSequence const, seqan2::InfixSegment>;
+
+private:
+    struct entry
+    {
+        std::string id{};
+        TSequence sequence{};
+        std::atomic<uint32_t> references{0};
+    };
+
+    // entries are allocated in chunks that never move, so that adding a sequence does not move the other ones
+    static constexpr size_t chunk_bits{14};
+    static constexpr size_t chunk_size{1ULL << chunk_bits};
+    static constexpr size_t chunk_count{(1ULL << 32) / chunk_size};
+
+    std::vector<std::unique_ptr<entry[]>> chunks;
+    uint64_t size_{0};
+
+    entry & at(query_handle const handle) const
+    {
+        return chunks[handle >> chunk_bits][handle & (chunk_size - 1)];
+    }
+
+public:
+    query_registry() : chunks(chunk_count)
+    {}
+
+    query_registry(query_registry const &) = delete;
+    query_registry & operator=(query_registry const &) = delete;
+    query_registry(query_registry &&) = delete;
+    query_registry & operator=(query_registry &&) = delete;
+    ~query_registry() = default;
+
+    //!\brief Number of query sequences that were added.
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    /**
+     * @brief Function that takes ownership of a query sequence and its ID. Not thread safe with itself.
+     *        The caller holds a reference to the sequence and releases it after it has created the records of the sequence.
+     */
+    query_handle add(std::string id, TSequence sequence)
+    {
+        if (size_ == chunk_count * chunk_size)
+            throw std::runtime_error{"Too many query sequences. At most " + std::to_string(chunk_count * chunk_size) +
+                                     " query sequences are supported."};
+        if (seqan2::length(sequence) > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error{"Query sequence " + id + " is too long. Query sequences can be at most " +
+                                     std::to_string(std::numeric_limits<uint32_t>::max()) + " bp long."};
+
+        query_handle const handle = static_cast<query_handle>(size_++);
+        auto & chunk = chunks[handle >> chunk_bits];
+        if (!chunk)
+            chunk = std::make_unique<entry[]>(chunk_size);
+
+        entry & e = at(handle);
+        e.id = std::move(id);
+        e.sequence = std::move(sequence);
+        e.references.store(1u, std::memory_order_relaxed);
+        return handle;
+    }
+
+    //!\brief Creates a record of the interval [begin, begin + length) of a query sequence and takes a reference for it.
+    shared_query_record<TSequence> record(query_handle const handle, uint64_t const begin, uint64_t const length)
+    {
+        entry & e = at(handle);
+        if (begin + length > seqan2::length(e.sequence))
+            throw std::runtime_error{"Interval [" + std::to_string(begin) + ", " + std::to_string(begin + length) +
+                                     ") is out of range for query " + e.id + "."};
+        retain(handle);
+        return shared_query_record<TSequence>{e.id,
+                                              seqan2::infixWithLength(e.sequence, begin, length),
+                                              query_ref{handle, static_cast<uint32_t>(begin), static_cast<uint32_t>(length)},
+                                              this};
+    }
+
+    //!\brief Creates a record of a whole query sequence and takes a reference for it.
+    shared_query_record<TSequence> record(query_handle const handle)
+    {
+        return record(handle, 0u, seqan2::length(at(handle).sequence));
+    }
+
+    void retain(query_handle const handle, size_t const count = 1u)
+    {
+        at(handle).references.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    //!\brief Releases references to a query sequence. The sequence is freed when the last reference is released.
+    void release(query_handle const handle, size_t const count = 1u)
+    {
+        entry & e = at(handle);
+        if (e.references.fetch_sub(count, std::memory_order_acq_rel) == count)
+        {
+            e.id = std::string{};
+            e.sequence = TSequence{};
+        }
+    }
+
+    //!\brief Releases the references of the entries of a cart.
+    void release(std::span<query_ref const> const refs)
+    {
+        // carts often hold consecutive segments of the same query
+        for (size_t i{0}; i < refs.size();)
+        {
+            size_t j{i + 1};
+            while (j < refs.size() && refs[j].handle == refs[i].handle)
+                ++j;
+            release(refs[i].handle, j - i);
+            i = j;
+        }
+    }
+
+    //!\brief Releases the references of records, e.g. of a batch that has been prefiltered.
+    void release(std::span<shared_query_record<TSequence> const> const records)
+    {
+        for (auto const & record : records)
+            release(record.ref.handle);
+    }
+
+    std::string const & id(query_handle const handle) const
+    {
+        return at(handle).id;
+    }
+
+    segment_type segment(query_ref const & ref) const
+    {
+        return seqan2::infixWithLength(at(ref.handle).sequence, ref.begin, ref.length);
+    }
+};
+
+/**
+ * @brief Function that inserts a record into the carts of the given bins.
+ *        A record that owns its sequence is copied into each cart.
+ */
+template <typename cart_queue_t>
+void insert_into_carts(cart_queue_t & queue, query_record const & record, std::span<size_t const> const bins)
+{
+    for (size_t const bin : bins)
+        queue.insert(bin, record);
+}
+
+/**
+ * @brief Function that inserts a reference to a record into the carts of the given bins.
+ *        The references are taken before the first insert, because a consumer can release a reference right away.
+ */
+template <typename cart_queue_t, typename TSequence>
+void insert_into_carts(cart_queue_t & queue, shared_query_record<TSequence> const & record, std::span<size_t const> const bins)
+{
+    if (bins.empty())
+        return;
+    record.registry->retain(record.ref.handle, bins.size());
+    for (size_t const bin : bins)
+        queue.insert(bin, record.ref);
+}
+
+} // namespace valik
@@ -6,6 +6,7 @@
 #include <valik/search/query_record.hpp>
 #include <valik/search/search_distributed.hpp>
 #include <valik/search/search_local.hpp>
+#include <valik/search/search_prefilter_only.hpp>
 #include <valik/search/search_time_statistics.hpp>
 #include <valik/shared.hpp>
 
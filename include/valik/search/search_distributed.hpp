@@ -14,14 +14,14 @@ namespace valik::app
 /**
  * @brief Function that calls Valik prefiltering and launches parallel processes of Stellar search.
  *
+ * @tparam index_structure_t Type of the IBF, one of valik::index_structure.
  * @param arguments Command line arguments.
  * @param time_statistics Run-time statistics.
  * @return false if search failed.
  */
-template <bool stellar_only>
+template <typename index_structure_t, bool stellar_only>
 bool search_distributed(search_arguments & arguments, search_time_statistics & time_statistics)
 {   
-    using index_structure_t = index_structure::ibf;
     auto index = valik_index<index_structure_t>{};
 
     std::optional<metadata> ref_meta;
@@ -39,10 +39,17 @@ bool search_distributed(search_arguments & arguments, search_time_statistics & t
             arguments.max_queued_carts = bin_count;
         arguments.cart_max_capacity = 1;
     }
+    else if (arguments.verify_prefilter_hits())
+    {
+        // verifying the prefilter hits of an earlier search does not need the index
+        bin_count = prefilter_hits_reader{arguments.prefilter_hits_file}.header().bin_count;
+        if (arguments.max_queued_carts == std::numeric_limits<uint32_t>::max()) // if no user input
+            arguments.max_queued_carts = bin_count;
+    }
     else
     {
         auto start = std::chrono::high_resolution_clock::now();
-        load_index(index, arguments.index_file);
+        load_index(index, arguments);
         auto end = std::chrono::high_resolution_clock::now();
         time_statistics.index_io_time += std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
 
@@ -52,7 +59,24 @@ bool search_distributed(search_arguments & arguments, search_time_statistics & t
     }
 
     env_var_pack var_pack{};
-    auto queue = cart_queue<query_record>{bin_count, arguments.cart_max_capacity, arguments.max_queued_carts};
+    // the Stellar search of a cart takes roughly the length of its queries times the length of the reference bin
+    auto cart_cost = [&ref_meta](size_t const bin_id, std::vector<query_record> const & records)
+    {
+        size_t query_length{0};
+        for (auto const & record : records)
+            query_length += std::max<size_t>(record.size(), 1u);
+        size_t const bin_length = (ref_meta && bin_id < ref_meta->segments.size()) ? ref_meta->segments[bin_id].len : 1u;
+        return static_cast<double>(query_length) * static_cast<double>(bin_length);
+    };
+    search_cart_queue<query_record> queue{arguments.lock_free_queue,
+                                          bin_count,
+                                          arguments.cart_max_capacity,
+                                          arguments.max_queued_carts,
+                                          cart_cost,
+                                          arguments.threads};
+    // a cart of stellar_only holds a whole bin, i.e. its capacity cannot adapt
+    if (arguments.cart_duration > 0.0 && !stellar_only)
+        queue.adapt_cart_capacity(arguments.cart_duration, 1u, arguments.cart_max_capacity * search_arguments::max_cart_growth);
 
     std::mutex mutex;
     execution_metadata exec_meta(arguments.threads);
@@ -135,6 +159,7 @@ bool search_distributed(search_arguments & arguments, search_time_statistics & t
                 auto end = std::chrono::high_resolution_clock::now();
 
                 thread_meta.time_statistics.emplace_back(0.0 + std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count());
+                queue.report_cart_duration(bin_id, records.size(), thread_meta.time_statistics.back());
 
                 thread_meta.text_out << process.cout();
                 thread_meta.text_out << process.cerr();
@@ -161,8 +186,16 @@ bool search_distributed(search_arguments & arguments, search_time_statistics & t
     }
     else
     {
-        raptor::threshold::threshold const thresholder{arguments.make_threshold_parameters()};
-        iterate_distributed_queries(arguments, index, thresholder, queue);
+        if (arguments.verify_prefilter_hits())
+        {
+            iterate_distributed_prefilter_hits(arguments, queue, bin_count);
+        }
+        else
+        {
+            raptor::threshold::threshold const thresholder = index.thresholds().make_threshold(arguments.make_threshold_parameters());
+            work_stealing_pool producer_pool{arguments.threads};
+            iterate_distributed_queries(arguments, index, thresholder, queue, producer_pool);
+        }
 
     }
     queue.finish(); // Flush carts that are not empty yet
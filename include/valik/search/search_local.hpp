@@ -2,6 +2,9 @@
 
 #include "future"
 
+#include <optional>
+#include <sstream>
+
 #include <valik/search/cart_query_io.hpp>
 #include <valik/search/iterate_queries.hpp>
 #include <valik/search/load_index.hpp>
@@ -54,24 +57,77 @@ static inline dream_stellar::StellarOptions make_thread_options(search_arguments
     return threadOptions;
 }
 
+/**
+ * @brief Stellar state of a reference bin that a consumer thread derives once and reuses for consecutive carts of the bin.
+ *
+ * The state consists of the options and the logged parameters of the bin, the database segments of both strands and
+ * a SWIFT finder for each strand. A finder is copied for each cart, so that the low complexity repeats of the segment
+ * are found only once.
+ */
+template <typename TAlphabet>
+struct bin_stellar_state
+{
+    using TDatabaseSegment = dream_stellar::StellarDatabaseSegment<TAlphabet>;
+    using TFinder = dream_stellar::StellarSwiftFinder<TAlphabet>;
+
+    size_t bin_id;
+    dream_stellar::StellarOptions options;  // the output file is set for each cart
+    std::string parameter_log;              // user specified and calculated parameters
+    TDatabaseSegment forward_segment{};
+    TDatabaseSegment reverse_segment{};
+    std::optional<TFinder> forward_finder{};
+    std::optional<TFinder> reverse_finder{};
+
+    template <typename TSize>
+    bin_stellar_state(search_arguments const & arguments,
+                      metadata const & ref_meta,
+                      TSize const refLen,
+                      size_t const bin_id_,
+                      seqan2::StringSet<seqan2::String<TAlphabet>> const & databases,
+                      seqan2::StringSet<seqan2::String<TAlphabet>> const & reverseDatabases,
+                      bool const reverse) :
+        bin_id{bin_id_},
+        options{make_thread_options(arguments, ref_meta, std::filesystem::path{}, refLen, bin_id_)}
+    {
+        std::stringstream log{};
+        dream_stellar::_writeSpecifiedParams(options, log);
+        dream_stellar::_writeCalculatedParams(options, log);   // calculate qGram
+        parameter_log = log.str();
+
+        if (options.forward)
+        {
+            forward_segment = dream_stellar::_getDREAMDatabaseSegment<TAlphabet, TDatabaseSegment>
+                                (databases[options.binSequences[0]], options);
+            forward_finder.emplace(forward_segment.asInfixSegment(), options.minRepeatLength, options.maxRepeatPeriod);
+        }
+        if (reverse)
+        {
+            reverse_segment = dream_stellar::_getDREAMDatabaseSegment<TAlphabet, TDatabaseSegment>
+                                (reverseDatabases[options.binSequences[0]], options, reverse);
+            reverse_finder.emplace(reverse_segment.asInfixSegment(), options.minRepeatLength, options.maxRepeatPeriod);
+        }
+    }
+};
+
 /**
  * @brief Function that calls Valik prefiltering and launches parallel threads of Stellar search.
  *
+ * @tparam index_structure_t Type of the IBF, one of valik::index_structure.
  * @tparam is_split Split query sequences.
  * @param arguments Command line arguments.
  * @param time_statistics Run-time statistics.
  * @return false if search failed.
  */
-template <bool is_split, bool stellar_only>
+template <typename index_structure_t, bool is_split, bool stellar_only>
 bool search_local(search_arguments & arguments, search_time_statistics & time_statistics)
 {
-    using index_structure_t = index_structure::ibf;
     auto index = valik_index<index_structure_t>{};
 
-    if (!stellar_only)
+    // verifying the prefilter hits of an earlier search does not need the index
+    if (!stellar_only && !arguments.verify_prefilter_hits())
     {
         auto start = std::chrono::high_resolution_clock::now();
-        load_index(index, arguments.index_file);
+        load_index(index, arguments);
         auto end = std::chrono::high_resolution_clock::now();
         time_statistics.index_io_time += std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();        
     }
@@ -105,7 +161,7 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
 
     env_var_pack var_pack{};
     std::optional<metadata> query_meta;
-    if (arguments.split_query && !stellar_only)
+    if (arguments.split_query && !stellar_only && !arguments.verify_prefilter_hits())
     {
         
         query_meta = metadata(arguments);
@@ -155,8 +211,26 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
 
     using TAlphabet = seqan2::Dna;
     using TSequence = seqan2::String<TAlphabet>;
+    // owns the query sequences, carts refer to them by handle
+    query_registry<TSequence> registry{};
     // the queue hands records over from the producer threads (valik prefiltering) to the consumer threads (stellar search) 
-    auto queue = cart_queue<shared_query_record<TSequence>>{ref_meta.seg_count, arguments.cart_max_capacity, arguments.max_queued_carts};
+    // the Stellar search of a cart takes roughly the length of its queries times the length of the reference segment
+    auto cart_cost = [&ref_meta](size_t const bin_id, std::vector<query_ref> const & records)
+    {
+        size_t query_length{0};
+        for (auto const & record : records)
+            query_length += std::max<size_t>(record.size(), 1u);
+        size_t const segment_length = bin_id < ref_meta.segments.size() ? ref_meta.segments[bin_id].len : 1u;
+        return static_cast<double>(query_length) * static_cast<double>(segment_length);
+    };
+    search_cart_queue<query_ref> queue{arguments.lock_free_queue,
+                                       ref_meta.seg_count,
+                                       arguments.cart_max_capacity,
+                                       arguments.max_queued_carts,
+                                       cart_cost,
+                                       arguments.threads};
+    if (arguments.cart_duration > 0.0)
+        queue.adapt_cart_capacity(arguments.cart_duration, 1u, arguments.cart_max_capacity * search_arguments::max_cart_growth);
 
     std::mutex mutex;
     execution_metadata exec_meta(arguments.threads);
@@ -211,25 +285,35 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
         consumerThreads.emplace_back(
         [&, threadNbr]() {
             auto& thread_meta = exec_meta.table[threadNbr];
+            // the thread prefers carts of the bin it processed last and reuses the Stellar state of the bin
+            std::optional<bin_stellar_state<TAlphabet>> bin_state{};
+            size_t preferred_bin = std::numeric_limits<size_t>::max();
             // this will block until producer threads have added carts to queue
-            for (auto next = queue.dequeue(); next; next = queue.dequeue())
+            for (auto next = queue.dequeue(preferred_bin); next; next = queue.dequeue(preferred_bin))
             {
                 auto & [bin_id, records] = *next;
+                preferred_bin = bin_id;
                 std::unique_lock g(mutex);
                 std::filesystem::path cart_queries_path = var_pack.tmp_path / std::string("query_" + std::to_string(bin_id) +
                                                           "_" + std::to_string(exec_meta.bin_count[bin_id]++) + ".fasta");
                 g.unlock();
 
+                auto const cart_start = std::chrono::high_resolution_clock::now();
                 dream_stellar::stellar_app_runtime stellarThreadTime{};
                 auto current_time = stellarThreadTime.now();
-                dream_stellar::StellarOptions threadOptions = make_thread_options(arguments, ref_meta, cart_queries_path, refLen, bin_id);
+                if (!bin_state || bin_state->bin_id != static_cast<size_t>(bin_id))
+                {
+                    bin_state.reset();
+                    bin_state.emplace(arguments, ref_meta, refLen, bin_id, databases, reverseDatabases, reverse);
+                }
+                dream_stellar::StellarOptions threadOptions = bin_state->options;
+                threadOptions.outputFile = cart_queries_path.string() + ".gff";
 
                 using TDatabaseSegment = dream_stellar::StellarDatabaseSegment<TAlphabet>;
                 using TQuerySegment = seqan2::Segment<seqan2::String<TAlphabet> const, seqan2::InfixSegment>;
 
                 dream_stellar::_writeFileNames(threadOptions, thread_meta.text_out);
-                dream_stellar::_writeSpecifiedParams(threadOptions, thread_meta.text_out);
-                dream_stellar::_writeCalculatedParams(threadOptions, thread_meta.text_out);   // calculate qGram
+                thread_meta.text_out << bin_state->parameter_log;
                 thread_meta.text_out << std::endl;
 
                 // import query sequences
@@ -238,7 +322,7 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
                 
                 stellarThreadTime.input_queries_time.measure_time([&]()
                 {
-                    get_cart_queries(records, queries, queryIDs, thread_meta.text_out, thread_meta.text_out);
+                    get_cart_queries(records, registry, queries, queryIDs, thread_meta.text_out, thread_meta.text_out);
                 });
 
                 dream_stellar::_writeMoreCalculatedParams(threadOptions, threadOptions.referenceLength, queries, thread_meta.text_out);
@@ -259,8 +343,7 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
                 bool threadFoundMatches{false};
                 if (threadOptions.forward)
                 {
-                    auto databaseSegment = dream_stellar::_getDREAMDatabaseSegment<TAlphabet, TDatabaseSegment>
-                                            (databases[threadOptions.binSequences[0]], threadOptions);
+                    TDatabaseSegment const & databaseSegment = bin_state->forward_segment;
                     stellarThreadTime.forward_strand_stellar_time.measure_time([&]()
                     {
                         size_t const databaseRecordID = databaseIDMap.recordID(databaseSegment);
@@ -271,13 +354,14 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
                         seqan2::resize(forwardMatches, length(queries));
 
                         constexpr bool databaseStrand = true;
+                        typename bin_stellar_state<TAlphabet>::TFinder swiftFinder{*bin_state->forward_finder};
                         dream_stellar::StellarComputeStatistics statistics = dream_stellar::StellarLauncher<TAlphabet>::search_and_verify
                         (
-                            databaseSegment,
                             databaseID,
                             databaseStrand,
                             threadOptions,
                             swiftPattern,
+                            swiftFinder,
                             stellarThreadTime.forward_strand_stellar_time.prefiltered_stellar_time,
                             forwardMatches
                         );
@@ -319,8 +403,7 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
                     TDatabaseSegment databaseSegment{};
                     stellarThreadTime.reverse_complement_database_time.measure_time([&]()
                     {
-                        databaseSegment = _getDREAMDatabaseSegment<TAlphabet, TDatabaseSegment>
-                                            (reverseDatabases[threadOptions.binSequences[0]], threadOptions, reverse);
+                        databaseSegment = bin_state->reverse_segment;
                     }); // measure_time
 
                     stellarThreadTime.reverse_strand_stellar_time.measure_time([&]()
@@ -333,13 +416,14 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
                         seqan2::resize(reverseMatches, length(queries));
 
                         constexpr bool databaseStrand = false;
+                        typename bin_stellar_state<TAlphabet>::TFinder swiftFinder{*bin_state->reverse_finder};
                         dream_stellar::StellarComputeStatistics statistics = dream_stellar::StellarLauncher<TAlphabet>::search_and_verify
                         (
-                            databaseSegment,
                             databaseID,
                             databaseStrand,
                             threadOptions,
                             swiftPattern,
+                            swiftFinder,
                             stellarThreadTime.reverse_strand_stellar_time.prefiltered_stellar_time,
                             reverseMatches
                         );
@@ -390,7 +474,10 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
 
                 dream_stellar::_writeOutputStatistics(outputStatistics, threadOptions.verbose, disabledQueriesFile.is_open(), thread_meta.text_out);
 
-                thread_meta.time_statistics.emplace_back(stellarThreadTime.milliseconds() / 1000);
+                auto const cart_end = std::chrono::high_resolution_clock::now();
+                thread_meta.time_statistics.emplace_back(std::chrono::duration_cast<std::chrono::duration<double>>(cart_end - cart_start).count());
+                queue.report_cart_duration(bin_id, records.size(), thread_meta.time_statistics.back());
+                registry.release(records);
                 if (arguments.write_time)
                 {
                     stellarThreadTime.manual_timing(current_time);
@@ -402,22 +489,27 @@ bool search_local(search_arguments & arguments, search_time_statistics & time_st
     }
 
     auto start = std::chrono::high_resolution_clock::now();
-    // producer threads are created here
+    // producer threads are created here and shared by all chunks of queries
+    work_stealing_pool producer_pool{arguments.threads};
     if constexpr (stellar_only)
     {
-        iterate_all_queries<TSequence>(ref_meta.seg_count, arguments, queue);
+        iterate_all_queries<TSequence>(ref_meta.seg_count, arguments, registry, queue, producer_pool);
+    }
+    else if (arguments.verify_prefilter_hits())
+    {
+        iterate_prefilter_hits<TSequence>(arguments, registry, queue, ref_meta.seg_count);
     }
     else
     {
         using index_t = decltype(index);
-        raptor::threshold::threshold const thresholder{arguments.make_threshold_parameters()};
+        raptor::threshold::threshold const thresholder = index.thresholds().make_threshold(arguments.make_threshold_parameters());
         if constexpr (is_split)
         {
-            iterate_split_queries<index_t, TSequence>(arguments, index, thresholder, queue, query_meta.value());
+            iterate_split_queries<index_t, TSequence>(arguments, index, thresholder, registry, queue, query_meta.value(), producer_pool);
         }
         else
         {
-            iterate_short_queries<index_t, TSequence>(arguments, index, thresholder, queue);
+            iterate_short_queries<index_t, TSequence>(arguments, index, thresholder, registry, queue, producer_pool);
         }
     }
 
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <valik/search/iterate_queries.hpp>
+#include <valik/search/load_index.hpp>
+#include <valik/search/prefilter_hits.hpp>
+#include <valik/search/search_time_statistics.hpp>
+#include <valik/shared.hpp>
+#include <valik/split/metadata.hpp>
+
+namespace valik::app
+{
+
+/**
+ * @brief Function that prefilters the queries and writes the bins of each query record to a prefilter hits file.
+ *        The hits can be verified later with `search --prefilter-hits` without loading the index.
+ *
+ * @tparam index_structure_t Type of the IBF, one of valik::index_structure.
+ * @tparam is_split Split query sequences.
+ * @param arguments Command line arguments.
+ * @param time_statistics Run-time statistics.
+ * @return true if search failed.
+ */
+template <typename index_structure_t, bool is_split>
+bool search_prefilter_only(search_arguments & arguments, search_time_statistics & time_statistics)
+{
+    auto index = valik_index<index_structure_t>{};
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        load_index(index, arguments);
+        auto end = std::chrono::high_resolution_clock::now();
+        time_statistics.index_io_time += std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+    }
+
+    std::optional<metadata> query_meta;
+    if constexpr (is_split)
+        query_meta = metadata(arguments);
+
+    prefilter_hits_header header{};
+    header.bin_count = index.ibf().bin_count();
+    header.split_query = is_split;
+    header.window_size = arguments.window_size;
+    header.shape = arguments.shape;
+    header.ref_meta_path = std::filesystem::absolute(arguments.ref_meta_path).string();
+    header.bin_path = arguments.bin_path;
+    prefilter_hits_writer writer{arguments.prefilter_hits_file, header};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    {
+        using index_t = decltype(index);
+        using TSequence = seqan2::String<seqan2::Dna>;
+        raptor::threshold::threshold const thresholder = index.thresholds().make_threshold(arguments.make_threshold_parameters());
+        query_registry<TSequence> registry{};
+        work_stealing_pool producer_pool{arguments.threads};
+        if constexpr (is_split)
+            iterate_split_queries<index_t, TSequence>(arguments, index, thresholder, registry, writer, query_meta.value(), producer_pool);
+        else
+            iterate_short_queries<index_t, TSequence>(arguments, index, thresholder, registry, writer, producer_pool);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    time_statistics.search_time += std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+
+    if (arguments.verbose)
+        std::cout << "Wrote prefilter hits of " << writer.record_count() << " query records to "
+                  << arguments.prefilter_hits_file.string() << '\n';
+
+    return false;
+}
+
+} // namespace valik::app
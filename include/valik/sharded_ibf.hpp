@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <seqan3/search/dream_index/interleaved_bloom_filter.hpp>
+
+#include <valik/ibf_geometry.hpp>
+
+namespace valik
+{
+
+/**
+ * @brief An uncompressed Interleaved Bloom Filter whose bins are stored in several shards.
+ *
+ * Each shard is an IBF for a contiguous block of bins. All shards have the same bin size and hash functions as the
+ * IBF they were cut from, so that a value hashes to the same rows in every shard. Only some of the shards need to be
+ * loaded: the membership agent returns binning bit vectors over all bins in which the bins of missing shards are unset.
+ */
+class sharded_ibf
+{
+public:
+    using ibf_t = seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>;
+    static constexpr seqan3::data_layout data_layout_mode = seqan3::data_layout::uncompressed;
+
+    struct shard
+    {
+        size_t first_bin;
+        ibf_t ibf;
+        detail::ibf_geometry geometry;
+    };
+
+    class membership_agent_type;
+
+private:
+    size_t bin_count_{};
+    size_t bin_size_{};
+    size_t hash_count_{};
+    std::vector<shard> shards_{};
+
+public:
+    sharded_ibf() = default;
+    sharded_ibf(sharded_ibf const &) = default;
+    sharded_ibf(sharded_ibf &&) = default;
+    sharded_ibf & operator=(sharded_ibf const &) = default;
+    sharded_ibf & operator=(sharded_ibf &&) = default;
+    ~sharded_ibf() = default;
+
+    /**
+     * @brief Constructor that creates a sharded IBF without any loaded shards.
+     *
+     * @param bin_count Number of bins of all shards.
+     * @param bin_size Size of each bin in bits.
+     * @param hash_count Number of hash functions.
+     */
+    sharded_ibf(size_t const bin_count, size_t const bin_size, size_t const hash_count) :
+        bin_count_{bin_count},
+        bin_size_{bin_size},
+        hash_count_{hash_count}
+    {}
+
+    /**
+     * @brief Function that copies a block of bins out of an IBF.
+     *
+     * @param ibf The IBF to cut.
+     * @param first_bin First bin of the block. Must be a multiple of 64.
+     * @param bin_count Number of bins in the block.
+     * @return An IBF with the bins [first_bin, first_bin + bin_count) of ibf.
+     */
+    static ibf_t slice(ibf_t const & ibf, size_t const first_bin, size_t const bin_count)
+    {
+        if (first_bin % 64 != 0 || first_bin + bin_count > ibf.bin_count())
+            throw std::invalid_argument{"Shards have to start at a multiple of 64 bins."};
+
+        ibf_t result{seqan3::bin_count{bin_count},
+                     seqan3::bin_size{ibf.bin_size()},
+                     seqan3::hash_function_count{ibf.hash_function_count()}};
+        detail::ibf_geometry const geometry{ibf};
+        detail::ibf_geometry const result_geometry{result};
+
+        uint64_t const * const words = ibf.raw_data().data() + (first_bin >> 6);
+        uint64_t * const result_words = result.raw_data().data();
+        for (size_t row = 0; row < geometry.bin_size; ++row)
+            std::memcpy(result_words + row * result_geometry.bin_words,
+                        words + row * geometry.bin_words,
+                        result_geometry.bin_words * sizeof(uint64_t));
+        return result;
+    }
+
+    /**
+     * @brief Function that adds a loaded shard.
+     *
+     * @param first_bin First bin of the shard.
+     * @param ibf The bins of the shard.
+     */
+    void add_shard(size_t const first_bin, ibf_t && ibf)
+    {
+        if (first_bin % 64 != 0 || first_bin + ibf.bin_count() > bin_count_ ||
+            ibf.bin_size() != bin_size_ || ibf.hash_function_count() != hash_count_)
+            throw std::runtime_error{"Shard does not match the sharded index."};
+
+        detail::ibf_geometry const geometry{ibf};
+        shards_.push_back(shard{first_bin, std::move(ibf), geometry});
+    }
+
+    membership_agent_type membership_agent() const;
+
+    size_t hash_function_count() const noexcept
+    {
+        return hash_count_;
+    }
+
+    size_t bin_count() const noexcept
+    {
+        return bin_count_;
+    }
+
+    size_t bin_size() const noexcept
+    {
+        return bin_size_;
+    }
+
+    //!\brief Size of the loaded shards in bits.
+    size_t bit_size() const noexcept
+    {
+        size_t bits{0};
+        for (auto const & s : shards_)
+            bits += s.ibf.bit_size();
+        return bits;
+    }
+
+    std::vector<shard> const & shards() const noexcept
+    {
+        return shards_;
+    }
+};
+
+/**
+ * @brief Manages membership queries for the valik::sharded_ibf.
+ *
+ * Like seqan3::interleaved_bloom_filter::membership_agent_type the agent owns a result buffer and has to be created
+ * for each thread.
+ */
+class sharded_ibf::membership_agent_type
+{
+private:
+    sharded_ibf const * ibf_ptr{nullptr};
+
+public:
+    using binning_bitvector = seqan3::interleaved_bloom_filter<seqan3::data_layout::uncompressed>::membership_agent_type::binning_bitvector;
+
+    membership_agent_type() = default;
+    membership_agent_type(membership_agent_type const &) = default;
+    membership_agent_type & operator=(membership_agent_type const &) = default;
+    membership_agent_type(membership_agent_type &&) = default;
+    membership_agent_type & operator=(membership_agent_type &&) = default;
+    ~membership_agent_type() = default;
+
+    explicit membership_agent_type(sharded_ibf const & ibf) : ibf_ptr{std::addressof(ibf)}, result_buffer(ibf.bin_count()) {}
+
+    binning_bitvector result_buffer;
+
+    [[nodiscard]] binning_bitvector const & bulk_contains(size_t const value) & noexcept
+    {
+        assert(ibf_ptr != nullptr);
+        assert(result_buffer.size() == ibf_ptr->bin_count());
+
+        uint64_t * const result = result_buffer.raw_data().data();
+        for (auto const & [first_bin, ibf, geometry] : ibf_ptr->shards())
+        {
+            std::array<size_t, 5> const rows = geometry.row_words(value);
+            uint64_t const * const words = ibf.raw_data().data();
+            uint64_t * const shard_result = result + (first_bin >> 6);
+
+            for (size_t batch = 0; batch < geometry.bin_words; ++batch)
+            {
+                uint64_t tmp{-1ULL};
+                for (size_t i = 0; i < geometry.hash_funs; ++i)
+                    tmp &= words[rows[i] + batch];
+                shard_result[batch] = tmp;
+            }
+        }
+
+        return result_buffer;
+    }
+
+    // `bulk_contains` cannot be called on a temporary, since the object the returned reference points to
+    // is immediately destroyed.
+    [[nodiscard]] binning_bitvector const & bulk_contains(size_t const value) && noexcept = delete;
+};
+
+inline sharded_ibf::membership_agent_type sharded_ibf::membership_agent() const
+{
+    return membership_agent_type{*this};
+}
+
+} // namespace valik
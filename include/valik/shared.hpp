@@ -92,6 +92,14 @@ struct build_arguments final : public split_arguments
     bool fast{false};
     bool manual_parameters{false};
     bool input_is_minimiser{false};
+    bool mapped_index{false};
+    bool compressed{false};
+    bool hierarchical{false};
+    size_t tmax{64};
+    size_t shards{1};
+    uint32_t index_version{1};
+    std::string minimiser_memory{"1g"};
+    size_t minimiser_memory_bytes{1ULL << 30};
 
     uint8_t kmer_count_min_cutoff{0};
     uint8_t kmer_count_max_cutoff{254};
@@ -101,10 +109,29 @@ struct build_arguments final : public split_arguments
     bool verbose{false};
 };
 
+struct update_arguments
+{
+    uint8_t threads{1u};
+    std::filesystem::path index_file{};
+    std::filesystem::path out_path{};
+    std::filesystem::path ref_meta_path{};
+    std::filesystem::path add_file{};
+    std::filesystem::path remove_file{};
+    std::vector<std::string> add_bin_path{};
+    std::vector<std::string> remove_bin_path{};
+    std::string minimiser_memory{"1g"};
+    size_t minimiser_memory_bytes{1ULL << 30};
+    bool verbose{false};
+};
+
 struct minimiser_threshold_arguments
 {
     virtual ~minimiser_threshold_arguments() = 0;   // make an abstract base struct
 
+    // stricter thresholding parameters of search --fast
+    static constexpr double fast_tau{0.99999};
+    static constexpr double fast_p_max{0.05};
+
     double tau{0.9999};
     double p_max{0.15};
     double fpr{0.05};
@@ -170,6 +197,13 @@ struct search_arguments final : public minimiser_threshold_arguments, search_pro
     std::vector<std::string> bin_path{};
     std::filesystem::path query_file{};
     std::filesystem::path index_file{};
+    bool mapped_index{false};
+    bool compressed{false};
+    bool hierarchical{false};
+    bool sharded{false};
+    std::string shard_range{};
+    size_t first_shard{0};
+    size_t last_shard{std::numeric_limits<size_t>::max()};
     std::filesystem::path all_matches{};
     std::filesystem::path out_file{"search.gff"};
 
@@ -183,6 +217,19 @@ struct search_arguments final : public minimiser_threshold_arguments, search_pro
 
     size_t cart_max_capacity{1000};
     size_t max_queued_carts{std::numeric_limits<size_t>::max()};
+    bool lock_free_queue{false};
+    double cart_duration{0.0}; // target seconds of Stellar search per cart, 0 means a fixed cart capacity
+    //!\brief With --cart-duration the capacity of a cart adapts between 1 and cart_max_capacity * max_cart_growth.
+    static constexpr size_t max_cart_growth{16};
+
+    bool prefilter_only{false};
+    std::filesystem::path prefilter_hits_file{};
+
+    //!\brief Stellar search verifies the prefilter hits of an earlier --prefilter-only search instead of prefiltering.
+    bool verify_prefilter_hits() const noexcept
+    {
+        return !prefilter_only && !prefilter_hits_file.empty();
+    }
 
     raptor::threshold::threshold_parameters make_threshold_parameters() const noexcept
     {
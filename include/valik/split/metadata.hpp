@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <optional>
 #include <ranges>
 #include <sstream>
 
@@ -172,6 +173,25 @@ SEQAN3_WORKAROUND_GCC_BOGUS_MEMCPY_STOP
         }
     };
 
+    /** !\brief a metadata struct that stores the k-mer count cutoffs of an index that was built from minimiser files.
+     *
+     * \param min                  Minimum number of occurrences of a stored minimiser.
+     * \param max                  Maximum number of occurrences of a stored minimiser.
+     * \param filesize_dependent   Minimum depends on the size of each bin.
+     */
+    struct minimiser_cutoffs
+    {
+        uint8_t min{0};
+        uint8_t max{254};
+        bool filesize_dependent{false};
+
+        template <class Archive>
+        void serialize(Archive & archive)
+        {
+            archive(min, max, filesize_dependent);
+        }
+    };
+
     struct fasta_order
     {
         inline bool operator() (sequence_stats const & left, sequence_stats const & right)
@@ -191,6 +211,7 @@ SEQAN3_WORKAROUND_GCC_BOGUS_MEMCPY_STOP
     size_t pattern_size;
     float ibf_fpr;
     double information_content{1.0};
+    std::optional<minimiser_cutoffs> cutoffs{};
 
     std::vector<sequence_file> files;
     std::vector<sequence_stats> sequences;
@@ -239,7 +260,7 @@ SEQAN3_WORKAROUND_GCC_BOGUS_MEMCPY_STOP
         void scan_metagenome_bins(std::vector<std::string> const & bin_path)
         {
             using traits_type = seqan3::sequence_file_input_default_traits_dna;
-            size_t file_id{0};
+            size_t file_id{files.size()};
             for (std::string bin_file : bin_path)
             {
                 uint64_t bin_len{0};
@@ -488,6 +509,32 @@ SEQAN3_WORKAROUND_GCC_BOGUS_MEMCPY_STOP
             load(filepath);
         }
 
+        /**
+         * @brief Function that appends bins to the metadata of a metagenome database.
+         *
+         * @param bin_path Paths of the new bins.
+         */
+        void add_metagenome_bins(std::vector<std::string> const & bin_path)
+        {
+            scan_metagenome_bins(bin_path);
+            seq_count = sequences.size();
+            seg_count = segments.size();
+        }
+
+        /**
+         * @brief Function that marks a bin of a metagenome database as empty. The ids of other bins do not change.
+         *
+         * @param id Numerical segment id.
+         */
+        void clear_segment(size_t const id)
+        {
+            if (segments.size() <= id)
+                throw std::runtime_error{"Segment " + std::to_string(id) + " index out of range."};
+
+            total_len -= segments[id].len;
+            segments[id].len = 0;
+        }
+
         /**
          * @brief Function that returns the numerical index of a sequence based on its fasta ID.
          *
@@ -542,6 +589,8 @@ SEQAN3_WORKAROUND_GCC_BOGUS_MEMCPY_STOP
             std::ofstream os(filepath, std::ios::binary);
             cereal::BinaryOutputArchive archive(os);
             archive(total_len, pattern_size, files, sequences, segments, ibf_fpr, information_content);
+            if (cutoffs)
+                archive(*cutoffs);
         }
       
         /**
@@ -554,6 +603,12 @@ SEQAN3_WORKAROUND_GCC_BOGUS_MEMCPY_STOP
             std::ifstream is(filepath, std::ios::binary);
             cereal::BinaryInputArchive archive(is);
             archive(total_len, pattern_size, files, sequences, segments, ibf_fpr, information_content);
+            // the cutoffs are only stored for indices that were built from minimiser files
+            if (is.peek() != std::ifstream::traits_type::eof())
+            {
+                cutoffs.emplace();
+                archive(*cutoffs);
+            }
             seq_count = sequences.size();
             seg_count = segments.size();
         }
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <valik/shared.hpp>
+
+namespace valik::app
+{
+
+void valik_update(update_arguments const & arguments);
+
+} // namespace valik::app
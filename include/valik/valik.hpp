@@ -12,6 +12,7 @@ void init_top_level_parser(sharg::parser & parser);
 void run_split(sharg::parser & parser);
 void run_build(sharg::parser & parser);
 void run_search(sharg::parser & parser);
+void run_update(sharg::parser & parser);
 void run_consolidation(sharg::parser & parser);
 
 } // namespace valik::app
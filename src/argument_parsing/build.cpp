@@ -104,6 +104,52 @@ void init_build_parser(sharg::parser & parser, build_arguments & arguments)
                       .description = "Choose the size of the resulting IBF.",
                       .advanced = true,
                       .validator = size_validator{"\\d+\\s{0,1}[k,m,g,t,K,M,G,T]"}});
+    parser.add_option(arguments.minimiser_memory,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "minimiser-memory",
+                      .description = "Memory used for counting the minimisers of each bin in --fast mode. "
+                                     "Counts that do not fit are spilled to the output directory.",
+                      .advanced = true,
+                      .validator = size_validator{"\\d+\\s{0,1}[k,m,g,t,K,M,G,T]"}});
+    parser.add_flag(arguments.mapped_index,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "mapped-index",
+                      .description = "Store the index in a layout that search memory maps instead of reading it into memory. "
+                                     "Concurrent searches on the same machine share the mapped IBF.",
+                      .advanced = true});
+    parser.add_flag(arguments.compressed,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "compressed",
+                      .description = "Store a compressed IBF. Reduces the size of the index and the memory used by search "
+                                     "for sparse IBFs at the cost of slower queries. Mutually exclusive with --mapped-index.",
+                      .advanced = true});
+    parser.add_flag(arguments.hierarchical,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "hibf",
+                      .description = "Store the bins of a metagenome database in a hierarchical IBF. Recommended for thousands of "
+                                     "bins of uneven size. Mutually exclusive with --mapped-index and --compressed.",
+                      .advanced = true});
+    parser.add_option(arguments.tmax,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "tmax",
+                      .description = "Maximum number of technical bins of each IBF in the hierarchy.",
+                      .advanced = true,
+                      .validator = sharg::arithmetic_range_validator{2, 4096}});
+    parser.add_option(arguments.index_version,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "index-version",
+                      .description = "Version 2 stores the index in sections with checksums that can be read on their own, "
+                                     "e.g. the parameters without the IBF. Can not be combined with --mapped-index, "
+                                     "--compressed, --hibf or --shards.",
+                      .advanced = true,
+                      .validator = sharg::value_list_validator{1u, 2u}});
+    parser.add_option(arguments.shards,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "shards",
+                      .description = "Store the IBF in this many files of contiguous bins, so that a search can load a subset "
+                                     "of the bins. Can not be combined with --mapped-index, --compressed or --hibf.",
+                      .advanced = true,
+                      .validator = positive_integer_validator{}});
     parser.add_flag(arguments.verbose,
                     sharg::config{.short_id = '\0',
                     .long_id = "verbose",
@@ -123,6 +169,11 @@ void init_build_parser(sharg::parser & parser, build_arguments & arguments)
                                     .description = "Only store k-mers with no more than (<=) x occurrences. "
                                                    "Mutually exclusive with --use-filesize-dependent-cutoff.",
                                     .validator = sharg::arithmetic_range_validator{1, 254}});
+    parser.add_flag(arguments.use_filesize_dependent_cutoff,
+                    sharg::config{.short_id = '\0',
+                                  .long_id = "use-filesize-dependent-cutoff",
+                                  .description = "Apply cutoffs from Mantis (Pandey et al., 2018) that depend on the size of "
+                                                 "each bin. Only used in --fast mode."});
 }
 
 void run_build(sharg::parser & parser)
@@ -145,6 +196,22 @@ void run_build(sharg::parser & parser)
         }
     }
 
+    if (arguments.use_filesize_dependent_cutoff && (parser.is_option_set("kmer-count-min") || parser.is_option_set("kmer-count-max")))
+        throw sharg::parser_error{"Arguments --kmer-count-min and --kmer-count-max are mutually exclusive with --use-filesize-dependent-cutoff."};
+
+    if (arguments.compressed && arguments.mapped_index)
+        throw sharg::parser_error{"Arguments --compressed and --mapped-index are mutually exclusive."};
+    if (arguments.hierarchical && (arguments.compressed || arguments.mapped_index))
+        throw sharg::parser_error{"Argument --hibf can not be combined with --compressed or --mapped-index."};
+    if (arguments.shards > 1 && (arguments.hierarchical || arguments.compressed || arguments.mapped_index))
+        throw sharg::parser_error{"Argument --shards can not be combined with --hibf, --compressed or --mapped-index."};
+    if (arguments.index_version == 2 && (arguments.hierarchical || arguments.compressed || arguments.mapped_index ||
+                                         arguments.shards > 1))
+        throw sharg::parser_error{"Argument --index-version 2 can not be combined with --hibf, --compressed, --mapped-index "
+                                  "or --shards."};
+    if (arguments.hierarchical && !arguments.metagenome)
+        throw sharg::parser_error{"A hierarchical IBF can only be built for a metagenome database."};
+
     if (parser.is_option_set("shape"))
     {
         uint64_t bin_shape{};
@@ -155,6 +222,7 @@ void run_build(sharg::parser & parser)
     }
 
     arguments.errors = std::ceil(arguments.error_rate * arguments.pattern_size);
+    arguments.minimiser_memory_bytes = size_in_bytes(arguments.minimiser_memory);
     // ==========================================
     // Process bin_path:
     // if building from clustered sequences each line in input corresponds to a bin
@@ -275,6 +343,12 @@ void run_build(sharg::parser & parser)
         {
             arguments.window_size = arguments.kmer_size + 2;
             arguments.input_is_minimiser = true;
+
+            // update filters the minimisers of new bins with the same cutoffs
+            meta.cutoffs = metadata::minimiser_cutoffs{.min = arguments.kmer_count_min_cutoff,
+                                                       .max = arguments.kmer_count_max_cutoff,
+                                                       .filesize_dependent = arguments.use_filesize_dependent_cutoff};
+            meta.save(arguments.ref_meta_path);
         }
         else
             arguments.window_size = arguments.kmer_size;
@@ -324,31 +398,7 @@ void run_build(sharg::parser & parser)
         // ==========================================
         if (parser.is_option_set("size"))
         {
-            arguments.size.erase(std::remove(arguments.size.begin(), arguments.size.end(), ' '), arguments.size.end());
-
-            size_t multiplier{};
-
-            switch (std::tolower(arguments.size.back()))
-            {
-                case 't':
-                    multiplier = 8ull * 1024ull * 1024ull * 1024ull * 1024ull;
-                    break;
-                case 'g':
-                    multiplier = 8ull * 1024ull * 1024ull * 1024ull;
-                    break;
-                case 'm':
-                    multiplier = 8ull * 1024ull * 1024ull;
-                    break;
-                case 'k':
-                    multiplier = 8ull * 1024ull;
-                    break;
-                default:
-                    throw sharg::parser_error{"Use {k, m, g, t} to pass size. E.g., --size 8g."};
-            }
-
-            size_t size{};
-            std::from_chars(arguments.size.data(), arguments.size.data() + arguments.size.size() - 1, size);
-            size *= multiplier;
+            size_t const size = 8u * size_in_bytes(arguments.size);
             arguments.bits = size / (((arguments.seg_count + 63) >> 6) << 6);
         }
         else 
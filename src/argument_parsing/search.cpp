@@ -3,6 +3,7 @@
 
 #include <valik/argument_parsing/search.hpp>
 #include <valik/index.hpp>
+#include <valik/search/load_index.hpp>
 #include <valik/search/search.hpp>
 
 namespace valik::app
@@ -14,8 +15,7 @@ void init_search_parser(sharg::parser & parser, search_arguments & arguments)
     parser.add_option(arguments.index_file,
                       sharg::config{.short_id = '\0',
                       .long_id = "index",
-                      .description = "Provide a valid path to an IBF.",
-                      .required = true,
+                      .description = "Provide a valid path to an IBF. Not needed to verify --prefilter-hits.",
                       .validator = sharg::input_file_validator{}});
     parser.add_option(arguments.query_file,
                       sharg::config{.short_id = '\0',
@@ -30,8 +30,7 @@ void init_search_parser(sharg::parser & parser, search_arguments & arguments)
     parser.add_option(arguments.out_file,
                       sharg::config{.short_id = '\0',
                       .long_id = "output",
-                      .description = "Please provide a valid path to the output.",
-                      .required = true,
+                      .description = "Please provide a valid path to the output. Not needed with --prefilter-only.",
                       .validator = sharg::output_file_validator{sharg::output_file_open_options::open_or_create, {"gff"}}});
     parser.add_option(arguments.error_rate,
                       sharg::config{.short_id = 'e',
@@ -70,6 +69,16 @@ void init_search_parser(sharg::parser & parser, search_arguments & arguments)
                     .long_id = "threads",
                     .description = "Choose the number of threads.",
                     .validator = positive_integer_validator{}});
+    parser.add_flag(arguments.prefilter_only,
+                    sharg::config{.short_id = '\0',
+                    .long_id = "prefilter-only",
+                    .description = "Only prefilter the queries and write the bins of each query to --prefilter-hits. "
+                                   "Stellar search is not run."});
+    parser.add_option(arguments.prefilter_hits_file,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "prefilter-hits",
+                      .description = "Binary file of prefilter hits. Written with --prefilter-only. Otherwise the prefilter "
+                                     "hits of an earlier search are verified with Stellar without loading the index."});
     
     /////////////////////////////////////////
     // Advanced options
@@ -125,6 +134,13 @@ void init_search_parser(sharg::parser & parser, search_arguments & arguments)
                                      "This determines how many potential matches are skipped in prefiltering."
                                      "--query-every 1 considers all potential matches.", 
                       .advanced = true});
+    parser.add_option(arguments.shard_range,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "shards",
+                      .description = "Only load and search these shards of a sharded index, e.g. 2-3. Shards are numbered from 0. "
+                                     "The shards of an index built with --index-version 2 are its blocks of 64 bins.",
+                      .advanced = true,
+                      .validator = sharg::regex_validator{"\\d+(-\\d+)?"}});
     parser.add_option(arguments.cart_max_capacity,
                     sharg::config{.short_id = '\0',
                     .long_id = "cart-max-capacity",
@@ -135,6 +151,21 @@ void init_search_parser(sharg::parser & parser, search_arguments & arguments)
                     .long_id = "max-queued-carts",
                     .description = "Maximal number of carts that are full and are waiting to be processed.",
                     .advanced = true});
+    parser.add_flag(arguments.lock_free_queue,
+                    sharg::config{.short_id = '\0',
+                    .long_id = "lock-free-queue",
+                    .description = "Each prefiltering thread fills carts of its own and full carts are handed over to Stellar "
+                                   "without locks. Reduces contention for many threads.",
+                    .advanced = true});
+    parser.add_option(arguments.cart_duration,
+                    sharg::config{.short_id = '\0',
+                    .long_id = "cart-duration",
+                    .description = "Adapt the cart capacity of each bin so that the Stellar search of a cart takes about this many "
+                                   "seconds. The capacity starts at --cart-max-capacity and stays between 1 and " +
+                                   std::to_string(search_arguments::max_cart_growth) + " times --cart-max-capacity. "
+                                   "0 means a fixed cart capacity.",
+                    .advanced = true,
+                    .validator = sharg::arithmetic_range_validator{0.0, 86400.0}});
 
     parser.add_subsection("Stellar options");
     parser.add_option(arguments.minLength,
@@ -206,8 +237,36 @@ void run_search(sharg::parser & parser)
     if (arguments.very_verbose)
         arguments.verbose = true;
 
-    arguments.ref_meta_path = arguments.index_file;
-    arguments.ref_meta_path.replace_extension("bin");
+    // ==========================================
+    // Process --prefilter-only and --prefilter-hits.
+    // ==========================================
+    if (arguments.prefilter_only && !parser.is_option_set("prefilter-hits"))
+        throw sharg::parser_error{"Option --prefilter-only requires --prefilter-hits."};
+    if (arguments.prefilter_hits_file.empty() || arguments.prefilter_only)
+    {
+        if (!parser.is_option_set("index"))
+            throw sharg::parser_error{"Option --index is required but not set."};
+    }
+    if (!arguments.prefilter_only && !parser.is_option_set("output"))
+        throw sharg::parser_error{"Option --output is required but not set."};
+    if (arguments.stellar_only && !arguments.prefilter_hits_file.empty())
+        throw sharg::parser_error{"Options --prefilter-only and --prefilter-hits can not be combined with --stellar-only."};
+
+    if (arguments.prefilter_only)
+        sharg::output_file_validator{sharg::output_file_open_options::open_or_create}(arguments.prefilter_hits_file);
+
+    std::optional<prefilter_hits_header> hits_header{};
+    if (arguments.verify_prefilter_hits())
+    {
+        sharg::input_file_validator{}(arguments.prefilter_hits_file);
+        hits_header = prefilter_hits_reader{arguments.prefilter_hits_file}.header();
+        arguments.ref_meta_path = hits_header->ref_meta_path;
+    }
+    else
+    {
+        arguments.ref_meta_path = arguments.index_file;
+        arguments.ref_meta_path.replace_extension("bin");
+    }
     sharg::input_file_validator{}(arguments.ref_meta_path);
 
     // ==========================================
@@ -240,20 +299,27 @@ void run_search(sharg::parser & parser)
         throw sharg::validation_error{"Invalid parameter values: Please choose numMatches <= sortThresh.\n"};
 
 
-    if (!arguments.stellar_only && !parser.is_option_set("index"))
-    {
-        throw sharg::parser_error{"Option --index is required but not set."};
-    }
-
     // ==========================================
     // Read window and kmer size, and the bin paths.
     // ==========================================
-    std::ifstream is{arguments.index_file.string(),std::ios::binary};
-    cereal::BinaryInputArchive iarchive{is};
-    if (!arguments.stellar_only)
+    if (hits_header)
     {
+        // the index is not loaded; the parameters are stored with the prefilter hits
+        arguments.split_query = hits_header->split_query;
+        arguments.shape = hits_header->shape;
+        arguments.shape_size = arguments.shape.size();
+        arguments.shape_weight = arguments.shape.count();
+        arguments.window_size = hits_header->window_size;
+        arguments.bin_path = hits_header->bin_path;
+    }
+    else if (!arguments.stellar_only)
+    {
+        arguments.mapped_index = is_mapped_index(arguments.index_file);
+        arguments.compressed = is_compressed_index(arguments.index_file);
+        arguments.hierarchical = is_hierarchical_index(arguments.index_file);
+        arguments.sharded = is_sharded_index(arguments.index_file);
         valik_index<> tmp{};
-        tmp.load_parameters(iarchive);
+        load_index_parameters(tmp, arguments.index_file);
         arguments.shape = tmp.shape();
         arguments.shape_size = arguments.shape.size();
         arguments.shape_weight = arguments.shape.count();
@@ -270,6 +336,24 @@ void run_search(sharg::parser & parser)
     if (arguments.bin_path.size() > 1)
         arguments.distribute = true;
 
+    // ==========================================
+    // Process --shards.
+    // ==========================================
+    if (parser.is_option_set("shards"))
+    {
+        // the bin blocks of an index of version 2 are read as shards
+        if (!arguments.sharded && !is_sectioned_index(arguments.index_file))
+            throw sharg::parser_error{"Option --shards requires an index that was built with --shards or --index-version 2."};
+        arguments.sharded = true;
+
+        auto const separator = arguments.shard_range.find('-');
+        arguments.first_shard = std::stoull(arguments.shard_range.substr(0, separator));
+        arguments.last_shard = (separator == std::string::npos) ? arguments.first_shard
+                                                                 : std::stoull(arguments.shard_range.substr(separator + 1));
+        if (arguments.first_shard > arguments.last_shard)
+            throw sharg::validation_error{"The first shard can not be larger than the last shard."};
+    }
+
     // ==========================================
     // Process --pattern.
     // ==========================================
@@ -377,10 +461,10 @@ void run_search(sharg::parser & parser)
         // Set strict thresholding parameters for fast mode.
         // ==========================================
         if (arguments.fast)
-            arguments.tau = 0.99999;
+            arguments.tau = search_arguments::fast_tau;
 
         if (arguments.fast)
-            arguments.p_max = 0.05;
+            arguments.p_max = search_arguments::fast_p_max;
     }
 
     if (!parser.is_option_set("minLength"))
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <charconv>
+
 #include <valik/argument_parsing/shared.hpp>
 
 namespace valik::app
@@ -56,4 +59,37 @@ void try_parsing(sharg::parser & parser)
     }
 }
 
+/**
+ * @brief Function that converts a size like "8g" to bytes.
+ *
+ * @param size Integer followed by one of {k, m, g, t} (case insensitive). Spaces are ignored.
+ */
+size_t size_in_bytes(std::string size)
+{
+    size.erase(std::remove(size.begin(), size.end(), ' '), size.end());
+
+    size_t multiplier{};
+    switch (std::tolower(size.back()))
+    {
+        case 't':
+            multiplier = 1024ull * 1024ull * 1024ull * 1024ull;
+            break;
+        case 'g':
+            multiplier = 1024ull * 1024ull * 1024ull;
+            break;
+        case 'm':
+            multiplier = 1024ull * 1024ull;
+            break;
+        case 'k':
+            multiplier = 1024ull;
+            break;
+        default:
+            throw sharg::parser_error{"Use {k, m, g, t} to pass size. E.g., --size 8g."};
+    }
+
+    size_t bytes{};
+    std::from_chars(size.data(), size.data() + size.size() - 1, bytes);
+    return bytes * multiplier;
+}
+
 } // namespace valik::app
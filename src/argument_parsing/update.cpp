@@ -0,0 +1,98 @@
+#include <valik/argument_parsing/update.hpp>
+
+namespace valik::app
+{
+
+void init_update_parser(sharg::parser & parser, update_arguments & arguments)
+{
+    init_shared_meta(parser);
+    parser.info.description.emplace_back("Add bins to or clear bins of the index of a metagenome database. "
+                                         "The IBF is only rebuilt if the new bins would exceed its false positive rate.");
+
+    parser.add_positional_option(arguments.index_file,
+                      sharg::config{.description = "Index of a metagenome database. The reference metadata (.bin) is expected "
+                                                   "next to the index. The minimisers of new bins of an index built with "
+                                                   "--fast are filtered with the k-mer count cutoffs of build and written "
+                                                   "next to the index, where the minimiser files of the old bins are expected.",
+                      .validator = sharg::input_file_validator{}});
+    parser.add_option(arguments.add_file,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "add",
+                      .description = "Text file with a list of cluster paths that are appended as new bins.",
+                      .validator = sharg::input_file_validator{}});
+    parser.add_option(arguments.remove_file,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "remove",
+                      .description = "Text file with a list of cluster paths whose bins are cleared. "
+                                     "Bin ids of the remaining bins do not change.",
+                      .validator = sharg::input_file_validator{}});
+    parser.add_option(arguments.out_path,
+                      sharg::config{.short_id = 'o',
+                      .long_id = "output",
+                      .description = "Provide an output filepath. Overwrites the index by default."});
+    parser.add_option(arguments.threads,
+                    sharg::config{.short_id = '\0',
+                    .long_id = "threads",
+                    .description = "Choose the number of threads.",
+                    .validator = positive_integer_validator{}});
+    parser.add_option(arguments.minimiser_memory,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "minimiser-memory",
+                      .description = "Memory used for counting the minimisers of each new bin. "
+                                     "Counts that do not fit are spilled to the output directory.",
+                      .advanced = true,
+                      .validator = size_validator{"\\d+\\s{0,1}[k,m,g,t,K,M,G,T]"}});
+    parser.add_flag(arguments.verbose,
+                    sharg::config{.short_id = '\0',
+                    .long_id = "verbose",
+                    .description = "Print verbose output.",
+                    .advanced = true});
+}
+
+void run_update(sharg::parser & parser)
+{
+    update_arguments arguments{};
+    init_update_parser(parser, arguments);
+    try_parsing(parser);
+
+    if (!parser.is_option_set("add") && !parser.is_option_set("remove"))
+        throw sharg::parser_error{"Provide a list of bins with --add or --remove."};
+
+    auto sequence_file_validator{bin_validator{}.sequence_file_validator};
+    auto read_bin_list = [&](std::filesystem::path const & list_file, bool const validate)
+    {
+        std::vector<std::string> bin_path{};
+        std::ifstream istrm{list_file};
+        std::string line;
+        while (std::getline(istrm, line))
+        {
+            if (!line.empty())
+            {
+                if (validate)
+                    sequence_file_validator(line);
+                bin_path.emplace_back(line);
+            }
+        }
+        return bin_path;
+    };
+
+    if (parser.is_option_set("add"))
+        arguments.add_bin_path = read_bin_list(arguments.add_file, true);
+    // removed bins do not have to exist anymore
+    if (parser.is_option_set("remove"))
+        arguments.remove_bin_path = read_bin_list(arguments.remove_file, false);
+
+    arguments.minimiser_memory_bytes = size_in_bytes(arguments.minimiser_memory);
+
+    if (!parser.is_option_set("output"))
+        arguments.out_path = arguments.index_file;
+    sharg::output_file_validator{sharg::output_file_open_options::open_or_create}(arguments.out_path);
+
+    arguments.ref_meta_path = arguments.index_file;
+    arguments.ref_meta_path.replace_extension("bin");
+    sharg::input_file_validator{{"bin"}}(arguments.ref_meta_path);
+
+    valik_update(arguments);
+}
+
+} // namespace valik::app
@@ -31,77 +31,90 @@ std::filesystem::path get_output_path(std::filesystem::path const & output_dir,
     return result;
 }
 
-void compute_minimiser(valik::build_arguments const & arguments)
+void compute_minimiser(valik::build_arguments const & arguments, std::vector<std::string> const & bin_path)
 {
-    if (arguments.bin_path.size() > 1)
+    // every thread counts the minimisers of one file at a time
+    size_t const thread_memory_bytes = arguments.minimiser_memory_bytes / arguments.threads;
+    file_reader<file_types::sequence> const reader{arguments.shape, arguments.window_size};
+    auto cluster_worker = [&](auto && zipped_view, auto &&)
     {
-        file_reader<file_types::sequence> const reader{arguments.shape, arguments.window_size};
-        auto cluster_worker = [&](auto && zipped_view, auto &&)
+        for (auto && [file_name, bin_number] : zipped_view)
         {
-            for (auto && [file_name, bin_number] : zipped_view)
-            {
-                size_t const seq_size = std::filesystem::file_size(file_name);
-                std::filesystem::path output_path = get_output_path(arguments.out_dir, file_name);
-
-                std::filesystem::path const minimiser_file =
-                    std::filesystem::path{output_path}.replace_extension("minimiser");
-                std::filesystem::path const progress_file =
-                    std::filesystem::path{output_path}.replace_extension("in_progress");
-                std::filesystem::path const header_file = std::filesystem::path{output_path}.replace_extension("header");
-            
-                // If we are already done with this file, we can skip it. Otherwise, we create a ".in_progress" file to keep
-                // track of whether the minimiser computation was successful.
-                bool const already_done = std::filesystem::exists(header_file) && std::filesystem::exists(header_file) && 
-                                          !std::filesystem::exists(progress_file);
-
-                if (already_done)
-                    continue;
-                else
-                    std::ofstream outfile{progress_file, std::ios::binary};
-
-                std::unordered_set<uint64_t> distinct_minimisers{};
-                // The set is (re-)constructed for each file. The alternative is to construct it once for each thread
-                // and clear+reuse it for every file that a thread works on. However, this dramatically increases
-                // memory consumption because the map will stay as big as needed for the biggest encountered file.
+            size_t const seq_size = std::filesystem::file_size(file_name);
+            std::filesystem::path output_path = get_output_path(arguments.out_dir, file_name);
 
-                reader.for_each_hash(file_name,
-                                     [&](auto && hash)
-                                     {
-                                         distinct_minimisers.insert(hash);
-                                     });
-
-                uint64_t count{};
+            std::filesystem::path const minimiser_file =
+                std::filesystem::path{output_path}.replace_extension("minimiser");
+            std::filesystem::path const progress_file =
+                std::filesystem::path{output_path}.replace_extension("in_progress");
+            std::filesystem::path const header_file = std::filesystem::path{output_path}.replace_extension("header");
+        
+            // If we are already done with this file, we can skip it. Otherwise, we create a ".in_progress" file to keep
+            // track of whether the minimiser computation was successful.
+            bool const already_done = std::filesystem::exists(header_file) && std::filesystem::exists(header_file) && 
+                                      !std::filesystem::exists(progress_file);
+
+            if (already_done)
+                continue;
+            else
+                std::ofstream outfile{progress_file, std::ios::binary};
+
+            // Counting is bounded by the memory budget of a thread and spills to the output directory otherwise.
+            valik::minimiser_counter counter{std::filesystem::path{output_path}.replace_extension("spill"),
+                                             thread_memory_bytes};
+            reader.for_each_hash(file_name,
+                                 [&](auto && hash)
+                                 {
+                                     counter.insert(hash);
+                                 });
+
+            uint8_t const min_cutoff = arguments.use_filesize_dependent_cutoff ?
+                                       detail::filesize_dependent_cutoff(file_name) : arguments.kmer_count_min_cutoff;
+            uint64_t count{};
 
+            {
+                std::ofstream outfile{minimiser_file, std::ios::binary};
+                counter.for_each_count([&](uint64_t const hash, uint8_t const occurrences)
                 {
-                    //!TODO: apply k-mer count cutoffs in metagenome search
-                    std::ofstream outfile{minimiser_file, std::ios::binary};
-                    for (auto && hash : distinct_minimisers)
+                    if (occurrences >= min_cutoff && occurrences <= arguments.kmer_count_max_cutoff)
                     {
                         outfile.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
                         ++count;
                     }
-                }
-
-                {
-                    std::ofstream headerfile{header_file};
-                    headerfile << arguments.shape.to_string() << '\t' << std::to_string(arguments.window_size) << '\t' << 
-                                  count << '\t' << seq_size << '\n';
-                }
+                });
+            }
 
-                std::filesystem::remove(progress_file);
+            {
+                std::ofstream headerfile{header_file};
+                headerfile << arguments.shape.to_string() << '\t' << std::to_string(arguments.window_size) << '\t' << 
+                              count << '\t' << seq_size << '\n';
             }
-        };
-        
-        size_t const chunk_size =
-            std::max<size_t>(1, std::floor(arguments.bin_path.size() / static_cast<double>(arguments.threads)));
-        auto chunked_view = seqan3::views::zip(arguments.bin_path, std::views::iota(0u)) | seqan3::views::chunk(chunk_size);
-        seqan3::detail::execution_handler_parallel executioner{arguments.threads};
-        executioner.bulk_execute(std::move(cluster_worker), std::move(chunked_view), []() {});
+
+            std::filesystem::remove(progress_file);
+        }
+    };
+    
+    size_t const chunk_size =
+        std::max<size_t>(1, std::floor(bin_path.size() / static_cast<double>(arguments.threads)));
+    auto chunked_view = seqan3::views::zip(bin_path, std::views::iota(0u)) | seqan3::views::chunk(chunk_size);
+    seqan3::detail::execution_handler_parallel executioner{arguments.threads};
+    executioner.bulk_execute(std::move(cluster_worker), std::move(chunked_view), []() {});
+}
+
+void compute_minimiser(valik::build_arguments const & arguments)
+{
+    // every thread counts the minimisers of one file or segment at a time
+    size_t const thread_memory_bytes = arguments.minimiser_memory_bytes / arguments.threads;
+    if (arguments.bin_path.size() > 1)
+    {
+        compute_minimiser(arguments, arguments.bin_path);
     }
     else
     {
         valik::metadata meta(arguments.ref_meta_path);
         std::filesystem::path const file_name{arguments.bin_path[0]};
+        uint8_t const min_cutoff = arguments.use_filesize_dependent_cutoff ?
+                                   detail::filesize_dependent_cutoff(file_name) : arguments.kmer_count_min_cutoff;
         
         auto segment_worker = [&](const auto && zipped_view, auto &&)
         {
@@ -128,10 +141,8 @@ void compute_minimiser(valik::build_arguments const & arguments)
                 else
                     std::ofstream outfile{progress_file, std::ios::binary};
 
-                std::unordered_map<uint64_t, uint8_t> minimiser_table{};
-                // The map is (re-)constructed for each segment. The alternative is to construct it once for each thread
-                // and clear+reuse it for every file that a thread works on. However, this dramatically increases
-                // memory consumption because the map will stay as big as needed for the biggest encountered file.
+                valik::minimiser_counter counter{std::filesystem::path{output_path}.replace_extension("spill"),
+                                                 thread_memory_bytes};
 
                 auto hash_view = [&] ()
                 {
@@ -142,20 +153,20 @@ void compute_minimiser(valik::build_arguments const & arguments)
 
                 for (auto const value : *shared_record.underlying_sequence | seqan3::views::slice(seg.start, seg.start + seg.len) | hash_view())
                 {
-                    minimiser_table[value] = std::min<uint8_t>(254u, minimiser_table[value] + 1);  
+                    counter.insert(value);
                 }
 
                 uint64_t count{};
                 {
                     std::ofstream outfile{minimiser_file, std::ios::binary};
-                    for (auto && [hash, occurrences] : minimiser_table)
+                    counter.for_each_count([&](uint64_t const hash, uint8_t const occurrences)
                     {
-                        if (occurrences >= arguments.kmer_count_min_cutoff && occurrences <= arguments.kmer_count_max_cutoff)
+                        if (occurrences >= min_cutoff && occurrences <= arguments.kmer_count_max_cutoff)
                         {
                             outfile.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
                             ++count;
                         }
-                    }
+                    });
                 }
 
                 {
@@ -204,6 +215,23 @@ void compute_minimiser(valik::build_arguments const & arguments)
 namespace detail
 {
 
+uint8_t filesize_dependent_cutoff(std::filesystem::path const & filename)
+{
+    // The cutoffs are based on the size of a gzipped FASTQ file. FASTA files are about half the size of FASTQ files
+    // and compression reduces the size about three times.
+    std::filesystem::path extension = filename.extension();
+    bool const is_compressed = extension == ".gz" || extension == ".bgzf" || extension == ".bz2";
+    if (is_compressed)
+        extension = std::filesystem::path{filename}.replace_extension().extension();
+    bool const is_fasta = extension == ".fa" || extension == ".fasta" || extension == ".fna" || extension == ".fas";
+    size_t const filesize = std::filesystem::file_size(filename) * (is_fasta ? 2 : 1) / (is_compressed ? 1 : 3);
+
+    for (size_t i = 0; i < cutoff_bounds.size(); ++i)
+        if (filesize <= cutoff_bounds[i])
+            return cutoffs[i];
+    return cutoffs.back();
+}
+
 size_t kmer_count_from_minimiser_files(std::vector<std::string> const & minimiser_bin_path, uint8_t const threads)
 {
     std::mutex callback_mutex{};
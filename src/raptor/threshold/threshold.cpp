@@ -15,7 +15,12 @@
 namespace raptor::threshold
 {
 
-threshold::threshold(threshold_parameters const & arguments)
+threshold::threshold(threshold_parameters const & arguments) : threshold{arguments, {}, {}}
+{}
+
+threshold::threshold(threshold_parameters const & arguments,
+                     std::vector<size_t> thresholds,
+                     std::vector<size_t> correction)
 {
     uint8_t const kmer_size{arguments.shape.size()};
     size_t const kmers_per_window = arguments.window_size - kmer_size + 1;
@@ -38,8 +43,9 @@ threshold::threshold(threshold_parameters const & arguments)
         size_t const kmers_per_pattern = arguments.query_length - kmer_size + 1;
         minimal_number_of_minimizers = kmers_per_pattern / kmers_per_window;
         maximal_number_of_minimizers = arguments.query_length - arguments.window_size + 1;
-        precomp_correction = precompute_correction(arguments);
-        precomp_thresholds = precompute_threshold(arguments);
+        size_t const table_size = maximal_number_of_minimizers - minimal_number_of_minimizers + 1;
+        precomp_correction = correction.size() == table_size ? std::move(correction) : precompute_correction(arguments);
+        precomp_thresholds = thresholds.size() == table_size ? std::move(thresholds) : precompute_threshold(arguments);
     }
 }
 
@@ -5,6 +5,38 @@
 namespace valik::app
 {
 
+namespace
+{
+
+/**
+ * @brief Function that computes the threshold tables of searches with up to arguments.errors errors,
+ *        for the default and the --fast thresholding parameters of search.
+ */
+precomputed_thresholds precompute_thresholds(build_arguments const & arguments)
+{
+    search_arguments search_defaults{};
+    search_defaults.window_size = arguments.window_size;
+    search_defaults.shape = arguments.shape;
+    search_defaults.pattern_size = arguments.pattern_size;
+
+    std::array<std::pair<double, double>, 2> const tau_p_max{std::pair{search_defaults.tau, search_defaults.p_max},
+                                                            std::pair{search_arguments::fast_tau, search_arguments::fast_p_max}};
+    precomputed_thresholds thresholds{};
+    for (size_t errors{0}; errors <= arguments.errors; ++errors)
+    {
+        search_defaults.errors = static_cast<uint8_t>(errors);
+        for (auto const & [tau, p_max] : tau_p_max)
+        {
+            search_defaults.tau = tau;
+            search_defaults.p_max = p_max;
+            thresholds.add(search_defaults.make_threshold_parameters());
+        }
+    }
+    return thresholds;
+}
+
+} // anonymous namespace
+
 void valik_build(build_arguments const & arguments)
 {
     if (arguments.verbose)
@@ -17,9 +49,29 @@ void valik_build(build_arguments const & arguments)
         std::cout << "FPR " << std::to_string(arguments.fpr) << '\n'; 
     }
 
+    precomputed_thresholds thresholds = precompute_thresholds(arguments);
+
     index_factory generator{arguments};
+    if (arguments.hierarchical)
+    {
+        auto index = generator.hierarchical();
+        index.thresholds() = std::move(thresholds);
+        store_index(arguments.out_path, index);
+        return;
+    }
+
     auto index = generator();
-    store_index(arguments.out_path, index);
+    index.thresholds() = std::move(thresholds);
+    if (arguments.shards > 1)
+        store_sharded_index(arguments.out_path, index, arguments.shards);
+    else if (arguments.index_version == 2)
+        store_sectioned_index(arguments.out_path, index);
+    else if (arguments.mapped_index)
+        store_mapped_index(arguments.out_path, index);
+    else if (arguments.compressed)
+        store_index(arguments.out_path, valik_index<index_structure::ibf_compressed>{index});
+    else
+        store_index(arguments.out_path, index);
     return;
 }
 
@@ -5,13 +5,14 @@
 #include <valik/argument_parsing/search.hpp>
 #include <valik/argument_parsing/shared.hpp>
 #include <valik/argument_parsing/top_level.hpp>
+#include <valik/argument_parsing/update.hpp>
 #include <valik/valik.hpp>
 
 int main(int argc, char ** argv)
 {
     try
     {
-        sharg::parser top_level_parser{"dream-stellar", argc, argv, sharg::update_notifications::off, {"build", "search"}};
+        sharg::parser top_level_parser{"dream-stellar", argc, argv, sharg::update_notifications::off, {"build", "search", "update"}};
         valik::app::init_top_level_parser(top_level_parser);
 
         valik::app::try_parsing(top_level_parser);
@@ -21,6 +22,8 @@ int main(int argc, char ** argv)
             valik::app::run_build(sub_parser);
         else if (sub_parser.info.app_name == std::string_view{"dream-stellar-search"})
             valik::app::run_search(sub_parser);
+        else if (sub_parser.info.app_name == std::string_view{"dream-stellar-update"})
+            valik::app::run_update(sub_parser);
         else
             throw sharg::parser_error{"Unhandled subcommand"};
     }
@@ -24,8 +24,27 @@ void runtime_to_compile_time(func_t const & func, bool b1, bs_t... bs)
     }, bs...);
 }
 
+/**
+ * @brief Function that calls func with the IBF type that matches the layout of the stored index.
+ */
+template <typename func_t>
+void index_structure_to_compile_time(func_t const & func, search_arguments const & arguments)
+{
+    if (arguments.mapped_index)
+        func.template operator()<index_structure::mapped_ibf>();
+    else if (arguments.compressed)
+        func.template operator()<index_structure::ibf_compressed>();
+    else if (arguments.hierarchical)
+        func.template operator()<index_structure::hibf>();
+    else if (arguments.sharded)
+        func.template operator()<index_structure::sharded_ibf>();
+    else
+        func.template operator()<index_structure::ibf>();
+}
+
 /**
  * @brief Function that loads the index and launches local or distributed search.
+ *        With --prefilter-only the queries are only prefiltered and the hits are written to a file.
  *
  * @param arguments Command line arguments.
  */
@@ -41,21 +60,42 @@ void valik_search(search_arguments & arguments)
     }
 
     bool failed;
-    if (arguments.distribute)
+    if (arguments.prefilter_only)
     {
-        runtime_to_compile_time([&]<bool stellar_only>()
+        index_structure_to_compile_time([&]<typename index_structure_t>()
         {
-            failed = search_distributed<stellar_only>(arguments, time_statistics);
-        }, (arguments.search_type == search_kind::STELLAR));
+            runtime_to_compile_time([&]<bool is_split>()
+            {
+                failed = search_prefilter_only<index_structure_t, is_split>(arguments, time_statistics);
+            }, arguments.split_query);
+        }, arguments);
+
+        if (arguments.write_time)
+            write_time_statistics(time_statistics, arguments.prefilter_hits_file.string() + ".time", arguments);
+
+        if (failed)
+            throw std::runtime_error("valik_search failed. Run didn't complete correctly.");
+        return;
     }
-    // Shared memory execution
-    else
+
+    index_structure_to_compile_time([&]<typename index_structure_t>()
     {
-        runtime_to_compile_time([&]<bool is_split, bool stellar_only>()
+        if (arguments.distribute)
         {
-            failed = search_local<is_split, stellar_only>(arguments, time_statistics);
-        }, arguments.split_query, (arguments.search_type == search_kind::STELLAR));
-    }
+            runtime_to_compile_time([&]<bool stellar_only>()
+            {
+                failed = search_distributed<index_structure_t, stellar_only>(arguments, time_statistics);
+            }, (arguments.search_type == search_kind::STELLAR));
+        }
+        // Shared memory execution
+        else
+        {
+            runtime_to_compile_time([&]<bool is_split, bool stellar_only>()
+            {
+                failed = search_local<index_structure_t, is_split, stellar_only>(arguments, time_statistics);
+            }, arguments.split_query, (arguments.search_type == search_kind::STELLAR));
+        }
+    }, arguments);
 
     // Consolidate matches (not necessary when searching a metagenomic database)
     auto start = std::chrono::high_resolution_clock::now();
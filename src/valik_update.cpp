@@ -0,0 +1,319 @@
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+#include <seqan3/search/views/minimiser_hash.hpp>
+
+#include <utilities/prepare/compute_bin_size.hpp>
+#include <utilities/prepare/minimiser_counter.hpp>
+#include <utilities/prepare/parse_bin_paths.hpp>
+#include <valik/build/call_parallel_on_bins.hpp>
+#include <valik/build/store_index.hpp>
+#include <valik/ibf_geometry.hpp>
+#include <valik/search/load_index.hpp>
+#include <valik/split/metadata.hpp>
+#include <valik/update/update.hpp>
+
+namespace valik::app
+{
+
+namespace
+{
+
+using sequence_file_t = seqan3::sequence_file_input<dna4_traits, seqan3::fields<seqan3::field::seq>>;
+
+auto hash_view(valik_index<> const & index)
+{
+    return seqan3::views::minimiser_hash(index.shape(),
+                                         seqan3::window_size{index.window_size()},
+                                         seqan3::seed{adjust_seed(index.shape().count())});
+}
+
+/**
+ * @brief Function that estimates the number of values in each bin from the fraction of set bits.
+ */
+std::vector<double> estimate_bin_elements(index_structure::ibf const & ibf)
+{
+    detail::ibf_geometry const geometry{ibf};
+    std::vector<size_t> set_bits(geometry.technical_bins, 0);
+    uint64_t const * const words = ibf.raw_data().data();
+    for (size_t i = 0; i < geometry.word_count(); ++i)
+        for (uint64_t word = words[i]; word != 0; word &= word - 1)
+            ++set_bits[((i % geometry.bin_words) << 6) + std::countr_zero(word)];
+
+    std::vector<double> elements(geometry.bins);
+    double const bin_size = geometry.bin_size;
+    for (size_t bin = 0; bin < geometry.bins; ++bin)
+    {
+        double const fill = std::min<double>(set_bits[bin], bin_size - 1) / bin_size;
+        elements[bin] = -bin_size / geometry.hash_funs * std::log1p(-fill);
+    }
+    return elements;
+}
+
+//!\brief Expected false positive rate of a bin that contains the given number of values.
+double bin_fpr(double const elements, size_t const bin_size, size_t const hash_count)
+{
+    return std::pow(1.0 - std::exp(-(hash_count * elements) / bin_size), hash_count);
+}
+
+//!\brief Path of the .minimiser or .header file that build --fast writes for a sequence file.
+std::string minimiser_path(std::filesystem::path const & dir, std::filesystem::path const & bin_file, std::string const & extension)
+{
+    return dir / bin_file.stem().replace_extension(extension);
+}
+
+/**
+ * @brief Function that reads the .header file of a bin and checks that it belongs to the index.
+ */
+minimiser_header read_bin_header(valik_index<> const & index, std::filesystem::path const & header_path)
+{
+    if (!std::filesystem::exists(header_path))
+        throw std::runtime_error{"The index was built with --fast and updating it requires " + header_path.string() + "."};
+
+    minimiser_header const header = read_minimiser_header(header_path);
+    if (header.shape != index.shape().to_string() || header.window_size != index.window_size())
+        throw std::runtime_error{"The minimisers in " + header_path.string() + " do not match the shape and window of the index."};
+    return header;
+}
+
+/**
+ * @brief Function that counts the distinct minimisers of each bin. Counting is bounded by the memory budget of a thread
+ *        and spills to the output directory otherwise.
+ */
+std::vector<size_t> count_minimisers(valik_index<> const & index, update_arguments const & arguments)
+{
+    std::filesystem::path const spill_dir = arguments.out_path.parent_path();
+    size_t const thread_memory_bytes = arguments.minimiser_memory_bytes / arguments.threads;
+    std::vector<size_t> counts(arguments.add_bin_path.size(), 0);
+    auto count_worker = [&] (auto && zipped_view, auto &&)
+    {
+        for (auto && [file_name, bin_number] : zipped_view)
+        {
+            minimiser_counter counter{minimiser_path(spill_dir, file_name, "spill"), thread_memory_bytes};
+            for (auto && record : sequence_file_t{file_name})
+                for (auto && value : record.sequence() | hash_view(index))
+                    counter.insert(value);
+            counter.for_each_count([&](uint64_t const, uint8_t const) { ++counts[bin_number]; });
+        }
+    };
+
+    call_parallel_on_bins(count_worker, arguments.add_bin_path, arguments.threads);
+    return counts;
+}
+
+/**
+ * @brief Function that writes the filtered minimisers of the new bins of an index built with --fast. The minimisers are
+ *        counted and filtered like in build.
+ */
+void compute_new_minimisers(valik_index<> const & index,
+                            metadata const & meta,
+                            update_arguments const & arguments,
+                            std::filesystem::path const & minimiser_dir)
+{
+    build_arguments minimiser_arguments{};
+    minimiser_arguments.shape = index.shape();
+    minimiser_arguments.shape_weight = index.shape().count();
+    minimiser_arguments.window_size = index.window_size();
+    minimiser_arguments.threads = arguments.threads;
+    minimiser_arguments.out_dir = minimiser_dir;
+    minimiser_arguments.minimiser_memory_bytes = arguments.minimiser_memory_bytes;
+    minimiser_arguments.kmer_count_min_cutoff = meta.cutoffs->min;
+    minimiser_arguments.kmer_count_max_cutoff = meta.cutoffs->max;
+    minimiser_arguments.use_filesize_dependent_cutoff = meta.cutoffs->filesize_dependent;
+
+    raptor::compute_minimiser(minimiser_arguments, arguments.add_bin_path);
+}
+
+/**
+ * @brief Function that inserts the bins [first_bin, bin_files.size()) into the IBF. Empty bins are skipped.
+ *
+ * @param bin_files Sequence file of each bin or, if from_minimiser, its .minimiser file.
+ */
+void insert_bins(valik_index<> & index,
+                 metadata const & meta,
+                 std::vector<std::string> const & bin_files,
+                 size_t const first_bin,
+                 bool const from_minimiser,
+                 uint8_t const threads)
+{
+    auto & ibf = index.ibf();
+    detail::ibf_geometry const geometry{ibf};
+    uint64_t * const ibf_words = ibf.raw_data().data();
+
+    std::vector<std::string> const bin_path(bin_files.begin() + first_bin, bin_files.end());
+    auto insert_worker = [&] (auto && zipped_view, auto &&)
+    {
+        for (auto && [file_name, bin_number] : zipped_view)
+        {
+            size_t const bin = first_bin + bin_number;
+            if (meta.segments[bin].len == 0)
+                continue;
+
+            if (from_minimiser)
+            {
+                std::ifstream fin{file_name, std::ios::binary};
+                uint64_t value;
+                while (fin.read(reinterpret_cast<char *>(&value), sizeof(value)))
+                    geometry.emplace(ibf_words, value, bin);
+            }
+            else
+            {
+                for (auto && record : sequence_file_t{file_name})
+                    for (auto && value : record.sequence() | hash_view(index))
+                        geometry.emplace(ibf_words, value, bin);
+            }
+        }
+    };
+
+    call_parallel_on_bins(insert_worker, bin_path, threads);
+}
+
+} // anonymous namespace
+
+void valik_update(update_arguments const & arguments)
+{
+    if (is_mapped_index(arguments.index_file) || is_compressed_index(arguments.index_file) ||
+        is_hierarchical_index(arguments.index_file) || is_sharded_index(arguments.index_file))
+        throw std::runtime_error{"Only indices built without --mapped-index, --compressed, --hibf or --shards can be updated."};
+
+    valik_index<> index{};
+    load_index(index, arguments.index_file);
+    metadata meta(arguments.ref_meta_path);
+
+    if (index.bin_path().size() <= 1 || meta.files.size() != index.bin_path().size())
+        throw std::runtime_error{"Only the index of a metagenome database can be updated."};
+
+    auto & ibf = index.ibf();
+    size_t const hash_count = ibf.hash_function_count();
+
+    // an index built with --fast is filled from the filtered minimisers that build wrote next to the index
+    bool const from_minimiser = !index.entropy_ranking().empty();
+    std::filesystem::path const minimiser_dir = arguments.index_file.parent_path();
+    if (from_minimiser && !meta.cutoffs)
+        throw std::runtime_error{"The k-mer count cutoffs of the --fast index are unknown. Build the index again to update it."};
+
+    // ==========================================
+    // Clear bins.
+    // ==========================================
+    for (auto const & path : arguments.remove_bin_path)
+    {
+        auto it = std::ranges::find(index.bin_path(), path);
+        if (it == index.bin_path().end())
+            throw std::runtime_error{"Bin " + path + " is not part of the index."};
+
+        size_t const bin = it - index.bin_path().begin();
+        ibf.clear(seqan3::bin_index{bin});
+        meta.clear_segment(bin);
+    }
+
+    // ==========================================
+    // Append bins.
+    // ==========================================
+    size_t const old_bin_count = ibf.bin_count();
+    std::vector<size_t> new_counts{};
+    if (from_minimiser)
+    {
+        compute_new_minimisers(index, meta, arguments, minimiser_dir);
+        for (auto const & path : arguments.add_bin_path)
+            new_counts.push_back(read_bin_header(index, minimiser_path(minimiser_dir, path, "header")).count);
+    }
+    else
+    {
+        new_counts = count_minimisers(index, arguments);
+    }
+    meta.add_metagenome_bins(arguments.add_bin_path);
+    index.bin_path().insert(index.bin_path().end(), arguments.add_bin_path.begin(), arguments.add_bin_path.end());
+
+    // a --fast index is filled from the .minimiser file of each bin, the .header files of bins that are not empty
+    // give the number of minimisers in each bin
+    std::vector<std::string> bin_files{index.bin_path()};
+    std::vector<std::string> header_paths{};
+    std::vector<size_t> minimiser_counts{};
+    if (from_minimiser)
+    {
+        header_paths.resize(bin_files.size());
+        minimiser_counts.resize(bin_files.size());
+        for (size_t bin = 0; bin < bin_files.size(); ++bin)
+        {
+            if (meta.segments[bin].len > 0)
+            {
+                header_paths[bin] = minimiser_path(minimiser_dir, bin_files[bin], "header");
+                minimiser_counts[bin] = read_bin_header(index, header_paths[bin]).count;
+            }
+            bin_files[bin] = minimiser_path(minimiser_dir, bin_files[bin], "minimiser");
+        }
+    }
+
+    bool const exceeds_fpr = std::ranges::any_of(new_counts, [&](size_t const count)
+    {
+        return bin_fpr(count, ibf.bin_size(), hash_count) > meta.ibf_fpr;
+    });
+
+    if (exceeds_fpr)
+    {
+        // rebuild the IBF with a bin size that fits the largest bin
+        // the old bins of a --fast index are inserted from their minimiser files and never hashed from sequence again
+        double max_elements{1.0};
+        if (from_minimiser)
+        {
+            for (size_t bin = 0; bin < old_bin_count; ++bin)
+            {
+                if (header_paths[bin].empty())
+                    continue;
+                if (!std::filesystem::exists(bin_files[bin]))
+                    throw std::runtime_error{"Rebuilding the IBF of the --fast index requires " + bin_files[bin] + "."};
+                max_elements = std::max<double>(max_elements, minimiser_counts[bin]);
+            }
+        }
+        else
+        {
+            std::vector<double> const old_elements = estimate_bin_elements(ibf);
+            for (size_t bin = 0; bin < old_bin_count; ++bin)
+                if (meta.segments[bin].len > 0)
+                    max_elements = std::max(max_elements, old_elements[bin]);
+        }
+        for (size_t const count : new_counts)
+            max_elements = std::max<double>(max_elements, count);
+
+        size_t const bits = seqan::hibf::build::bin_size_in_bits({.fpr = meta.ibf_fpr,
+                                                                  .hash_count = hash_count,
+                                                                  .elements = static_cast<size_t>(std::ceil(max_elements))});
+        if (arguments.verbose)
+            std::cout << "New bins exceed the FPR of the IBF. Rebuilding with " << bits << " bits per bin.\n";
+
+        ibf = index_structure::ibf{seqan3::bin_count{index.bin_path().size()},
+                                   seqan3::bin_size{bits},
+                                   seqan3::hash_function_count{hash_count}};
+        insert_bins(index, meta, bin_files, 0u, from_minimiser, arguments.threads);
+    }
+    else if (!arguments.add_bin_path.empty())
+    {
+        ibf.increase_bin_number_to(seqan3::bin_count{index.bin_path().size()});
+        insert_bins(index, meta, bin_files, old_bin_count, from_minimiser, arguments.threads);
+    }
+
+    // ==========================================
+    // Update the entropy ranking like build does.
+    // ==========================================
+    if (from_minimiser)
+        index.entropy_ranking() = entropy_ranking_from_headers(header_paths);
+    if (arguments.verbose)
+    {
+        std::cout << "\n-----------Updated index-----------\n";
+        std::cout << "bins " << ibf.bin_count() << '\n';
+        std::cout << "cleared bins " << arguments.remove_bin_path.size() << '\n';
+        std::cout << "IBF size " << ibf.bin_size() << " bits\n";
+    }
+
+    std::filesystem::path out_meta_path{arguments.out_path};
+    out_meta_path.replace_extension("bin");
+    if (is_sectioned_index(arguments.index_file))
+        store_sectioned_index(arguments.out_path, index);
+    else
+        store_index(arguments.out_path, index);
+    meta.save(out_meta_path);
+}
+
+} // namespace valik::app
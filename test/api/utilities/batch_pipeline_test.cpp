@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <utilities/batch_pipeline.hpp>
+
+TEST(batch_pipeline, batches_by_bytes)
+{
+    std::vector<std::string> processed{};
+    std::vector<size_t> batch_sizes{};
+    valik::run_batch_pipeline<std::string>([] (valik::batch_builder<std::string> & builder)
+                                           {
+                                               // a long record fills a batch on its own
+                                               for (size_t i{0}; i < 100u; ++i)
+                                               {
+                                                   std::string record(i % 10 == 0 ? 50u : 5u, 'A' + i % 26);
+                                                   size_t const bytes = record.size();
+                                                   EXPECT_TRUE(builder.add(std::move(record), bytes));
+                                               }
+                                           },
+                                           [&] (std::vector<std::string> const & batch)
+                                           {
+                                               batch_sizes.push_back(batch.size());
+                                               processed.insert(processed.end(), batch.begin(), batch.end());
+                                           },
+                                           20u,
+                                           2u);
+
+    ASSERT_EQ(processed.size(), 100u);
+    for (size_t i{0}; i < 100u; ++i)
+        EXPECT_EQ(processed[i], std::string(i % 10 == 0 ? 50u : 5u, 'A' + i % 26));
+
+    EXPECT_EQ(batch_sizes.front(), 1u);
+    for (size_t const size : batch_sizes)
+        EXPECT_LE(size, 4u);
+}
+
+TEST(batch_pipeline, rethrows_read_error)
+{
+    size_t processed{0};
+    auto read = [] (valik::batch_builder<int> & builder)
+    {
+        for (int i{0}; i < 10; ++i)
+            builder.add(int{i}, 1u);
+        throw std::runtime_error{"read failed"};
+    };
+    EXPECT_THROW(valik::run_batch_pipeline<int>(read,
+                                                [&] (std::vector<int> const & batch) { processed += batch.size(); },
+                                                2u,
+                                                1u),
+                 std::runtime_error);
+    EXPECT_EQ(processed, 10u);
+}
+
+TEST(batch_pipeline, stops_reader_on_process_error)
+{
+    size_t read_records{0};
+    auto read = [&] (valik::batch_builder<int> & builder)
+    {
+        for (int i{0}; i < 1000000; ++i)
+        {
+            ++read_records;
+            if (!builder.add(int{i}, 1u))
+                return;
+        }
+    };
+    EXPECT_THROW(valik::run_batch_pipeline<int>(read,
+                                                [] (std::vector<int> const &) { throw std::runtime_error{"process failed"}; },
+                                                10u,
+                                                2u),
+                 std::runtime_error);
+    // the reader is at most a few batches ahead when the error stops it
+    EXPECT_LT(read_records, 1000u);
+}
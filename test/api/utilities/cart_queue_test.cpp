@@ -0,0 +1,388 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <utilities/cart_queue.hpp>
+
+template <typename queue_t>
+struct cart_queue_test : public ::testing::Test
+{};
+
+using queue_types = ::testing::Types<cart_queue<size_t>, lock_free_cart_queue<size_t>>;
+TYPED_TEST_SUITE(cart_queue_test, queue_types);
+
+TYPED_TEST(cart_queue_test, every_value_is_dequeued_once)
+{
+    size_t constexpr bin_count{7u};
+    size_t constexpr cart_max_capacity{5u};
+    size_t constexpr values_per_producer{10000u};
+    size_t constexpr producer_count{4u};
+    TypeParam queue{bin_count, cart_max_capacity, 4u};
+
+    std::mutex mutex;
+    std::vector<size_t> seen(producer_count * values_per_producer, 0u);
+    {
+        std::vector<std::jthread> consumers;
+        for (size_t c{0}; c < 3u; ++c)
+            consumers.emplace_back([&] ()
+            {
+                for (auto next = queue.dequeue(); next; next = queue.dequeue())
+                {
+                    auto const & [bin_id, cart] = *next;
+                    EXPECT_LE(cart.size(), cart_max_capacity);
+                    EXPECT_FALSE(cart.empty());
+                    std::lock_guard lk{mutex};
+                    for (size_t const value : cart)
+                    {
+                        EXPECT_EQ(value % bin_count, static_cast<size_t>(bin_id));
+                        ++seen[value];
+                    }
+                }
+            });
+
+        {
+            std::vector<std::jthread> producers;
+            for (size_t p{0}; p < producer_count; ++p)
+                producers.emplace_back([&, p] ()
+                {
+                    for (size_t i{0}; i < values_per_producer; ++i)
+                    {
+                        size_t const value = p * values_per_producer + i;
+                        queue.insert(value % bin_count, value);
+                    }
+                });
+        }
+        queue.finish();
+    }
+
+    for (size_t const count : seen)
+        EXPECT_EQ(count, 1u);
+}
+
+TYPED_TEST(cart_queue_test, finish_without_values)
+{
+    TypeParam queue{3u, 10u, 2u};
+    queue.finish();
+    EXPECT_FALSE(queue.dequeue().has_value());
+}
+
+TYPED_TEST(cart_queue_test, cart_capacity_follows_reported_durations)
+{
+    TypeParam queue{2u, 4u, 10u};
+    queue.adapt_cart_capacity(1.0, 2u, 16u);
+
+    // 4 values took 4 seconds, i.e. the capacity moves from 4 toward 1 and is clamped to 2
+    queue.report_cart_duration(0u, 4u, 4.0);
+    for (size_t value{0}; value < 3u; ++value)
+        queue.insert(0u, value);
+    // the capacity of the other bin is unchanged
+    for (size_t value{0}; value < 4u; ++value)
+        queue.insert(1u, value);
+    queue.finish();
+
+    std::vector<std::vector<size_t>> bin_carts(2u);
+    for (auto next = queue.dequeue(); next; next = queue.dequeue())
+    {
+        auto const & [bin_id, cart] = *next;
+        bin_carts[bin_id].push_back(cart.size());
+    }
+    std::ranges::sort(bin_carts[0]);
+    EXPECT_EQ(bin_carts[0], (std::vector<size_t>{1u, 2u}));
+    EXPECT_EQ(bin_carts[1], (std::vector<size_t>{4u}));
+}
+
+TYPED_TEST(cart_queue_test, cart_capacity_of_each_bin_adapts)
+{
+    TypeParam queue{3u, 8u, 10u};
+    queue.report_cart_duration(0u, 8u, 100.0);
+    EXPECT_EQ(queue.capacity(0u), 8u) << "a fixed capacity does not adapt";
+
+    queue.adapt_cart_capacity(0.01, 1u, 64u);
+    // consumers report durations below a second
+    queue.report_cart_duration(0u, 8u, 0.08);     // ideal capacity 1
+    queue.report_cart_duration(1u, 8u, 0.0025);   // ideal capacity 32
+    EXPECT_EQ(queue.capacity(0u), 3u);
+    EXPECT_EQ(queue.capacity(1u), 16u);
+    EXPECT_EQ(queue.capacity(2u), 8u);
+
+    queue.report_cart_duration(1u, 16u, 0.0);
+    EXPECT_EQ(queue.capacity(1u), 32u);
+    queue.report_cart_duration(1u, 0u, 1.0);
+    EXPECT_EQ(queue.capacity(1u), 32u) << "an empty cart is not reported";
+}
+
+TEST(cart_capacity, moves_toward_target_duration)
+{
+    cart_capacity capacity{1u, 100u};
+    capacity.report(0u, 100u, 10.0);
+    EXPECT_EQ(capacity(0u), 100u) << "a fixed capacity does not adapt";
+
+    capacity.adapt(1.0, 1u, 1000u);
+    capacity.report(0u, 100u, 0.25);   // ideal capacity 400
+    EXPECT_EQ(capacity(0u), 200u);
+    capacity.report(0u, 200u, 0.5);    // ideal capacity 400
+    EXPECT_EQ(capacity(0u), 283u);
+    capacity.report(0u, 283u, 28.3);   // ideal capacity 10
+    EXPECT_EQ(capacity(0u), 53u);
+    capacity.report(0u, 53u, 0.0);
+    EXPECT_EQ(capacity(0u), 230u);
+    for (size_t i{0}; i < 10u; ++i)
+        capacity.report(0u, capacity(0u), 1e-6);
+    EXPECT_EQ(capacity(0u), 1000u);
+}
+
+TEST(mpmc_ring, fifo_and_bounded)
+{
+    mpmc_ring<int> ring{5u};
+    EXPECT_EQ(ring.capacity(), 4u);
+    for (int i{0}; i < 4; ++i)
+    {
+        int value{i};
+        EXPECT_TRUE(ring.try_push(value));
+    }
+    int rejected{4};
+    EXPECT_FALSE(ring.try_push(rejected));
+    EXPECT_EQ(rejected, 4);
+
+    for (int i{0}; i < 4; ++i)
+        EXPECT_EQ(ring.try_pop(), i);
+    EXPECT_FALSE(ring.try_pop().has_value());
+}
+
+TEST(cart_queue, newest_cart_first_without_cost)
+{
+    cart_queue<size_t> queue{3u, 1u, 10u};
+    for (size_t bin{0}; bin < 3u; ++bin)
+        queue.insert(bin, bin);
+    queue.finish();
+
+    for (int bin{2}; bin >= 0; --bin)
+    {
+        auto next = queue.dequeue();
+        ASSERT_TRUE(next.has_value());
+        EXPECT_EQ(std::get<0>(*next), bin);
+    }
+    EXPECT_FALSE(queue.dequeue().has_value());
+}
+
+TEST(cart_queue, most_expensive_cart_first)
+{
+    // the cost of a cart is the sum of its values times the length of the bin
+    std::vector<double> const bin_length{1.0, 10.0, 2.0};
+    auto cost = [&] (size_t const bin_id, std::vector<size_t> const & cart)
+    {
+        return std::accumulate(cart.begin(), cart.end(), 0.0) * bin_length[bin_id];
+    };
+    cart_queue<size_t> queue{3u, 2u, 10u, cost, 1u};
+    queue.insert(0u, 100u);
+    queue.insert(0u, 100u);   // cost 200
+    queue.insert(1u, 1u);
+    queue.insert(1u, 2u);     // cost 30
+    queue.insert(2u, 50u);
+    queue.insert(2u, 60u);    // cost 220
+    queue.insert(1u, 7u);     // partial cart, cost 70
+    queue.finish();
+
+    std::vector<int> order{};
+    for (auto next = queue.dequeue(); next; next = queue.dequeue())
+        order.push_back(std::get<0>(*next));
+    EXPECT_EQ(order, (std::vector<int>{2, 0, 1, 1}));
+}
+
+TEST(cart_queue, finish_splits_expensive_partial_carts)
+{
+    auto cost = [] (size_t, std::vector<size_t> const & cart)
+    {
+        return static_cast<double>(cart.size());
+    };
+    // 4 consumers share the work of 8 values, i.e. no part should hold more than 2 values
+    cart_queue<size_t> queue{2u, 100u, 10u, cost, 4u};
+    for (size_t value{0}; value < 8u; ++value)
+        queue.insert(0u, value);
+    queue.finish();
+
+    std::vector<size_t> values{};
+    size_t parts{0};
+    for (auto next = queue.dequeue(); next; next = queue.dequeue())
+    {
+        auto const & [bin_id, cart] = *next;
+        EXPECT_EQ(bin_id, 0);
+        EXPECT_LE(cart.size(), 2u);
+        values.insert(values.end(), cart.begin(), cart.end());
+        ++parts;
+    }
+    EXPECT_EQ(parts, 4u);
+    std::ranges::sort(values);
+    EXPECT_EQ(values, (std::vector<size_t>{0u, 1u, 2u, 3u, 4u, 5u, 6u, 7u}));
+}
+
+TEST(cart_queue, dequeue_prefers_bin)
+{
+    cart_queue<size_t> queue{3u, 1u, 10u};
+    queue.insert(0u, 0u);
+    queue.insert(1u, 1u);
+    queue.insert(2u, 2u);
+    queue.insert(1u, 4u);
+
+    // without a preference the newest cart comes first
+    auto next = queue.dequeue(3u);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(std::get<0>(*next), 1);
+    EXPECT_EQ(std::get<1>(*next), (std::vector<size_t>{4u}));
+
+    next = queue.dequeue(0u);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(std::get<0>(*next), 0);
+
+    // no cart of bin 0 is left, i.e. the consumer steals the newest cart
+    next = queue.dequeue(0u);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(std::get<0>(*next), 2);
+
+    next = queue.dequeue(1u);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(std::get<1>(*next), (std::vector<size_t>{1u}));
+
+    queue.finish();
+    EXPECT_FALSE(queue.dequeue(1u));
+}
+
+TEST(cart_queue, preferred_carts_keep_the_order_of_the_others)
+{
+    auto cost = [] (size_t, std::vector<size_t> const & cart)
+    {
+        return static_cast<double>(cart.front());
+    };
+    size_t constexpr bin_count{5u};
+    cart_queue<size_t> queue{bin_count, 1u, 100u, cost, 1u};
+    for (size_t value{0}; value < 40u; ++value)
+        queue.insert((value * 3u) % bin_count, value);
+
+    // the carts of the preferred bin come first, most expensive first
+    for (size_t expected : {39u, 34u, 29u, 24u})
+    {
+        auto next = queue.dequeue(2u);
+        ASSERT_TRUE(next);
+        EXPECT_EQ(std::get<0>(*next), 2);
+        EXPECT_EQ(std::get<1>(*next), (std::vector<size_t>{expected}));
+    }
+
+    queue.finish();
+    std::vector<size_t> values{};
+    for (auto next = queue.dequeue(); next; next = queue.dequeue())
+    {
+        auto const & [bin_id, cart] = *next;
+        EXPECT_EQ(static_cast<size_t>(bin_id), (cart.front() * 3u) % bin_count);
+        values.push_back(cart.front());
+    }
+    EXPECT_EQ(values.size(), 36u);
+    EXPECT_TRUE(std::ranges::is_sorted(values, std::greater{}));
+}
+
+TEST(lock_free_cart_queue, most_expensive_bin_first)
+{
+    std::vector<double> const bin_length{1.0, 10.0, 2.0};
+    auto cost = [&] (size_t const bin_id, std::vector<size_t> const & cart)
+    {
+        return std::accumulate(cart.begin(), cart.end(), 0.0) * bin_length[bin_id];
+    };
+    lock_free_cart_queue<size_t> queue{3u, 2u, 10u, cost, 1u};
+    queue.insert(0u, 100u);
+    queue.insert(0u, 100u);   // cost 200
+    queue.insert(1u, 1u);
+    queue.insert(1u, 2u);     // cost 30
+    queue.insert(2u, 50u);
+    queue.insert(2u, 60u);    // cost 220
+    queue.insert(1u, 7u);     // partial cart, cost 70
+    queue.finish();
+
+    std::vector<int> order{};
+    for (auto next = queue.dequeue(); next; next = queue.dequeue())
+        order.push_back(std::get<0>(*next));
+    EXPECT_EQ(order, (std::vector<int>{2, 0, 1, 1}));
+}
+
+TEST(lock_free_cart_queue, finish_splits_expensive_partial_carts)
+{
+    auto cost = [] (size_t, std::vector<size_t> const & cart)
+    {
+        return static_cast<double>(cart.size());
+    };
+    lock_free_cart_queue<size_t> queue{2u, 100u, 10u, cost, 4u};
+    for (size_t value{0}; value < 8u; ++value)
+        queue.insert(0u, value);
+    queue.finish();
+
+    size_t parts{0};
+    for (auto next = queue.dequeue(); next; next = queue.dequeue())
+    {
+        EXPECT_LE(std::get<1>(*next).size(), 2u);
+        ++parts;
+    }
+    EXPECT_EQ(parts, 4u);
+}
+
+TEST(lock_free_cart_queue, dequeue_prefers_bin)
+{
+    lock_free_cart_queue<size_t> queue{3u, 1u, 10u};
+    queue.insert(0u, 0u);
+    queue.insert(1u, 1u);
+    queue.insert(2u, 2u);
+    queue.insert(1u, 4u);
+
+    // the carts of a bin are taken in the order they were published
+    auto next = queue.dequeue(1u);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(std::get<0>(*next), 1);
+    EXPECT_EQ(std::get<1>(*next), (std::vector<size_t>{1u}));
+    next = queue.dequeue(1u);
+    ASSERT_TRUE(next);
+    EXPECT_EQ(std::get<1>(*next), (std::vector<size_t>{4u}));
+
+    // no cart of bin 1 is left, i.e. the consumer takes a cart of another bin
+    next = queue.dequeue(1u);
+    ASSERT_TRUE(next);
+    EXPECT_NE(std::get<0>(*next), 1);
+
+    queue.finish();
+    EXPECT_TRUE(queue.dequeue(1u));
+    EXPECT_FALSE(queue.dequeue(1u));
+}
+
+TEST(lock_free_cart_queue, thread_inserts_into_consecutive_queues)
+{
+    for (size_t round{0}; round < 3u; ++round)
+    {
+        lock_free_cart_queue<size_t> queue{2u, 10u, 4u};
+        queue.insert(round % 2u, round);
+        queue.finish();
+        auto next = queue.dequeue();
+        ASSERT_TRUE(next);
+        EXPECT_EQ(std::get<1>(*next), (std::vector<size_t>{round}));
+        EXPECT_FALSE(queue.dequeue());
+    }
+}
+
+TEST(search_cart_queue, selects_the_queue_at_runtime)
+{
+    for (bool const lock_free : {false, true})
+    {
+        search_cart_queue<size_t> queue{lock_free, 2u, 2u, 4u};
+        EXPECT_EQ(queue.queue.index(), lock_free ? 2u : 1u);
+        for (size_t value{0}; value < 5u; ++value)
+            queue.insert(value % 2u, value);
+        queue.finish();
+
+        std::vector<size_t> values{};
+        for (auto next = queue.dequeue(0u); next; next = queue.dequeue(0u))
+            values.insert(values.end(), std::get<1>(*next).begin(), std::get<1>(*next).end());
+        std::ranges::sort(values);
+        EXPECT_EQ(values, (std::vector<size_t>{0u, 1u, 2u, 3u, 4u}));
+    }
+}
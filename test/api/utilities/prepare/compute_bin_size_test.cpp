@@ -60,3 +60,49 @@ TEST_F(compute_bin_size, segment_db_no_count_cutoff)
         EXPECT_EQ(sequence_files_max_count, minimiser_files_max_count);    
     }
 }
+
+TEST_F(compute_bin_size, split_db_min_count_cutoff)
+{
+    size_t bin_count = 8;
+    valik::build_arguments arguments{};
+    arguments.bin_path = std::vector<std::string>{};
+    for (size_t b{0}; b < bin_count; b++)
+        arguments.bin_path.emplace_back(data("ref_" + std::to_string(b) + ".fasta"));
+    arguments.shape = seqan3::shape{seqan3::ungapped{8}};
+    arguments.window_size = 10;
+    arguments.input_is_minimiser = true;
+
+    auto minimiser_counts = [&](std::filesystem::path const & out_dir)
+    {
+        std::filesystem::create_directory(out_dir);
+        arguments.out_dir = out_dir;
+        raptor::compute_minimiser(arguments);
+        std::vector<size_t> counts{};
+        for (auto const & header_file : valik::parse_bin_paths(arguments, "header"))
+        {
+            std::ifstream header{header_file};
+            std::string shape_string{};
+            uint64_t window_size{};
+            size_t count{};
+            header >> shape_string >> window_size >> count;
+            counts.push_back(count);
+        }
+        return counts;
+    };
+
+    auto const all_counts = minimiser_counts("all");
+    EXPECT_EQ(raptor::compute_bin_size(arguments),
+              seqan::hibf::build::bin_size_in_bits({.fpr = arguments.fpr,
+                                                    .hash_count = arguments.hash,
+                                                    .elements = std::ranges::max(all_counts)}));
+
+    // most minimisers of a bin occur once
+    arguments.kmer_count_min_cutoff = 2;
+    auto const filtered_counts = minimiser_counts("filtered");
+    auto const filtered_files = valik::parse_bin_paths(arguments);
+    for (size_t b{0}; b < bin_count; b++)
+    {
+        EXPECT_LT(filtered_counts[b], all_counts[b]);
+        EXPECT_EQ(std::filesystem::file_size(filtered_files[b]), filtered_counts[b] * sizeof(uint64_t));
+    }
+}
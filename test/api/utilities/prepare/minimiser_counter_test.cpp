@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "../../../app_test.hpp"
+
+#include <map>
+#include <random>
+
+#include <utilities/prepare/minimiser_counter.hpp>
+
+struct minimiser_counter : public app_test
+{
+    static void check_counts(size_t const memory_bytes)
+    {
+        std::mt19937_64 gen{42};
+        std::map<uint64_t, size_t> expected{};
+        valik::minimiser_counter counter{"counts.spill", memory_bytes};
+        for (size_t i{0}; i < 100000; i++)
+        {
+            // frequent values and values that share the most significant bits
+            uint64_t value = (i % 3 == 0) ? gen() % 500 : gen();
+            if (i % 5 == 0)
+                value &= 0xFF000000000000FFULL;
+            expected[value]++;
+            counter.insert(value);
+        }
+
+        std::vector<std::pair<uint64_t, size_t>> actual{};
+        counter.for_each_count([&](uint64_t const hash, uint8_t const count) { actual.emplace_back(hash, count); });
+
+        ASSERT_EQ(expected.size(), actual.size());
+        size_t i{0};
+        for (auto const & [hash, count] : expected)
+        {
+            EXPECT_EQ(hash, actual[i].first);
+            EXPECT_EQ(std::min<size_t>(valik::minimiser_counter::max_count, count), actual[i].second);
+            i++;
+        }
+    }
+};
+
+TEST_F(minimiser_counter, in_memory)
+{
+    check_counts(1ULL << 24);
+}
+
+TEST_F(minimiser_counter, spilled)
+{
+    check_counts(1ULL << 14);
+    for (auto const & entry : std::filesystem::directory_iterator{std::filesystem::current_path()})
+        EXPECT_EQ(entry.path().string().find("counts.spill"), std::string::npos);
+}
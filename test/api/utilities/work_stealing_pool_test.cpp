@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include <utilities/work_stealing_pool.hpp>
+
+TEST(work_stealing_pool, runs_all_tasks)
+{
+    valik::work_stealing_pool pool{4u};
+    EXPECT_EQ(pool.thread_count(), 4u);
+
+    // the pool is reused for several batches like for several chunks of query records
+    std::vector<std::atomic<size_t>> counts(1000u);
+    for (size_t batch{0}; batch < 3u; ++batch)
+    {
+        std::vector<valik::work_stealing_pool::task_t> tasks;
+        for (size_t i{0}; i < counts.size(); ++i)
+            tasks.emplace_back([&counts, i] () { counts[i]++; });
+        pool.run(std::move(tasks));
+
+        for (auto const & count : counts)
+            EXPECT_EQ(count.load(), batch + 1u);
+    }
+}
+
+TEST(work_stealing_pool, rethrows_exception)
+{
+    valik::work_stealing_pool pool{2u};
+    std::atomic<size_t> finished{0};
+    std::vector<valik::work_stealing_pool::task_t> tasks;
+    for (size_t i{0}; i < 10u; ++i)
+        tasks.emplace_back([&finished, i] ()
+        {
+            if (i == 5u)
+                throw std::runtime_error{"task failed"};
+            finished++;
+        });
+
+    EXPECT_THROW(pool.run(std::move(tasks)), std::runtime_error);
+    EXPECT_EQ(finished.load(), 9u);
+
+    // the pool is still usable
+    pool.run({[&finished] () { finished++; }});
+    EXPECT_EQ(finished.load(), 10u);
+}
+
+TEST(work_stealing_pool, worker_id)
+{
+    valik::work_stealing_pool pool{3u};
+    EXPECT_EQ(valik::work_stealing_pool::worker_id(), valik::work_stealing_pool::not_a_worker);
+
+    // state indexed by the worker id is only touched by its worker
+    std::vector<size_t> counts(pool.thread_count());
+    std::atomic<size_t> invalid{0};
+    std::vector<valik::work_stealing_pool::task_t> tasks;
+    for (size_t i{0}; i < 300u; ++i)
+        tasks.emplace_back([&counts, &invalid] ()
+        {
+            size_t const worker = valik::work_stealing_pool::worker_id();
+            if (worker < counts.size())
+                counts[worker]++;
+            else
+                invalid++;
+        });
+    pool.run(std::move(tasks));
+
+    EXPECT_EQ(invalid.load(), 0u);
+    EXPECT_EQ(std::accumulate(counts.begin(), counts.end(), size_t{0}), 300u);
+}
+
+TEST(balanced_ranges, equal_weight)
+{
+    std::vector<size_t> const lengths{100, 1, 1, 1, 1, 50, 50, 1, 1, 94};
+    auto const ranges = valik::balanced_ranges(lengths.size(), 3u, [&lengths] (size_t const i) { return lengths[i]; });
+
+    std::vector<std::pair<size_t, size_t>> const expected{{0, 1}, {1, 7}, {7, 10}};
+    EXPECT_EQ(ranges, expected);
+}
+
+TEST(balanced_ranges, covers_all_items)
+{
+    std::vector<size_t> lengths(97u);
+    std::iota(lengths.begin(), lengths.end(), 0u);
+    auto const ranges = valik::balanced_ranges(lengths.size(), 16u, [&lengths] (size_t const i) { return lengths[i]; });
+
+    size_t begin{0};
+    for (auto const & [range_begin, range_end] : ranges)
+    {
+        EXPECT_EQ(range_begin, begin);
+        EXPECT_LT(range_begin, range_end);
+        begin = range_end;
+    }
+    EXPECT_EQ(begin, lengths.size());
+    EXPECT_LE(ranges.size(), 17u);
+
+    EXPECT_TRUE(valik::balanced_ranges(0u, 4u, [] (size_t const) { return 1u; }).empty());
+    EXPECT_EQ(valik::balanced_ranges(3u, 8u, [] (size_t const) { return 1u; }).size(), 3u);
+}
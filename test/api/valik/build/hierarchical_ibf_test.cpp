@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "../../../app_test.hpp"
+
+#include <random>
+#include <set>
+
+#include <valik/hierarchical_ibf.hpp>
+
+struct hierarchical_ibf : public app_test
+{
+    // a few large bins and many small bins
+    static std::vector<uint64_t> uneven_weights(size_t const bin_count)
+    {
+        std::vector<uint64_t> weights{};
+        for (size_t bin{0}; bin < bin_count; bin++)
+            weights.push_back((bin % 100 == 0) ? 100000u : 100u + bin);
+        return weights;
+    }
+};
+
+TEST_F(hierarchical_ibf, layout)
+{
+    auto const weights = uneven_weights(1000u);
+    valik::hierarchical_ibf const hibf{weights, {.max_bin_bits = 1u << 16, .hash_count = 2u, .fpr = 0.05, .tmax = 64u}};
+
+    EXPECT_EQ(hibf.bin_count(), weights.size());
+    std::multiset<uint64_t> user_bins{};
+    for (size_t ibf_idx{0}; ibf_idx < hibf.ibf_vector().size(); ibf_idx++)
+    {
+        auto const & user_bin_ids = hibf.ibf_bin_to_user_bin_id()[ibf_idx];
+        EXPECT_LE(user_bin_ids.size(), 64u);
+        EXPECT_EQ(user_bin_ids.size(), hibf.ibf_vector()[ibf_idx].bin_count());
+        for (size_t bin{0}; bin < user_bin_ids.size(); bin++)
+        {
+            if (user_bin_ids[bin] == valik::hierarchical_ibf::merged_bin)
+                EXPECT_GT(hibf.next_ibf_id()[ibf_idx][bin], ibf_idx);
+            else if (bin == 0 || user_bin_ids[bin - 1] != user_bin_ids[bin])
+                user_bins.insert(user_bin_ids[bin]);
+        }
+    }
+
+    // each user bin is stored in exactly one IBF
+    EXPECT_EQ(user_bins.size(), weights.size());
+    for (size_t bin{0}; bin < weights.size(); bin++)
+        EXPECT_EQ(user_bins.count(bin), 1u);
+
+    // a flat IBF would need the bin size of the largest bin for every bin
+    EXPECT_LT(hibf.bit_size(), weights.size() * (1u << 16));
+}
+
+TEST_F(hierarchical_ibf, no_false_negatives)
+{
+    auto const weights = uneven_weights(300u);
+    valik::hierarchical_ibf hibf{weights, {.max_bin_bits = 1u << 14, .hash_count = 2u, .fpr = 0.05, .tmax = 64u}};
+
+    std::mt19937_64 gen{42};
+    std::vector<std::vector<uint64_t>> values(weights.size());
+    for (size_t bin{0}; bin < weights.size(); bin++)
+    {
+        for (size_t i{0}; i < 20; i++)
+        {
+            values[bin].push_back(gen());
+            hibf.emplace(values[bin].back(), bin);
+        }
+    }
+
+    // descend from the top level to the user bin through all technical bins that contain the value
+    auto contains = [&](auto & self, size_t const ibf_idx, uint64_t const value, size_t const user_bin) -> bool
+    {
+        auto agent = hibf.ibf_vector()[ibf_idx].membership_agent();
+        auto const & result = agent.bulk_contains(value);
+        auto const & user_bin_ids = hibf.ibf_bin_to_user_bin_id()[ibf_idx];
+        for (size_t bin{0}; bin < user_bin_ids.size(); bin++)
+        {
+            if (!result[bin])
+                continue;
+            if (user_bin_ids[bin] == user_bin)
+                return true;
+            if (user_bin_ids[bin] == valik::hierarchical_ibf::merged_bin &&
+                self(self, hibf.next_ibf_id()[ibf_idx][bin], value, user_bin))
+                return true;
+        }
+        return false;
+    };
+
+    for (size_t bin{0}; bin < weights.size(); bin++)
+        for (uint64_t const value : values[bin])
+            EXPECT_TRUE(contains(contains, 0u, value, bin));
+}
+
+TEST_F(hierarchical_ibf, more_empty_bins_than_tmax)
+{
+    // e.g. sequences shorter than the window have no minimisers
+    std::vector<uint64_t> weights(200u, 0u);
+    std::fill_n(weights.begin(), 10u, 1000000u);
+    valik::hierarchical_ibf const hibf{weights, {.max_bin_bits = 1u << 16, .hash_count = 2u, .fpr = 0.05, .tmax = 64u}};
+
+    EXPECT_EQ(hibf.bin_count(), weights.size());
+    std::set<uint64_t> user_bins{};
+    for (size_t ibf_idx{0}; ibf_idx < hibf.ibf_vector().size(); ibf_idx++)
+    {
+        EXPECT_LE(hibf.ibf_bin_to_user_bin_id()[ibf_idx].size(), 64u);
+        for (uint64_t const user_bin : hibf.ibf_bin_to_user_bin_id()[ibf_idx])
+            if (user_bin != valik::hierarchical_ibf::merged_bin)
+                user_bins.insert(user_bin);
+    }
+    EXPECT_EQ(user_bins.size(), weights.size());
+
+    std::vector<uint64_t> const only_empty_bins(500u, 0u);
+    valik::hierarchical_ibf const empty_hibf{only_empty_bins, {.max_bin_bits = 1u << 10, .hash_count = 2u, .fpr = 0.05, .tmax = 2u}};
+    EXPECT_EQ(empty_hibf.bin_count(), only_empty_bins.size());
+}
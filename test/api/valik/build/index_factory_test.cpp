@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "../../../app_test.hpp"
+
+#include <fstream>
+#include <random>
+
+#include <seqan3/alphabet/nucleotide/dna4.hpp>
+#include <seqan3/utility/views/slice.hpp>
+
+#include <valik/build/index_factory.hpp>
+#include <valik/split/metadata.hpp>
+
+struct index_factory : public app_test
+{};
+
+TEST_F(index_factory, parallel_segments_equal_sequential_build)
+{
+    // a few sequences of different lengths that are split into more segments than fit into one word of the IBF
+    std::mt19937_64 gen{42};
+    std::vector<seqan3::dna4_vector> sequences(3u);
+    {
+        std::ofstream fasta{"ref.fasta"};
+        for (size_t i{0}; i < sequences.size(); i++)
+        {
+            for (size_t j{0}; j < 4000u + 1500u * i; j++)
+                sequences[i].push_back(seqan3::dna4{}.assign_rank(gen() % 4));
+
+            fasta << ">seq" << i << '\n';
+            for (auto const base : sequences[i])
+                fasta << seqan3::to_char(base);
+            fasta << '\n';
+        }
+    }
+
+    valik::build_arguments arguments{};
+    arguments.bin_path = {"ref.fasta"};
+    arguments.pattern_size = 50u;
+    arguments.seg_count = 150u;
+    arguments.shape = seqan3::ungapped{15u};
+    arguments.shape_weight = 15u;
+    arguments.window_size = 19u;
+    arguments.bits = 1u << 12;
+    arguments.hash = 2u;
+    arguments.threads = 4u;
+    arguments.ref_meta_path = "ref.bin";
+
+    valik::metadata meta{arguments};
+    meta.save(arguments.ref_meta_path);
+    ASSERT_EQ(meta.seg_count, arguments.seg_count);
+
+    // segments are hashed concurrently and overlapping segments of neighbouring bins share words
+    auto const index = valik::index_factory{arguments}();
+
+    seqan3::interleaved_bloom_filter<> expected{seqan3::bin_count{arguments.seg_count},
+                                                seqan3::bin_size{arguments.bits},
+                                                seqan3::hash_function_count{arguments.hash}};
+    auto minimiser_hash = seqan3::views::minimiser_hash(arguments.shape,
+                                                        seqan3::window_size{arguments.window_size},
+                                                        seqan3::seed{valik::adjust_seed(arguments.shape_weight)});
+    for (size_t i{0}; i < sequences.size(); i++)
+        for (auto const & seg : meta.segments_from_ind(i))
+            for (uint64_t const value : sequences[i] | seqan3::views::slice(seg.start, seg.start + seg.len) | minimiser_hash)
+                expected.emplace(value, seqan3::bin_index{seg.id});
+
+    EXPECT_TRUE(index.ibf() == expected);
+}
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include <valik/search/counting_kernel.hpp>
+
+using valik::detail::counting_kernel;
+using valik::detail::simd_level;
+
+TEST(counting_kernel, levels_equal_scalar)
+{
+    size_t const word_count = 5u;
+    std::mt19937_64 gen{42};
+    std::vector<std::vector<uint64_t>> rows(100u, std::vector<uint64_t>(word_count));
+    for (auto & row : rows)
+        for (auto & word : row)
+            word = gen() & gen();
+    rows[3][2] = 0u;
+
+    counting_kernel const scalar = counting_kernel::for_level(simd_level::scalar);
+    for (simd_level const level : {simd_level::avx2, simd_level::avx512})
+    {
+        // unsupported levels fall back to a supported kernel
+        counting_kernel const kernel = counting_kernel::for_level(level);
+        EXPECT_LE(kernel.level, counting_kernel::supported_level());
+
+        std::vector<uint8_t> expected(word_count * 64u, 0u);
+        std::vector<uint8_t> actual(word_count * 64u, 0u);
+        for (auto const & row : rows)
+        {
+            scalar.add(expected.data(), row.data(), word_count);
+            kernel.add(actual.data(), row.data(), word_count);
+        }
+        for (size_t i{0}; i < 30u; i++)
+        {
+            scalar.subtract(expected.data(), rows[i].data(), word_count);
+            kernel.subtract(actual.data(), rows[i].data(), word_count);
+        }
+        EXPECT_EQ(expected, actual);
+
+        for (uint8_t const threshold : {0u, 10u, 20u, 30u, 255u})
+        {
+            std::vector<uint64_t> expected_mask(word_count);
+            std::vector<uint64_t> actual_mask(word_count);
+            scalar.above_threshold(expected.data(), word_count, threshold, expected_mask.data());
+            kernel.above_threshold(actual.data(), word_count, threshold, actual_mask.data());
+            EXPECT_EQ(expected_mask, actual_mask);
+
+            std::vector<uint8_t> expected_margins(word_count * 64u, 1u);
+            std::vector<uint8_t> actual_margins(word_count * 64u, 1u);
+            scalar.max_margin(expected.data(), word_count, threshold, expected_margins.data());
+            kernel.max_margin(actual.data(), word_count, threshold, actual_margins.data());
+            EXPECT_EQ(expected_margins, actual_margins);
+        }
+    }
+}
@@ -0,0 +1,329 @@
+#include <gtest/gtest.h>
+
+#include "../../../app_test.hpp"
+
+#include <random>
+
+#include <valik/batched_membership_agent.hpp>
+#include <valik/build/store_index.hpp>
+#include <valik/search/load_index.hpp>
+
+struct load_index : public app_test
+{
+    static valik::valik_index<> make_index(size_t const bin_count, size_t const bin_size, size_t const hash_count)
+    {
+        seqan3::interleaved_bloom_filter<> ibf{seqan3::bin_count{bin_count},
+                                               seqan3::bin_size{bin_size},
+                                               seqan3::hash_function_count{hash_count}};
+
+        std::mt19937_64 gen{42};
+        for (size_t bin{0}; bin < bin_count; bin++)
+            for (size_t i{0}; i < 50; i++)
+                ibf.emplace(gen(), seqan3::bin_index{bin});
+
+        std::vector<std::string> bin_path{};
+        for (size_t bin{0}; bin < bin_count; bin++)
+            bin_path.emplace_back("bin_" + std::to_string(bin) + ".fasta");
+
+        valik::valik_index<> index{valik::window{23u}, seqan3::shape{seqan3::ungapped{20u}}, bin_path, std::move(ibf)};
+        for (size_t bin{bin_count}; bin > 0; bin--)
+            index.entropy_ranking().push_back(bin - 1);
+        return index;
+    }
+};
+
+TEST_F(load_index, mapped_layout_parameters)
+{
+    auto const expected = make_index(130u, 1024u, 3u);
+    valik::store_mapped_index("mapped.index", expected);
+    EXPECT_TRUE(valik::is_mapped_index("mapped.index"));
+
+    valik::valik_index<valik::index_structure::mapped_ibf> actual{};
+    valik::load_index(actual, "mapped.index");
+
+    EXPECT_EQ(expected.window_size(), actual.window_size());
+    EXPECT_EQ(expected.shape(), actual.shape());
+    EXPECT_EQ(expected.bin_path(), actual.bin_path());
+    EXPECT_EQ(expected.entropy_ranking(), actual.entropy_ranking());
+    EXPECT_EQ(expected.ibf().bin_count(), actual.ibf().bin_count());
+    EXPECT_EQ(expected.ibf().bin_size(), actual.ibf().bin_size());
+    EXPECT_EQ(expected.ibf().hash_function_count(), actual.ibf().hash_function_count());
+
+    valik::valik_index<> parameters_only{};
+    valik::load_index_parameters(parameters_only, "mapped.index");
+    EXPECT_EQ(expected.window_size(), parameters_only.window_size());
+    EXPECT_EQ(expected.bin_path(), parameters_only.bin_path());
+}
+
+TEST_F(load_index, mapped_layout_queries)
+{
+    for (size_t hash_count : {1u, 2u, 5u})
+    {
+        auto const expected = make_index(64u, 256u, hash_count);
+        valik::store_mapped_index("mapped.index", expected);
+
+        valik::valik_index<valik::index_structure::mapped_ibf> actual{};
+        valik::load_index(actual, "mapped.index");
+
+        auto expected_agent = expected.ibf().membership_agent();
+        auto actual_agent = actual.ibf().membership_agent();
+        std::mt19937_64 gen{42};
+        for (size_t i{0}; i < 10000; i++)
+        {
+            size_t const value = (i % 2 == 0) ? gen() : i;
+            EXPECT_EQ(expected_agent.bulk_contains(value).raw_data(), actual_agent.bulk_contains(value).raw_data());
+        }
+    }
+}
+
+TEST_F(load_index, batched_queries)
+{
+    auto const expected = make_index(130u, 1024u, 3u);
+    valik::store_mapped_index("mapped.index", expected);
+    valik::store_sharded_index("sharded.index", expected, 3u);
+
+    valik::valik_index<valik::index_structure::mapped_ibf> mapped{};
+    valik::load_index(mapped, "mapped.index");
+    valik::valik_index<valik::index_structure::sharded_ibf> partial{};
+    valik::load_index(partial, "sharded.index", 1u, 1u);
+
+    // more values than the prefetch distance and fewer
+    for (size_t const value_count : {1000u, 5u})
+    {
+        std::mt19937_64 gen{value_count};
+        std::vector<uint64_t> values(value_count);
+        for (auto & value : values)
+            value = gen();
+
+        auto expected_agent = expected.ibf().membership_agent();
+        auto partial_agent = partial.ibf().membership_agent();
+        auto check = [&](auto const & ibf, auto & agent)
+        {
+            valik::batched_membership_agent batched_agent{ibf};
+            EXPECT_EQ(batched_agent.word_count(), 3u);
+            // filled with garbage to check that every word is written
+            std::vector<uint64_t> rows(values.size() * batched_agent.word_count(), -1ULL);
+            batched_agent.bulk_contains(values, rows.data());
+            for (size_t i{0}; i < values.size(); i++)
+            {
+                auto const & bits = agent.bulk_contains(values[i]).raw_data();
+                EXPECT_TRUE(std::equal(bits.data(), bits.data() + 3u, rows.data() + i * 3u));
+            }
+        };
+
+        check(expected.ibf(), expected_agent);
+        check(mapped.ibf(), expected_agent);
+        check(partial.ibf(), partial_agent);
+    }
+}
+
+TEST_F(load_index, archive_layout)
+{
+    auto const expected = make_index(8u, 128u, 2u);
+    valik::store_index("archive.index", expected);
+    EXPECT_FALSE(valik::is_mapped_index("archive.index"));
+
+    valik::valik_index<> actual{};
+    valik::load_index(actual, "archive.index");
+    EXPECT_TRUE(expected.ibf() == actual.ibf());
+    EXPECT_EQ(expected.entropy_ranking(), actual.entropy_ranking());
+}
+
+TEST_F(load_index, compressed_layout)
+{
+    auto const expected = make_index(130u, 1024u, 2u);
+    valik::store_index("compressed.index", valik::valik_index<valik::index_structure::ibf_compressed>{expected});
+    EXPECT_TRUE(valik::is_compressed_index("compressed.index"));
+    EXPECT_FALSE(valik::is_mapped_index("compressed.index"));
+
+    valik::valik_index<valik::index_structure::ibf_compressed> actual{};
+    valik::load_index(actual, "compressed.index");
+    EXPECT_EQ(expected.bin_path(), actual.bin_path());
+    EXPECT_EQ(expected.entropy_ranking(), actual.entropy_ranking());
+
+    auto expected_agent = expected.ibf().membership_agent();
+    auto actual_agent = actual.ibf().membership_agent();
+    std::mt19937_64 gen{42};
+    for (size_t i{0}; i < 1000; i++)
+    {
+        size_t const value = gen();
+        EXPECT_EQ(expected_agent.bulk_contains(value).raw_data(), actual_agent.bulk_contains(value).raw_data());
+    }
+
+    valik::valik_index<> parameters_only{};
+    valik::load_index_parameters(parameters_only, "compressed.index");
+    EXPECT_EQ(expected.window_size(), parameters_only.window_size());
+    EXPECT_EQ(expected.shape(), parameters_only.shape());
+}
+
+TEST_F(load_index, sharded_layout)
+{
+    auto const expected = make_index(130u, 1024u, 2u);
+    valik::store_sharded_index("sharded.index", expected, 3u);
+    EXPECT_TRUE(valik::is_sharded_index("sharded.index"));
+    EXPECT_FALSE(valik::is_mapped_index("sharded.index"));
+    for (size_t shard{0}; shard < 3; shard++)
+        EXPECT_TRUE(std::filesystem::exists("sharded." + std::to_string(shard) + ".shard"));
+
+    valik::valik_index<valik::index_structure::sharded_ibf> all{};
+    valik::load_index(all, "sharded.index");
+    EXPECT_EQ(expected.bin_path(), all.bin_path());
+    EXPECT_EQ(expected.entropy_ranking(), all.entropy_ranking());
+    EXPECT_EQ(expected.ibf().bin_count(), all.ibf().bin_count());
+    EXPECT_EQ(3u, all.ibf().shards().size());
+
+    // only the bins [64, 128) of the second shard are set
+    valik::valik_index<valik::index_structure::sharded_ibf> partial{};
+    valik::load_index(partial, "sharded.index", 1u, 1u);
+    EXPECT_EQ(1u, partial.ibf().shards().size());
+
+    auto expected_agent = expected.ibf().membership_agent();
+    auto all_agent = all.ibf().membership_agent();
+    auto partial_agent = partial.ibf().membership_agent();
+    std::mt19937_64 gen{42};
+    for (size_t i{0}; i < 1000; i++)
+    {
+        size_t const value = gen();
+        auto const & expected_bins = expected_agent.bulk_contains(value);
+        EXPECT_EQ(expected_bins.raw_data(), all_agent.bulk_contains(value).raw_data());
+
+        auto const & partial_bins = partial_agent.bulk_contains(value);
+        for (size_t bin{0}; bin < 130u; bin++)
+            EXPECT_EQ(bin >= 64u && bin < 128u && expected_bins[bin], partial_bins[bin]);
+    }
+
+    valik::valik_index<> parameters_only{};
+    valik::load_index_parameters(parameters_only, "sharded.index");
+    EXPECT_EQ(expected.window_size(), parameters_only.window_size());
+    EXPECT_EQ(expected.shape(), parameters_only.shape());
+
+    EXPECT_THROW(valik::load_index(partial, "sharded.index", 3u, 3u), sharg::validation_error);
+}
+
+TEST_F(load_index, sectioned_layout)
+{
+    auto const expected = make_index(130u, 1024u, 2u);
+    valik::store_sectioned_index("sectioned.index", expected);
+    EXPECT_TRUE(valik::is_sectioned_index("sectioned.index"));
+    EXPECT_FALSE(valik::is_mapped_index("sectioned.index"));
+
+    valik::valik_index<> actual{};
+    valik::load_index(actual, "sectioned.index");
+    EXPECT_EQ(expected.window_size(), actual.window_size());
+    EXPECT_EQ(expected.shape(), actual.shape());
+    EXPECT_EQ(expected.bin_path(), actual.bin_path());
+    EXPECT_EQ(expected.entropy_ranking(), actual.entropy_ranking());
+    EXPECT_TRUE(expected.ibf() == actual.ibf());
+
+    valik::valik_index<> parameters_only{};
+    valik::load_index_parameters(parameters_only, "sectioned.index");
+    EXPECT_EQ(expected.bin_path(), parameters_only.bin_path());
+
+    valik::sectioned_index_reader reader{"sectioned.index"};
+    EXPECT_EQ(expected.entropy_ranking(), reader.read_entropy_ranking());
+    EXPECT_FALSE(reader.read_section(valik::index_section::thresholds).has_value());
+    for (size_t block{0}; block < 3u; block++)
+    {
+        size_t const bin_count = std::min<size_t>(64u, 130u - block * 64u);
+        EXPECT_TRUE(valik::sharded_ibf::slice(expected.ibf(), block * 64u, bin_count) == reader.read_bin_block(block));
+    }
+}
+
+TEST_F(load_index, sectioned_layout_partial)
+{
+    auto const expected = make_index(130u, 1024u, 2u);
+    valik::store_sectioned_index("sectioned.index", expected);
+
+    // the bin blocks are loaded as shards; only the bins [64, 130) are set
+    valik::valik_index<valik::index_structure::sharded_ibf> partial{};
+    valik::load_index(partial, "sectioned.index", 1u, 2u);
+    EXPECT_EQ(expected.bin_path(), partial.bin_path());
+    EXPECT_EQ(expected.entropy_ranking(), partial.entropy_ranking());
+    EXPECT_EQ(expected.ibf().bin_count(), partial.ibf().bin_count());
+    ASSERT_EQ(2u, partial.ibf().shards().size());
+    EXPECT_EQ(2u, partial.ibf().shards()[1].ibf.bin_count());
+
+    auto expected_agent = expected.ibf().membership_agent();
+    auto partial_agent = partial.ibf().membership_agent();
+    std::mt19937_64 gen{42};
+    for (size_t i{0}; i < 1000; i++)
+    {
+        size_t const value = gen();
+        auto const & expected_bins = expected_agent.bulk_contains(value);
+        auto const & partial_bins = partial_agent.bulk_contains(value);
+        for (size_t bin{0}; bin < 130u; bin++)
+            EXPECT_EQ(bin >= 64u && expected_bins[bin], partial_bins[bin]);
+    }
+
+    EXPECT_THROW(valik::load_index(partial, "sectioned.index", 3u, 3u), sharg::validation_error);
+}
+
+TEST_F(load_index, sectioned_layout_checksum)
+{
+    valik::store_sectioned_index("sectioned.index", make_index(64u, 256u, 2u));
+    {
+        // flip a bit in the last bin block
+        std::fstream file{"sectioned.index", std::ios::binary | std::ios::in | std::ios::out};
+        file.seekg(-1, std::ios::end);
+        char const last = file.get() ^ 1;
+        file.seekp(-1, std::ios::end);
+        file.put(last);
+    }
+
+    valik::valik_index<> parameters_only{};
+    EXPECT_NO_THROW(valik::load_index_parameters(parameters_only, "sectioned.index"));
+    valik::valik_index<> actual{};
+    EXPECT_THROW(valik::load_index(actual, "sectioned.index"), sharg::validation_error);
+}
+
+TEST_F(load_index, threshold_tables)
+{
+    raptor::threshold::threshold_parameters parameters{.window_size = 23u,
+                                                       .shape = seqan3::shape{seqan3::ungapped{20u}},
+                                                       .query_length = 50u,
+                                                       .errors = 1u,
+                                                       .p_max = 0.15,
+                                                       .fpr = 0.05,
+                                                       .tau = 0.9999};
+    auto expected = make_index(130u, 1024u, 2u);
+    expected.thresholds().add(parameters);
+    EXPECT_FALSE(expected.thresholds().empty());
+
+    auto expect_thresholds = [&](valik::precomputed_thresholds const & thresholds)
+    {
+        EXPECT_FALSE(thresholds.empty());
+        // 2 errors are not stored and computed on demand
+        for (uint8_t errors : {1u, 2u})
+        {
+            parameters.errors = errors;
+            raptor::threshold::threshold const computed{parameters};
+            raptor::threshold::threshold const stored = thresholds.make_threshold(parameters);
+            for (size_t minimiser_count{0}; minimiser_count < 40u; minimiser_count++)
+                EXPECT_EQ(computed.get(minimiser_count), stored.get(minimiser_count));
+        }
+        parameters.errors = 1u;
+    };
+
+    valik::store_index("archive.index", expected);
+    valik::valik_index<> archive{};
+    valik::load_index(archive, "archive.index");
+    EXPECT_TRUE(expected.ibf() == archive.ibf());
+    expect_thresholds(archive.thresholds());
+
+    valik::store_mapped_index("mapped.index", expected);
+    valik::valik_index<valik::index_structure::mapped_ibf> mapped{};
+    valik::load_index(mapped, "mapped.index");
+    expect_thresholds(mapped.thresholds());
+
+    valik::store_sharded_index("sharded.index", expected, 3u);
+    valik::valik_index<valik::index_structure::sharded_ibf> sharded{};
+    valik::load_index(sharded, "sharded.index");
+    expect_thresholds(sharded.thresholds());
+
+    valik::store_sectioned_index("sectioned.index", expected);
+    EXPECT_TRUE(valik::sectioned_index_reader{"sectioned.index"}.read_section(valik::index_section::thresholds).has_value());
+    valik::valik_index<> sectioned{};
+    valik::load_index(sectioned, "sectioned.index");
+    EXPECT_TRUE(expected.ibf() == sectioned.ibf());
+    expect_thresholds(sectioned.thresholds());
+}
@@ -2,6 +2,8 @@
 
 #include "../../../app_test.hpp"
 
+#include <random>
+
 #include <valik/search/local_prefilter.hpp>
 #include <valik/shared.hpp>
 
@@ -14,6 +16,18 @@ struct pattern_begin_positions : public app_test
 struct make_pattern_bounds : public app_test
 {};
 
+struct pattern_counts : public app_test
+{};
+
+struct bin_hits : public app_test
+{};
+
+struct distinct_minimisers : public app_test
+{};
+
+struct hierarchical_prefilter : public app_test
+{};
+
 TEST_F(pattern_begin_positions, read_length_and_pattern_size_are_equal)
 {
     // edge case where read_len = pattern_size
@@ -299,3 +313,279 @@ TEST_F(make_pattern_bounds, odd_lengths)
     EXPECT_EQ(bounds.begin_position, expected.begin_position);
     EXPECT_EQ(bounds.end_position, expected.end_position);
 }
+
+TEST_F(pattern_counts, sliding_equals_recounting)
+{
+    size_t const bin_count = 130u;
+    seqan3::interleaved_bloom_filter<> ibf{seqan3::bin_count{bin_count},
+                                           seqan3::bin_size{256u},
+                                           seqan3::hash_function_count{2u}};
+    std::mt19937_64 gen{42};
+    for (size_t i{0}; i < 5000; i++)
+        ibf.emplace(gen() % 500u, seqan3::bin_index{gen() % bin_count});
+
+    using binning_bitvector_t = seqan3::interleaved_bloom_filter<>::membership_agent_type::binning_bitvector;
+    auto agent = ibf.membership_agent();
+    std::vector<binning_bitvector_t> rows(200u, binning_bitvector_t(bin_count));
+    valik::counting_matrix counting_table{};
+    counting_table.reset(rows.size(), bin_count);
+    for (size_t i{0}; i < rows.size(); i++)
+    {
+        rows[i].raw_data() |= agent.bulk_contains(gen() % 1000u).raw_data();
+        counting_table.assign_row(i, rows[i]);
+    }
+
+    // consecutive patterns, a small overlap, an unchanged pattern and a restart from the first pattern
+    std::vector<valik::pattern_bounds> const patterns{{0u, 40u, 0u}, {1u, 42u, 0u}, {5u, 44u, 0u}, {30u, 70u, 0u},
+                                                      {30u, 70u, 0u}, {60u, 100u, 0u}, {160u, 200u, 0u}, {0u, 40u, 0u}};
+    valik::pattern_counts counts{bin_count};
+    for (auto const & pattern : patterns)
+    {
+        seqan3::counting_vector<uint8_t> expected(bin_count, 0);
+        for (size_t i = pattern.begin_position; i < pattern.end_position; i++)
+            expected += rows[i];
+
+        auto const actual = counts.slide_to(pattern, counting_table);
+        EXPECT_TRUE(std::ranges::equal(expected, actual));
+
+        std::vector<size_t> expected_bins{};
+        for (size_t bin{0}; bin < bin_count; bin++)
+            if (expected[bin] >= 20u)
+                expected_bins.push_back(bin);
+        std::vector<size_t> actual_bins{};
+        counts.for_each_bin_above(20u, [&](size_t const bin) { actual_bins.push_back(bin); });
+        EXPECT_EQ(expected_bins, actual_bins);
+    }
+}
+
+TEST_F(pattern_counts, resize_for_another_ibf)
+{
+    // counts are reused for the IBFs of a hierarchy with different numbers of bins
+    std::mt19937_64 gen{11};
+    auto make_table = [&](size_t const bin_count)
+    {
+        seqan3::interleaved_bloom_filter<> ibf{seqan3::bin_count{bin_count},
+                                               seqan3::bin_size{128u},
+                                               seqan3::hash_function_count{2u}};
+        for (size_t i{0}; i < 2000; i++)
+            ibf.emplace(gen() % 300u, seqan3::bin_index{gen() % bin_count});
+
+        auto agent = ibf.membership_agent();
+        valik::counting_matrix counting_table{};
+        counting_table.reset(60u, bin_count);
+        for (size_t i{0}; i < 60u; i++)
+            counting_table.assign_row(i, agent.bulk_contains(gen() % 600u));
+        return counting_table;
+    };
+
+    valik::counting_matrix const large = make_table(130u);
+    valik::counting_matrix const small = make_table(70u);
+    std::vector<valik::pattern_bounds> const patterns{{0u, 30u, 0u}, {5u, 35u, 0u}, {20u, 60u, 0u}};
+
+    valik::pattern_counts counts{130u};
+    for (auto const & pattern : patterns)
+        counts.slide_to(pattern, large);
+
+    counts.resize(70u);
+    valik::pattern_counts expected{70u};
+    for (auto const & pattern : patterns)
+        EXPECT_TRUE(std::ranges::equal(expected.slide_to(pattern, small), counts.slide_to(pattern, small)));
+
+    counts.resize(130u);
+    valik::pattern_counts expected_large{130u};
+    EXPECT_TRUE(std::ranges::equal(expected_large.slide_to(patterns[2], large), counts.slide_to(patterns[2], large)));
+}
+
+TEST_F(pattern_counts, correction_from_margins)
+{
+    size_t const bin_count = 70u;
+    seqan3::interleaved_bloom_filter<> ibf{seqan3::bin_count{bin_count},
+                                           seqan3::bin_size{128u},
+                                           seqan3::hash_function_count{2u}};
+    std::mt19937_64 gen{7};
+    for (size_t i{0}; i < 3000; i++)
+        ibf.emplace(gen() % 300u, seqan3::bin_index{gen() % bin_count});
+
+    using binning_bitvector_t = seqan3::interleaved_bloom_filter<>::membership_agent_type::binning_bitvector;
+    auto agent = ibf.membership_agent();
+    std::vector<binning_bitvector_t> rows(100u, binning_bitvector_t(bin_count));
+    valik::counting_matrix counting_table{};
+    counting_table.reset(rows.size(), bin_count);
+    for (size_t i{0}; i < rows.size(); i++)
+    {
+        rows[i].raw_data() |= agent.bulk_contains(gen() % 600u).raw_data();
+        counting_table.assign_row(i, rows[i]);
+    }
+
+    std::vector<valik::pattern_bounds> const patterns{{0u, 30u, 10u}, {10u, 40u, 12u}, {20u, 50u, 8u}, {50u, 100u, 20u}};
+    valik::pattern_counts counts{bin_count};
+    counts.reset();
+    for (auto const & pattern : patterns)
+        valik::find_pattern_bins(pattern, counting_table, counts);
+
+    for (size_t correction{0}; correction < 20u; correction++)
+    {
+        // bins that reach the corrected threshold of at least one pattern
+        std::vector<size_t> expected{};
+        for (size_t bin{0}; bin < bin_count; bin++)
+        {
+            bool is_hit{false};
+            for (auto const & pattern : patterns)
+            {
+                size_t count{0};
+                for (size_t i = pattern.begin_position; i < pattern.end_position; i++)
+                    count += rows[i][bin];
+                is_hit |= count >= pattern.threshold + correction;
+            }
+            if (is_hit)
+                expected.push_back(bin);
+        }
+
+        std::vector<size_t> actual{};
+        counts.for_each_bin_with_correction(correction, [&](size_t const bin) { actual.push_back(bin); });
+        EXPECT_EQ(expected, actual);
+        EXPECT_EQ(expected.size(), counts.count_bins_with_correction(correction));
+    }
+}
+
+TEST_F(distinct_minimisers, shared_rows)
+{
+    size_t const bin_count = 100u;
+    seqan3::interleaved_bloom_filter<> ibf{seqan3::bin_count{bin_count},
+                                           seqan3::bin_size{256u},
+                                           seqan3::hash_function_count{2u}};
+    std::mt19937_64 gen{3};
+    for (size_t i{0}; i < 2000; i++)
+        ibf.emplace(gen() % 50u, seqan3::bin_index{gen() % bin_count});
+
+    // a low-complexity query repeats few minimisers
+    std::vector<uint64_t> minimisers(500u);
+    for (auto & minimiser : minimisers)
+        minimiser = gen() % 50u;
+
+    valik::distinct_minimisers distinct{};
+    distinct.assign(minimisers);
+    EXPECT_LE(distinct.values().size(), 50u);
+    ASSERT_EQ(distinct.ids().size(), minimisers.size());
+    for (size_t i{0}; i < minimisers.size(); i++)
+        EXPECT_EQ(distinct.values()[distinct.ids()[i]], minimisers[i]);
+    EXPECT_EQ(distinct.values().front(), minimisers.front());
+
+    auto agent = ibf.membership_agent();
+    valik::counting_matrix counting_table{};
+    valik::fill_counting_table(agent, distinct, counting_table, bin_count);
+    EXPECT_EQ(counting_table.size(), minimisers.size());
+    EXPECT_EQ(counting_table.distinct_size(), distinct.values().size());
+    for (size_t i{0}; i < minimisers.size(); i++)
+    {
+        auto const & bits = agent.bulk_contains(minimisers[i]).raw_data();
+        EXPECT_TRUE(std::equal(bits.data(), bits.data() + counting_table.word_count(), counting_table.row(i)));
+    }
+
+    // a smaller query reuses the buffers
+    distinct.assign({7u, 7u, 8u});
+    EXPECT_EQ(distinct.values(), (std::vector<uint64_t>{7u, 8u}));
+    EXPECT_EQ(distinct.ids(), (std::vector<uint32_t>{0u, 0u, 1u}));
+}
+
+TEST_F(bin_hits, insert_and_clear)
+{
+    valik::bin_hits hits{130u};
+    EXPECT_TRUE(hits.empty());
+    for (size_t const bin : {129u, 3u, 64u, 3u, 0u})
+        hits.insert(bin);
+
+    EXPECT_EQ(hits.size(), 4u);
+    EXPECT_TRUE(hits.contains(64u));
+    EXPECT_FALSE(hits.contains(65u));
+
+    std::vector<size_t> bins{};
+    hits.for_each([&](size_t const bin) { bins.push_back(bin); });
+    EXPECT_EQ(bins, (std::vector<size_t>{0u, 3u, 64u, 129u}));
+
+    hits.clear();
+    EXPECT_TRUE(hits.empty());
+    EXPECT_FALSE(hits.contains(129u));
+}
+
+TEST_F(bin_hits, resize)
+{
+    valik::bin_hits hits{130u};
+    for (size_t const bin : {129u, 3u, 64u})
+        hits.insert(bin);
+
+    hits.resize(10u);
+    EXPECT_TRUE(hits.empty());
+    EXPECT_FALSE(hits.contains(3u));
+    hits.insert(9u);
+
+    std::vector<size_t> bins{};
+    hits.for_each([&](size_t const bin) { bins.push_back(bin); });
+    EXPECT_EQ(bins, (std::vector<size_t>{9u}));
+
+    hits.resize(130u);
+    EXPECT_TRUE(hits.empty());
+    EXPECT_FALSE(hits.contains(9u));
+    EXPECT_FALSE(hits.contains(129u));
+}
+
+TEST_F(hierarchical_prefilter, finds_user_bin_of_each_query)
+{
+    valik::search_arguments arguments{};
+    arguments.pattern_size = 50u;
+    arguments.window_size = 15u;
+    arguments.shape = seqan3::ungapped{15u};
+    arguments.shape_weight = 15u;
+    arguments.errors = 0u;
+
+    // a few large bins and many small bins; the small bins are merged into lower levels
+    size_t const bin_count = 300u;
+    std::vector<uint64_t> weights{};
+    for (size_t bin{0}; bin < bin_count; bin++)
+        weights.push_back((bin % 50 == 0) ? 10000u : 100u);
+    valik::hierarchical_ibf hibf{weights, {.max_bin_bits = 1u << 14, .hash_count = 2u, .fpr = 0.05, .tmax = 64u}};
+    ASSERT_GT(hibf.ibf_vector().size(), 1u);
+
+    auto minimiser_hash = seqan3::views::minimiser_hash(arguments.shape,
+                                                        seqan3::window_size{arguments.window_size},
+                                                        seqan3::seed{valik::adjust_seed(arguments.shape_weight)});
+    std::mt19937_64 gen{42};
+    std::vector<valik::query_record> records(bin_count);
+    for (size_t bin{0}; bin < bin_count; bin++)
+    {
+        records[bin].sequence_id = "query" + std::to_string(bin);
+        for (size_t i{0}; i < 100u; i++)
+            records[bin].sequence.push_back(seqan3::dna4{}.assign_rank(gen() % 4));
+        for (uint64_t const value : records[bin].sequence | minimiser_hash)
+            hibf.emplace(value, bin);
+    }
+
+    raptor::threshold::threshold const thresholder{arguments.make_threshold_parameters()};
+    std::vector<std::vector<size_t>> found(bin_count);
+    valik::local_prefilter(std::span<valik::query_record const>{records}, hibf, arguments, thresholder,
+                           [&](valik::query_record const & record, valik::bin_hits const & hits)
+    {
+        size_t const query = &record - records.data();
+        hits.for_each([&](size_t const bin) { found[query].push_back(bin); });
+    });
+
+    for (size_t bin{0}; bin < bin_count; bin++)
+        EXPECT_TRUE(std::ranges::find(found[bin], bin) != found[bin].end()) << "query" << bin;
+
+    // a context that is reused for several batches, like the context of a producer thread, finds the same bins
+    valik::prefilter_context<valik::hierarchical_ibf> context{hibf};
+    std::vector<std::vector<size_t>> found_with_context(bin_count);
+    for (size_t begin{bin_count}; begin > 0u;)
+    {
+        size_t const end = begin;
+        begin = (begin >= 7u) ? begin - 7u : 0u;
+        valik::local_prefilter(std::span<valik::query_record const>{records.data() + begin, end - begin},
+                               hibf, context, arguments, thresholder,
+                               [&](valik::query_record const & record, valik::bin_hits const & hits)
+        {
+            size_t const query = &record - records.data();
+            hits.for_each([&](size_t const bin) { found_with_context[query].push_back(bin); });
+        });
+    }
+    EXPECT_EQ(found_with_context, found);
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include "../../../app_test.hpp"
+
+#include <valik/search/prefilter_hits.hpp>
+#include <valik/search/query_registry.hpp>
+
+struct prefilter_hits : public app_test
+{};
+
+TEST_F(prefilter_hits, write_and_read)
+{
+    using TSequence = seqan2::String<seqan2::Dna>;
+
+    valik::prefilter_hits_header header{};
+    header.bin_count = 8u;
+    header.split_query = true;
+    header.window_size = 19u;
+    header.shape = seqan3::shape{seqan3::ungapped{15u}};
+    header.ref_meta_path = "/data/reference.bin";
+    header.bin_path = {"/data/reference.fasta"};
+
+    valik::query_registry<TSequence> registry{};
+    auto const segment = registry.record(registry.add("query1", TSequence{"ACGTACGTACGTACGTACGT"}), 5u, 10u);
+    auto const whole = registry.record(registry.add("query2", TSequence{"ACGTAC"}));
+
+    {
+        valik::prefilter_hits_writer writer{"hits.bin", header};
+        writer.write(segment, {0u, 7u});
+        writer.finish_batch();
+        writer.finish_batch();  // a batch without hits is not written
+        // the records of query1 continue in the second batch
+        writer.write(whole, {3u});
+        writer.write(segment, {1u});
+        EXPECT_EQ(writer.record_count(), 3u);
+    }
+
+    valik::prefilter_hits_reader reader{"hits.bin"};
+    EXPECT_EQ(reader.header().bin_count, header.bin_count);
+    EXPECT_EQ(reader.header().split_query, header.split_query);
+    EXPECT_EQ(reader.header().window_size, header.window_size);
+    EXPECT_EQ(reader.header().shape, header.shape);
+    EXPECT_EQ(reader.header().ref_meta_path, header.ref_meta_path);
+    EXPECT_EQ(reader.header().bin_path, header.bin_path);
+
+    std::vector<valik::prefilter_hit_record> batch{};
+    ASSERT_TRUE(reader.read_batch(batch));
+    ASSERT_EQ(batch.size(), 1u);
+    EXPECT_EQ(batch[0].sequence_id, "query1");
+    EXPECT_EQ(batch[0].begin, 5u);
+    EXPECT_EQ(batch[0].length, 10u);
+    EXPECT_EQ(batch[0].bins, (std::vector<uint32_t>{0u, 7u}));
+    ASSERT_TRUE(reader.read_batch(batch));
+    EXPECT_EQ(batch.size(), 2u);
+    EXPECT_FALSE(reader.read_batch(batch));
+    EXPECT_TRUE(batch.empty());
+}
+
+TEST_F(prefilter_hits, merge_with_query_file)
+{
+    using TSequence = seqan2::String<seqan2::Dna>;
+
+    valik::prefilter_hits_header header{};
+    header.bin_count = 8u;
+
+    valik::query_registry<TSequence> registry{};
+    auto const segment = registry.record(registry.add("query1", TSequence{"ACGTACGTACGTACGTACGT"}), 5u, 10u);
+    auto const whole = registry.record(registry.add("query2", TSequence{"ACGTAC"}));
+    {
+        valik::prefilter_hits_writer writer{"hits.bin", header};
+        writer.write(segment, {0u, 7u});
+        writer.finish_batch();
+        writer.write(whole, {3u});
+        writer.write(segment, {1u});
+    }
+
+    // the query sequences are visited in the order of the query file
+    valik::prefilter_hits_reader reader{"hits.bin"};
+    std::vector<valik::prefilter_hit_record> records{};
+    reader.take_records("query0", records);
+    EXPECT_TRUE(records.empty());
+
+    reader.take_records("query1", records);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].begin, 5u);
+    EXPECT_EQ(records[0].length, 10u);
+    EXPECT_EQ(records[0].bins, (std::vector<uint32_t>{0u, 7u}));
+    EXPECT_EQ(records[1].bins, (std::vector<uint32_t>{1u}));
+    EXPECT_FALSE(reader.finished());
+
+    reader.take_records("query2", records);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].begin, 0u);
+    EXPECT_EQ(records[0].length, 6u);
+    EXPECT_EQ(records[0].bins, (std::vector<uint32_t>{3u}));
+    EXPECT_TRUE(reader.finished());
+
+    reader.take_records("query3", records);
+    EXPECT_TRUE(records.empty());
+}
+
+TEST_F(prefilter_hits, invalid_file)
+{
+    {
+        std::ofstream os{"not_hits.bin"};
+        os << ">query\nACGT\n";
+    }
+    EXPECT_THROW(valik::prefilter_hits_reader{"not_hits.bin"}, std::runtime_error);
+
+    valik::prefilter_hits_header header{};
+    header.bin_count = 2u;
+    {
+        valik::prefilter_hits_writer writer{"out_of_range.bin", header};
+        writer.write(valik::query_record{"query", {}}, {2u});
+    }
+    valik::prefilter_hits_reader reader{"out_of_range.bin"};
+    std::vector<valik::prefilter_hit_record> records{};
+    EXPECT_THROW(reader.read_batch(records), std::runtime_error);
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <valik/search/query_registry.hpp>
+
+using TSequence = seqan2::String<seqan2::Dna>;
+
+TEST(query_registry, resolves_handles)
+{
+    valik::query_registry<TSequence> registry{};
+    valik::query_handle const first = registry.add("query1", TSequence{"ACGTACGTAC"});
+    valik::query_handle const second = registry.add("query2", TSequence{"GGGTTT"});
+    EXPECT_EQ(registry.size(), 2u);
+
+    auto const segment = registry.record(first, 2u, 5u);
+    EXPECT_EQ(segment.sequence_id, "query1");
+    EXPECT_EQ(segment.size(), 5u);
+    EXPECT_EQ(seqan2::beginPosition(segment.querySegment), 2u);
+    EXPECT_EQ(TSequence{segment.querySegment}, TSequence{"GTACG"});
+
+    auto const whole = registry.record(second);
+    EXPECT_EQ(whole.ref.handle, second);
+    EXPECT_EQ(whole.ref.begin, 0u);
+    EXPECT_EQ(whole.ref.length, 6u);
+    EXPECT_EQ(registry.id(second), "query2");
+    EXPECT_EQ(TSequence{registry.segment(whole.ref)}, TSequence{"GGGTTT"});
+
+    EXPECT_THROW(registry.record(second, 4u, 3u), std::runtime_error);
+}
+
+TEST(query_registry, frees_sequence_after_last_reference)
+{
+    valik::query_registry<TSequence> registry{};
+    valik::query_handle const handle = registry.add("query", TSequence{"ACGTACGT"});
+    auto const first_half = registry.record(handle, 0u, 4u);
+    auto const second_half = registry.record(handle, 4u, 4u);
+    registry.release(handle);   // the reference of the reader
+
+    // the first half is in two carts, the second half in one
+    registry.retain(handle, 2u);
+    registry.retain(handle, 1u);
+    std::vector<valik::query_ref> const cart{first_half.ref, first_half.ref, second_half.ref};
+    std::vector<valik::shared_query_record<TSequence>> const batch{first_half, second_half};
+    registry.release(batch);
+    EXPECT_EQ(registry.id(handle), "query");
+
+    registry.release(cart);
+    EXPECT_TRUE(registry.id(handle).empty());
+}
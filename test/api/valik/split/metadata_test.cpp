@@ -49,6 +49,40 @@ TEST_F(split_options, split_metagenome_clusters)
     }    
 }
 
+TEST_F(split_options, update_metagenome_clusters)
+{
+    valik::build_arguments arguments{};
+    arguments.metagenome = true;
+
+    std::vector<std::string> new_bins{};
+    for (size_t i{0}; i < 8; i++)
+    {
+        std::string file_path = data("bin_" + std::to_string(i) + ".fasta");
+        if (i < 6)
+            arguments.bin_path.emplace_back(file_path);
+        else
+            new_bins.emplace_back(file_path);
+    }
+
+    valik::metadata meta(arguments);
+    meta.add_metagenome_bins(new_bins);
+    EXPECT_EQ(meta.seq_count, 8u * 2);
+    EXPECT_EQ(meta.seg_count, 8u);
+    EXPECT_EQ(meta.total_len, 8192*2);
+    for (size_t i{0}; i < 8; i++)
+    {
+        EXPECT_EQ(meta.files[i].id, i);
+        EXPECT_EQ(meta.segments[i].id, i);
+    }
+
+    uint64_t const cleared_len = meta.segments[2].len;
+    meta.clear_segment(2);
+    EXPECT_EQ(meta.seg_count, 8u);
+    EXPECT_EQ(meta.segments[2].len, 0u);
+    EXPECT_EQ(meta.total_len, 8192*2 - cleared_len);
+    EXPECT_THROW(meta.clear_segment(8), std::runtime_error);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////// valik split index bins /////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
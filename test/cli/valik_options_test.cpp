@@ -36,11 +36,14 @@ TEST_F(argparse_build, no_options)
         "dream-stellar - DNA search tool for finding local alignments between long sequences.\n"
         "====================================================================================\n"
         "    dream-stellar build [--metagenome] [--fast] [--without-parameter-tuning]\n"
-        "    [--split-only] [--write-out] [--verbose] [--pattern uint64]\n"
+        "    [--split-only] [--write-out] [--mapped-index] [--compressed] [--hibf]\n"
+        "    [--verbose] [--use-filesize-dependent-cutoff] [--pattern uint64]\n"
         "    [-e|--error-rate float] [--fpr float] [-k|--kmer uint8] [-s|--shape\n"
         "    string] [-n|--seg-count uint32] [-o|--output path] [--threads uint8]\n"
         "    [--inf-cont double] [-w|--window uint8] [--hash uint64] [--size string]\n"
-        "    [--kmer-count-min uint8] [--kmer-count-max uint8] [--] path\n"
+        "    [--minimiser-memory string] [--tmax uint64] [--index-version uint32]\n"
+        "    [--shards uint64] [--kmer-count-min uint8] [--kmer-count-max uint8] [--]\n"
+        "    path\n"
         "    Try -h or --help for more information.\n"
     };
     EXPECT_SUCCESS(result);
@@ -58,15 +61,17 @@ TEST_F(argparse_search, no_options)
         "dream-stellar - DNA search tool for finding local alignments between long sequences.\n"
         "====================================================================================\n"
         "    dream-stellar search [--split-query] [--fast] [--time] [--verbose]\n"
-        "    [--very-verbose] [--distribute] [--stellar-only]\n"
-        "    [--without-parameter-tuning] [--cache-thresholds] --index path --query\n"
-        "    path --output path [-e|--error-rate float] [--pattern uint64] [--threads\n"
-            "    uint8] [--bin-entropy-cutoff double] [--bin-cutoff double] [-n|--seg-count\n"
-            "    uint32] [--threshold uint64] [--query-every uint8] [--cart-max-capacity\n"
-            "    uint64] [--max-queued-carts uint64] [--minLength uint32] [--disableThresh\n"
-            "    uint64] [-s|--sortThresh uint64] [-q|--stellar-kmer uint64]\n"
-        "    [-c|--abundanceCut double] [--repeatPeriod uint64] [--repeatLength uint64]\n"
-        "    [-x|--xDrop double] [--verification string] [--numMatches uint64]\n"
+        "    [--very-verbose] [--distribute] [--prefilter-only] [--stellar-only]\n"
+        "    [--without-parameter-tuning] [--cache-thresholds] [--lock-free-queue]\n"
+        "    [--index path] --query path [--output path] [-e|--error-rate float]\n"
+        "    [--pattern uint64] [--threads uint8] [--prefilter-hits path]\n"
+        "    [--bin-entropy-cutoff double] [--bin-cutoff double] [-n|--seg-count\n"
+        "    uint32] [--threshold uint64] [--query-every uint8] [--shards string]\n"
+        "    [--cart-max-capacity uint64] [--max-queued-carts uint64] [--cart-duration\n"
+        "    double] [--minLength uint32] [--disableThresh uint64] [-s|--sortThresh\n"
+        "    uint64] [-q|--stellar-kmer uint64] [-c|--abundanceCut double]\n"
+        "    [--repeatPeriod uint64] [--repeatLength uint64] [-x|--xDrop double]\n"
+        "    [--verification string] [--numMatches uint64]\n"
         "    Try -h or --help for more information.\n"
     };
     EXPECT_SUCCESS(result);
@@ -81,7 +86,7 @@ TEST_F(argparse, no_subparser)
     app_test_result const result = execute_app("dream-stellar", "foo");
     std::string const expected
     {
-        "[Error] You specified an unknown subcommand! Available subcommands are: [build, search]. "
+        "[Error] You specified an unknown subcommand! Available subcommands are: [build, search, update]. "
         "Use -h/--help for more information.\n"
     };
     EXPECT_FAILURE(result);
@@ -254,6 +259,17 @@ TEST_F(argparse_search, output_wrong)
     EXPECT_EQ(result.err, std::string{"[Error] Validation failed for option --output: Cannot write \"foo/search.gff\"!\n"});
 }
 
+TEST_F(argparse_search, prefilter_only_without_hits_file)
+{
+    app_test_result const result = execute_app("dream-stellar", "search",
+                                                         "--query ", dummy_query_file.file_path,
+                                                         "--index ", data("8bins19window.ibf"),
+                                                         "--prefilter-only");
+    EXPECT_FAILURE(result);
+    EXPECT_EQ(result.out, std::string{});
+    EXPECT_EQ(result.err, std::string{"[Error] Option --prefilter-only requires --prefilter-hits.\n"});
+}
+
 TEST_F(argparse_search, pattern_window)
 {
     app_test_result const result = execute_app("dream-stellar", "search",
@@ -0,0 +1,347 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <ranges>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "app_test_cli_base.hpp"
+
+#include <valik/search/load_index.hpp>
+#include <valik/search/prefilter_hits.hpp>
+#include <valik/split/metadata.hpp>
+
+struct valik_update : public app_test_cli_base
+{
+    static std::string bin_file(size_t const bin)
+    {
+        return data("bin_" + std::to_string(bin) + ".fasta").string();
+    }
+
+    static void write_bin_list(std::filesystem::path const & list_file, std::vector<size_t> const & bins)
+    {
+        std::ofstream file{list_file};
+        for (size_t const bin : bins)
+            file << bin_file(bin) << '\n';
+    }
+
+    // builds an index of the given bins with a window that is larger than the k-mer, i.e. with threshold tables
+    static app_test_result build_index(std::vector<size_t> const & bins, std::string const & size)
+    {
+        write_bin_list("bin_paths.txt", bins);
+        return execute_app("dream-stellar", "build",
+                           "bin_paths.txt",
+                           "--metagenome",
+                           "--kmer 19",
+                           "--window 23",
+                           "--size ", size,
+                           "--output index.ibf",
+                           "--without-parameter-tuning");
+    }
+
+    // builds an index with --fast, i.e. from minimisers that are filtered by their k-mer count
+    static app_test_result build_fast_index(std::vector<size_t> const & bins,
+                                            std::string const & size,
+                                            std::filesystem::path const & index_file)
+    {
+        write_bin_list("bin_paths.txt", bins);
+        return execute_app("dream-stellar", "build",
+                           "bin_paths.txt",
+                           "--metagenome",
+                           "--kmer 19",
+                           "--fast",
+                           "--kmer-count-max 1",
+                           "--size ", size,
+                           "--output ", index_file,
+                           "--without-parameter-tuning");
+    }
+
+    static std::string file_bytes(std::filesystem::path const & file)
+    {
+        std::ifstream stream{file, std::ios::binary};
+        return std::string{std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+    }
+
+    // writes the first 150bp of a bin as a query
+    static void write_query(std::filesystem::path const & query_file, size_t const bin)
+    {
+        std::ifstream fasta{bin_file(bin)};
+        std::string line;
+        std::string sequence;
+        std::getline(fasta, line);
+        while (std::getline(fasta, line) && !line.starts_with('>'))
+            sequence += line;
+
+        std::ofstream file{query_file};
+        file << ">bin_" << bin << "_query\n" << sequence.substr(0, 150) << '\n';
+    }
+
+    // the bins that search reports for a query taken from the given bin
+    static std::set<uint32_t> prefilter_bins(std::filesystem::path const & index_file, size_t const bin)
+    {
+        write_query("query.fasta", bin);
+        app_test_result const result = execute_app("dream-stellar", "search",
+                                                   "--prefilter-only",
+                                                   "--prefilter-hits hits.bin",
+                                                   "--index ", index_file,
+                                                   "--query query.fasta",
+                                                   "--pattern 50",
+                                                   "--error-rate 0",
+                                                   "--without-parameter-tuning");
+        EXPECT_SUCCESS(result);
+
+        std::set<uint32_t> bins{};
+        valik::prefilter_hits_reader reader{"hits.bin"};
+        std::vector<valik::prefilter_hit_record> records{};
+        reader.take_records("bin_" + std::to_string(bin) + "_query", records);
+        for (auto const & record : records)
+            bins.insert(record.bins.begin(), record.bins.end());
+        return bins;
+    }
+
+    static std::string threshold_bytes(std::filesystem::path const & index_file)
+    {
+        valik::valik_index<> index{};
+        valik::load_index(index, index_file);
+        std::ostringstream os{};
+        {
+            cereal::BinaryOutputArchive oarchive{os};
+            oarchive(index.thresholds());
+        }
+        return os.str();
+    }
+};
+
+TEST_F(valik_update, add_without_rebuild)
+{
+    app_test_result const build = build_index({0u, 1u, 2u, 3u}, "1m");
+    EXPECT_SUCCESS(build);
+    valik::valik_index<> before{};
+    valik::load_index(before, "index.ibf");
+
+    write_bin_list("add.txt", {4u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--add add.txt",
+                                               "--output updated.ibf",
+                                               "--verbose");
+    EXPECT_SUCCESS(result);
+    EXPECT_EQ(result.out.find("Rebuilding"), std::string::npos);
+    EXPECT_EQ(result.err, std::string{});
+
+    valik::valik_index<> after{};
+    valik::load_index(after, "updated.ibf");
+    EXPECT_EQ(after.ibf().bin_count(), 5u);
+    EXPECT_EQ(after.ibf().bin_size(), before.ibf().bin_size());
+    ASSERT_EQ(after.bin_path().size(), 5u);
+    EXPECT_EQ(after.bin_path()[4], bin_file(4u));
+
+    // old bins are kept as they are
+    auto before_agent = before.ibf().counting_agent<uint16_t>();
+    auto after_agent = after.ibf().counting_agent<uint16_t>();
+    for (uint64_t value{0}; value < 1000u; ++value)
+    {
+        auto const & expected = before_agent.bulk_count(std::views::single(value));
+        auto const & actual = after_agent.bulk_count(std::views::single(value));
+        for (size_t bin{0}; bin < 4u; ++bin)
+            EXPECT_EQ(expected[bin], actual[bin]);
+    }
+
+    EXPECT_TRUE(prefilter_bins("updated.ibf", 4u).contains(4u));
+    EXPECT_TRUE(prefilter_bins("updated.ibf", 0u).contains(0u));
+}
+
+TEST_F(valik_update, add_with_rebuild)
+{
+    // 512 bits per bin can not hold a new bin at the FPR of the index
+    app_test_result const build = build_index({0u, 1u, 2u, 3u}, "4k");
+    EXPECT_SUCCESS(build);
+    valik::valik_index<> before{};
+    valik::load_index(before, "index.ibf");
+
+    write_bin_list("add.txt", {4u, 5u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--add add.txt",
+                                               "--output updated.ibf",
+                                               "--verbose");
+    EXPECT_SUCCESS(result);
+    EXPECT_NE(result.out.find("New bins exceed the FPR of the IBF. Rebuilding with "), std::string::npos);
+    EXPECT_EQ(result.err, std::string{});
+
+    valik::valik_index<> after{};
+    valik::load_index(after, "updated.ibf");
+    EXPECT_EQ(after.ibf().bin_count(), 6u);
+    EXPECT_GT(after.ibf().bin_size(), before.ibf().bin_size());
+    EXPECT_EQ(after.ibf().hash_function_count(), before.ibf().hash_function_count());
+
+    // old bins are hashed again into the rebuilt IBF
+    for (size_t bin : {0u, 3u, 4u, 5u})
+        EXPECT_TRUE(prefilter_bins("updated.ibf", bin).contains(bin));
+}
+
+TEST_F(valik_update, remove_keeps_bin_ids)
+{
+    app_test_result const build = build_index({0u, 1u, 2u, 3u}, "1m");
+    EXPECT_SUCCESS(build);
+    EXPECT_TRUE(prefilter_bins("index.ibf", 1u).contains(1u));
+
+    write_bin_list("remove.txt", {1u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--remove remove.txt",
+                                               "--output updated.ibf");
+    EXPECT_SUCCESS(result);
+    EXPECT_EQ(result.out, std::string{});
+    EXPECT_EQ(result.err, std::string{});
+
+    valik::valik_index<> after{};
+    valik::load_index(after, "updated.ibf");
+    EXPECT_EQ(after.ibf().bin_count(), 4u);
+    EXPECT_EQ(after.bin_path().size(), 4u);
+    EXPECT_EQ(after.bin_path()[2], bin_file(2u));
+
+    valik::metadata const meta("updated.bin");
+    ASSERT_EQ(meta.segments.size(), 4u);
+    EXPECT_EQ(meta.segments[1].len, 0u);
+    EXPECT_GT(meta.segments[2].len, 0u);
+
+    EXPECT_FALSE(prefilter_bins("updated.ibf", 1u).contains(1u));
+    EXPECT_TRUE(prefilter_bins("updated.ibf", 2u).contains(2u));
+    EXPECT_TRUE(prefilter_bins("updated.ibf", 3u).contains(3u));
+}
+
+TEST_F(valik_update, metadata_and_thresholds_round_trip)
+{
+    app_test_result const build = build_index({0u, 1u, 2u, 3u}, "1m");
+    EXPECT_SUCCESS(build);
+    valik::metadata const before("index.bin");
+    std::string const thresholds = threshold_bytes("index.ibf");
+    EXPECT_FALSE(thresholds.empty());
+
+    write_bin_list("add.txt", {4u});
+    write_bin_list("remove.txt", {0u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--add add.txt",
+                                               "--remove remove.txt");
+    EXPECT_SUCCESS(result);
+
+    // the index and its metadata are overwritten by default
+    valik::metadata const after("index.bin");
+    EXPECT_EQ(after.pattern_size, before.pattern_size);
+    EXPECT_EQ(after.ibf_fpr, before.ibf_fpr);
+    EXPECT_EQ(after.information_content, before.information_content);
+    EXPECT_EQ(after.total_len, before.total_len - before.segments[0].len + after.segments[4].len);
+    ASSERT_EQ(after.files.size(), 5u);
+    EXPECT_EQ(after.files[4].path, bin_file(4u));
+    ASSERT_EQ(after.segments.size(), 5u);
+    EXPECT_EQ(after.segments[0].len, 0u);
+    for (size_t bin{1}; bin < 4u; ++bin)
+    {
+        EXPECT_EQ(after.segments[bin].start, before.segments[bin].start);
+        EXPECT_EQ(after.segments[bin].len, before.segments[bin].len);
+        EXPECT_EQ(after.segments[bin].seq_vec, before.segments[bin].seq_vec);
+    }
+
+    EXPECT_EQ(threshold_bytes("index.ibf"), thresholds);
+
+    // a second round trip does not change the metadata
+    write_bin_list("remove.txt", {0u});
+    app_test_result const again = execute_app("dream-stellar", "update",
+                                              "index.ibf",
+                                              "--remove remove.txt");
+    EXPECT_SUCCESS(again);
+    valik::metadata const reloaded("index.bin");
+    EXPECT_EQ(reloaded.total_len, after.total_len);
+    EXPECT_EQ(reloaded.ibf_fpr, after.ibf_fpr);
+    EXPECT_EQ(reloaded.information_content, after.information_content);
+    EXPECT_EQ(reloaded.segments.size(), after.segments.size());
+    EXPECT_EQ(threshold_bytes("index.ibf"), thresholds);
+}
+
+TEST_F(valik_update, add_to_fast_index)
+{
+    app_test_result const build = build_fast_index({0u, 1u, 2u, 3u}, "1m", "index.ibf");
+    EXPECT_SUCCESS(build);
+    std::filesystem::create_directory("full");
+    app_test_result const full_build = build_fast_index({0u, 1u, 2u, 3u, 4u}, "1m", "full/index.ibf");
+    EXPECT_SUCCESS(full_build);
+
+    write_bin_list("add.txt", {4u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--add add.txt",
+                                               "--output updated.ibf",
+                                               "--minimiser-memory 1k");
+    EXPECT_SUCCESS(result);
+    EXPECT_EQ(result.err, std::string{});
+
+    // the new bin is filtered with the cutoffs of build
+    EXPECT_EQ(file_bytes("bin_4.minimiser"), file_bytes("full/bin_4.minimiser"));
+    EXPECT_EQ(file_bytes("bin_4.header"), file_bytes("full/bin_4.header"));
+
+    valik::valik_index<> after{};
+    valik::load_index(after, "updated.ibf");
+    valik::valik_index<> full{};
+    valik::load_index(full, "full/index.ibf");
+    EXPECT_EQ(after.ibf().bin_count(), 5u);
+    EXPECT_EQ(after.entropy_ranking(), full.entropy_ranking());
+    EXPECT_TRUE(prefilter_bins("updated.ibf", 4u).contains(4u));
+}
+
+TEST_F(valik_update, rebuild_fast_index_from_minimisers)
+{
+    app_test_result const build = build_fast_index({0u, 1u, 2u, 3u}, "4k", "index.ibf");
+    EXPECT_SUCCESS(build);
+
+    write_bin_list("add.txt", {4u, 5u});
+    write_bin_list("remove.txt", {1u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--add add.txt",
+                                               "--remove remove.txt",
+                                               "--output updated.ibf",
+                                               "--verbose");
+    EXPECT_SUCCESS(result);
+    EXPECT_NE(result.out.find("New bins exceed the FPR of the IBF. Rebuilding with "), std::string::npos);
+
+    valik::valik_index<> after{};
+    valik::load_index(after, "updated.ibf");
+    ASSERT_EQ(after.entropy_ranking().size(), 6u);
+    EXPECT_EQ(after.entropy_ranking().back(), 1u);   // cleared bins are ranked last
+
+    // old bins are inserted from the minimiser files that build wrote next to the index
+    for (size_t bin : {0u, 3u, 4u, 5u})
+        EXPECT_TRUE(prefilter_bins("updated.ibf", bin).contains(bin));
+
+    std::filesystem::remove("bin_0.header");
+    write_bin_list("add.txt", {6u});
+    app_test_result const missing = execute_app("dream-stellar", "update",
+                                                "updated.ibf",
+                                                "--add add.txt");
+    EXPECT_FAILURE(missing);
+    EXPECT_NE(missing.err.find("bin_0.header"), std::string::npos);
+}
+
+TEST_F(valik_update, fast_index_without_cutoffs)
+{
+    app_test_result const build = build_fast_index({0u, 1u, 2u, 3u}, "1m", "index.ibf");
+    EXPECT_SUCCESS(build);
+
+    // metadata of an index whose cutoffs were not stored
+    valik::metadata meta("index.bin");
+    ASSERT_TRUE(meta.cutoffs.has_value());
+    EXPECT_EQ(meta.cutoffs->max, 1u);
+    meta.cutoffs.reset();
+    meta.save("index.bin");
+
+    write_bin_list("add.txt", {4u});
+    app_test_result const result = execute_app("dream-stellar", "update",
+                                               "index.ibf",
+                                               "--add add.txt");
+    EXPECT_FAILURE(result);
+    EXPECT_NE(result.err.find("cutoffs"), std::string::npos);
+}
@@ -0,0 +1,277 @@
+#include <chrono>
+#include <fstream>
+#include <random>
+
+#include <valik/argument_parsing/shared.hpp>
+#include <valik/build/index_factory.hpp>
+#include <valik/build/store_index.hpp>
+#include <valik/split/metadata.hpp>
+#include <utilities/prepare/compute_bin_size.hpp>
+#include <utilities/threshold/find.hpp>
+
+/**
+ * @brief Times the stages of `dream-stellar build` on a synthetic reference database.
+ *
+ * The reference consists of random sequences of equal length. Each repetition runs the stages in the same order as
+ * valik::app::run_build in a fresh working directory and the results are printed as JSON.
+ */
+
+struct benchmark_arguments
+{
+    size_t reference_length{10'000'000};
+    size_t sequences{4};
+    uint32_t seg_count{1024};
+    size_t pattern_size{150};
+    uint8_t errors{3};
+    uint8_t threads{1u};
+    size_t repetitions{3};
+    bool fast{false};
+    std::filesystem::path work_dir{std::filesystem::temp_directory_path() / "dream-stellar-build-benchmark"};
+    std::filesystem::path output{};
+};
+
+struct stage_result
+{
+    std::string name;
+    size_t repetition;
+    double seconds;
+};
+
+void write_reference(std::filesystem::path const & path, benchmark_arguments const & arguments)
+{
+    std::ofstream out{path};
+    if (!out)
+        throw std::runtime_error{"Could not write reference " + path.string()};
+
+    std::mt19937_64 gen{42};
+    std::uniform_int_distribution<size_t> base{0, 3};
+    size_t const sequence_length = arguments.reference_length / arguments.sequences;
+    for (size_t seq{0}; seq < arguments.sequences; seq++)
+    {
+        out << ">seq" << seq << '\n';
+        for (size_t i{0}; i < sequence_length; i++)
+        {
+            out << "ACGT"[base(gen)];
+            if ((i + 1) % 80 == 0 || i + 1 == sequence_length)
+                out << '\n';
+        }
+    }
+}
+
+template <typename stage_t>
+auto time_stage(std::vector<stage_result> & results, std::string name, size_t const repetition, stage_t && stage)
+{
+    auto const start = std::chrono::steady_clock::now();
+    if constexpr (std::is_void_v<decltype(stage())>)
+    {
+        stage();
+        results.push_back(stage_result{std::move(name), repetition,
+                                       std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()});
+    }
+    else
+    {
+        auto result = stage();
+        results.push_back(stage_result{std::move(name), repetition,
+                                       std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()});
+        return result;
+    }
+}
+
+/**
+ * @brief Function that runs the build stages once.
+ *
+ * @param reference Path to the synthetic reference.
+ * @param arguments Benchmark parameters.
+ * @param repetition Index of the repetition.
+ * @param results Stage timings are appended here.
+ */
+void run_build_stages(std::filesystem::path const & reference,
+                      benchmark_arguments const & arguments,
+                      size_t const repetition,
+                      std::vector<stage_result> & results)
+{
+    using namespace valik;
+
+    std::filesystem::path const out_dir = arguments.work_dir / ("repetition_" + std::to_string(repetition));
+    std::filesystem::remove_all(out_dir);
+    std::filesystem::create_directories(out_dir);
+
+    build_arguments build{};
+    build.bin_path = {reference.string()};
+    build.seg_count_in = arguments.seg_count;
+    build.seg_count = adjust_bin_count(arguments.seg_count);
+    build.pattern_size = arguments.pattern_size;
+    build.errors = arguments.errors;
+    build.error_rate = static_cast<float>(arguments.errors) / arguments.pattern_size;
+    build.threads = arguments.threads;
+    build.fast = arguments.fast;
+    build.out_dir = out_dir;
+    build.out_path = out_dir / "reference.index";
+    build.ref_meta_path = out_dir / "reference.bin";
+
+    metadata const meta = time_stage(results, "metadata", repetition, [&] ()
+    {
+        metadata meta(build);
+        meta.save(build.ref_meta_path);
+        return meta;
+    });
+    build.seg_count = meta.seg_count;
+
+    fn_confs const fn_attr = time_stage(results, "fn_confs", repetition, [&] ()
+    {
+        return fn_confs(param_space());
+    });
+
+    param_set const best_params = time_stage(results, "get_best_params", repetition, [&] ()
+    {
+        return get_best_params(search_pattern(build.errors, build.pattern_size), meta, fn_attr, false).get_equivalent_gapped();
+    });
+    build.kmer_size = best_params.kmer.size();
+    build.shape = best_params.kmer.shape;
+    build.shape_str = best_params.kmer.to_string();
+    build.shape_weight = best_params.kmer.weight();
+    build.window_size = build.fast ? build.kmer_size + 2 : build.kmer_size;
+    build.input_is_minimiser = build.fast;
+
+    time_stage(results, "find_thresholds_for_kmer_size", repetition, [&] ()
+    {
+        return find_thresholds_for_kmer_size(meta, fn_attr, utilities::kmer{build.shape}, build.errors, build.fast);
+    });
+
+    if (build.fast)
+        time_stage(results, "compute_minimiser", repetition, [&] () { raptor::compute_minimiser(build); });
+
+    build.fpr = meta.ibf_fpr;
+    build.bits = time_stage(results, "compute_bin_size", repetition, [&] () { return raptor::compute_bin_size(build); });
+
+    valik_index<> const index = time_stage(results, "index_factory", repetition, [&] ()
+    {
+        return index_factory{build}();
+    });
+
+    time_stage(results, "store_index", repetition, [&] () { store_index(build.out_path, index); });
+
+    std::filesystem::remove_all(out_dir);
+}
+
+void write_results(std::ostream & out, benchmark_arguments const & arguments, std::vector<stage_result> const & results)
+{
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"reference_length\": " << arguments.reference_length << ",\n";
+    out << "    \"sequences\": " << arguments.sequences << ",\n";
+    out << "    \"seg_count\": " << valik::adjust_bin_count(arguments.seg_count) << ",\n";
+    out << "    \"pattern_size\": " << arguments.pattern_size << ",\n";
+    out << "    \"errors\": " << static_cast<int>(arguments.errors) << ",\n";
+    out << "    \"threads\": " << static_cast<int>(arguments.threads) << ",\n";
+    out << "    \"fast\": " << (arguments.fast ? "true" : "false") << ",\n";
+    out << "    \"repetitions\": " << arguments.repetitions << '\n';
+    out << "  },\n";
+    out << "  \"stages\": [";
+    for (size_t i{0}; i < results.size(); i++)
+    {
+        auto const & [name, repetition, seconds] = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"name\": \"" << name << "\", \"repetition\": " << repetition
+            << ", \"seconds\": " << seconds
+            << ", \"bases_per_second\": " << (seconds > 0 ? arguments.reference_length / seconds : 0.0) << '}';
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+void init_parser(sharg::parser & parser, benchmark_arguments & arguments)
+{
+    valik::app::init_shared_meta(parser);
+    parser.info.app_name = "build_benchmark";
+    parser.info.description.emplace_back("Times the stages of dream-stellar build on a random reference database "
+                                         "and prints the results as JSON.");
+
+    parser.add_option(arguments.reference_length,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "reference-length",
+                      .description = "Total length of the reference database in bp.",
+                      .validator = valik::app::positive_integer_validator{}});
+    parser.add_option(arguments.sequences,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "sequences",
+                      .description = "Number of sequences in the reference database.",
+                      .validator = valik::app::positive_integer_validator{}});
+    parser.add_option(arguments.seg_count,
+                      sharg::config{.short_id = 'n',
+                      .long_id = "seg-count",
+                      .description = "Number of segments. Adjusted to the next multiple of 64.",
+                      .validator = valik::app::positive_integer_validator{}});
+    parser.add_option(arguments.pattern_size,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "pattern",
+                      .description = "Minimum length of a local match."});
+    parser.add_option(arguments.errors,
+                      sharg::config{.short_id = 'e',
+                      .long_id = "errors",
+                      .description = "Maximum number of errors of a local match.",
+                      .validator = sharg::arithmetic_range_validator{0, 15}});
+    parser.add_option(arguments.threads,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "threads",
+                      .description = "Choose the number of threads.",
+                      .validator = valik::app::positive_integer_validator{}});
+    parser.add_option(arguments.repetitions,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "repetitions",
+                      .description = "Number of times the build stages are run.",
+                      .validator = valik::app::positive_integer_validator{}});
+    parser.add_flag(arguments.fast,
+                    sharg::config{.short_id = '\0',
+                    .long_id = "fast",
+                    .description = "Build from minimiser files like dream-stellar build --fast."});
+    parser.add_option(arguments.work_dir,
+                      sharg::config{.short_id = '\0',
+                      .long_id = "work-dir",
+                      .description = "Directory for the reference and the build output. Removed afterwards."});
+    parser.add_option(arguments.output,
+                      sharg::config{.short_id = 'o',
+                      .long_id = "output",
+                      .description = "Write the JSON results to this file instead of stdout."});
+}
+
+int main(int argc, char ** argv)
+{
+    try
+    {
+        sharg::parser parser{"build_benchmark", argc, argv, sharg::update_notifications::off};
+        benchmark_arguments arguments{};
+        init_parser(parser, arguments);
+        parser.parse();
+
+        if (arguments.sequences > arguments.seg_count)
+            throw sharg::validation_error{"There can not be more sequences than segments."};
+
+        std::filesystem::create_directories(arguments.work_dir);
+        std::filesystem::path const reference = arguments.work_dir / "reference.fasta";
+        write_reference(reference, arguments);
+
+        std::vector<stage_result> results{};
+        for (size_t repetition{0}; repetition < arguments.repetitions; repetition++)
+            run_build_stages(reference, arguments, repetition, results);
+
+        std::filesystem::remove_all(arguments.work_dir);
+
+        if (arguments.output.empty())
+        {
+            write_results(std::cout, arguments, results);
+        }
+        else
+        {
+            std::ofstream out{arguments.output};
+            write_results(out, arguments, results);
+        }
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << "[Error] " << e.what() << '\n';
+        return -1;
+    }
+
+    return 0;
+}
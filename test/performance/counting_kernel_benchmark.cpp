@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <valik/argument_parsing/shared.hpp>
+#include <valik/search/counting_kernel.hpp>
+
+/**
+ * @brief Times the kernels that accumulate binning bit vectors in local_prefilter for each supported instruction set.
+ *
+ * A pattern is simulated by adding `minimisers` random rows and comparing the counters to a threshold.
+ * The results are printed as JSON.
+ */
+
+struct benchmark_arguments
+{
+    size_t bin_count{1024};
+    size_t minimisers{64};
+    size_t patterns{10000};
+};
+
+std::string_view level_name(valik::detail::simd_level const level)
+{
+    switch (level)
+    {
+        case valik::detail::simd_level::avx512: return "avx512";
+        case valik::detail::simd_level::avx2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    using valik::detail::counting_kernel;
+    using valik::detail::simd_level;
+
+    try
+    {
+        sharg::parser parser{"counting_kernel_benchmark", argc, argv, sharg::update_notifications::off};
+        valik::app::init_shared_meta(parser);
+        parser.info.app_name = "counting_kernel_benchmark";
+        parser.info.description.emplace_back("Times the counting kernels of the prefilter and prints the results as JSON.");
+
+        benchmark_arguments arguments{};
+        parser.add_option(arguments.bin_count,
+                          sharg::config{.short_id = '\0',
+                          .long_id = "bins",
+                          .description = "Number of bins of the IBF.",
+                          .validator = valik::app::positive_integer_validator{}});
+        parser.add_option(arguments.minimisers,
+                          sharg::config{.short_id = '\0',
+                          .long_id = "minimisers",
+                          .description = "Number of minimisers of a pattern.",
+                          .validator = sharg::arithmetic_range_validator{1, 255}});
+        parser.add_option(arguments.patterns,
+                          sharg::config{.short_id = '\0',
+                          .long_id = "patterns",
+                          .description = "Number of simulated patterns.",
+                          .validator = valik::app::positive_integer_validator{}});
+        parser.parse();
+
+        size_t const word_count = (arguments.bin_count + 63) >> 6;
+        std::mt19937_64 gen{42};
+        // sparse rows like the binning bit vectors of a real query
+        std::vector<uint64_t> rows(arguments.minimisers * word_count);
+        for (auto & word : rows)
+            word = gen() & gen() & gen();
+
+        std::vector<simd_level> levels{simd_level::scalar};
+        if (counting_kernel::supported_level() >= simd_level::avx2)
+            levels.push_back(simd_level::avx2);
+        if (counting_kernel::supported_level() >= simd_level::avx512)
+            levels.push_back(simd_level::avx512);
+
+        std::cout << "{\n";
+        std::cout << "  \"context\": {\"bins\": " << arguments.bin_count << ", \"minimisers\": " << arguments.minimisers
+                  << ", \"patterns\": " << arguments.patterns << "},\n";
+        std::cout << "  \"kernels\": [";
+        for (size_t l{0}; l < levels.size(); l++)
+        {
+            counting_kernel const kernel = counting_kernel::for_level(levels[l]);
+            std::vector<uint8_t> counts(word_count * 64u);
+            std::vector<uint64_t> mask(word_count);
+            size_t hits{0};
+
+            auto const start = std::chrono::steady_clock::now();
+            for (size_t pattern{0}; pattern < arguments.patterns; pattern++)
+            {
+                std::ranges::fill(counts, 0);
+                for (size_t i{0}; i < arguments.minimisers; i++)
+                    kernel.add(counts.data(), rows.data() + i * word_count, word_count);
+                kernel.above_threshold(counts.data(), word_count, arguments.minimisers / 8u + 1u, mask.data());
+                hits += std::popcount(mask[pattern % word_count]);
+            }
+            double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << (l == 0 ? "\n" : ",\n");
+            std::cout << "    {\"name\": \"" << level_name(kernel.level) << "\", \"seconds\": " << seconds
+                      << ", \"ns_per_row\": " << seconds * 1e9 / (arguments.patterns * arguments.minimisers)
+                      << ", \"hits\": " << hits << '}';
+        }
+        std::cout << "\n  ]\n";
+        std::cout << "}\n";
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << "[Error] " << e.what() << '\n';
+        return -1;
+    }
+
+    return 0;
+}